@@ -3,6 +3,379 @@
 #include <string>
 using namespace std;
 #include <vector>
+#include <memory>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <algorithm>
+#include <numeric>
+#include <unordered_map>
+#include <fstream>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <cstdio>
+#include <charconv>
+#include <sstream>
+#include <chrono>
+#include <type_traits>
+#include <variant>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <dirent.h>
+#include <cerrno>
+#endif
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <signal.h>
+#endif
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+
+// ShapeWriter Class
+//
+// Formats text straight into a buffer without per-field string temporaries.
+// The target is an ostream or a string (written in 16 KB blocks), or a
+// caller-supplied fixed buffer (writing stops, and truncated() turns true,
+// once it is full). Doubles use the same fixed 6-decimal format as to_string().
+
+class ShapeWriter {
+private:
+    char staging[16384];      // Block buffer for stream and string targets
+    char* buffer;
+    size_t capacity;
+    size_t used = 0;          // Bytes waiting in buffer
+    size_t written = 0;       // Bytes accepted so far
+    ostream* stream = nullptr;
+    string* text = nullptr;
+    bool overflowed = false;  // A fixed buffer ran out of space
+
+    void put(const char* p, size_t n) {
+        while (n > 0) {
+            if (used == capacity) {
+                if (stream == nullptr && text == nullptr) {
+                    overflowed = true;
+                    return;
+                }
+                flush();
+            }
+            size_t chunk = min(n, capacity - used);
+            memcpy(buffer + used, p, chunk);
+            used += chunk;
+            written += chunk;
+            p += chunk;
+            n -= chunk;
+        }
+    }
+
+public:
+    explicit ShapeWriter(ostream& out) : buffer(staging), capacity(sizeof(staging)), stream(&out) {}
+    explicit ShapeWriter(string& out) : buffer(staging), capacity(sizeof(staging)), text(&out) {}
+    ShapeWriter(char* target, size_t size) : buffer(target), capacity(size) {}
+
+    ShapeWriter(const ShapeWriter&) = delete;
+    ShapeWriter& operator=(const ShapeWriter&) = delete;
+
+    ShapeWriter& operator<<(const char* s) {
+        put(s, strlen(s));
+        return *this;
+    }
+
+    ShapeWriter& operator<<(const string& s) {
+        put(s.data(), s.size());
+        return *this;
+    }
+
+    ShapeWriter& operator<<(char c) {
+        put(&c, 1);
+        return *this;
+    }
+
+    template <typename T>
+    typename enable_if<is_integral<T>::value && !is_same<T, bool>::value && !is_same<T, char>::value, ShapeWriter&>::type
+    operator<<(T value) {
+        char digits[24];
+        to_chars_result r = to_chars(digits, digits + sizeof(digits), value);
+        put(digits, r.ptr - digits);
+        return *this;
+    }
+
+    ShapeWriter& operator<<(double value) {
+        char digits[400];  // Enough for any double in fixed notation
+        to_chars_result r = to_chars(digits, digits + sizeof(digits), value, chars_format::fixed, 6);
+        put(digits, r.ptr - digits);
+        return *this;
+    }
+
+    // Hand the buffered block to the stream or string target
+    void flush() {
+        if (stream != nullptr) {
+            stream->write(buffer, used);
+            used = 0;
+        } else if (text != nullptr) {
+            text->append(buffer, used);
+            used = 0;
+        }
+    }
+
+    // Bytes written so far (into the fixed buffer, or in total)
+    size_t size() const {
+        return written;
+    }
+
+    // Check whether a fixed buffer was too small for everything written
+    bool truncated() const {
+        return overflowed;
+    }
+
+    // Destructor: flush the last block
+    ~ShapeWriter() {
+        flush();
+    }
+};
+
+
+// ==============================
+// Test function for ShapeWriter class
+// ==============================
+void test_shape_writer_class() {
+    cout << "\n========== Running test_shape_writer_class() ==========" << endl;
+
+    int passed = 0, failed = 0;
+
+    // Test 1: Numbers are formatted like to_string()
+    string text;
+    {
+        ShapeWriter out(text);
+        out << "n=" << 42 << ',' << static_cast<size_t>(7) << ',' << -3 << ',' << 3.14159265 << ',' << 1e20 << ',' << 0.0000004;
+    }
+    if (text == "n=42,7,-3," + to_string(3.14159265) + "," + to_string(1e20) + "," + to_string(0.0000004)) {
+        cout << "Test 1 passed: Number formatting" << endl;
+        passed++;
+    } else {
+        cout << "Test 1 FAILED: Number formatting" << endl;
+        failed++;
+    }
+
+    // Test 2: Output larger than one block reaches the stream intact
+    ostringstream stream;
+    {
+        ShapeWriter out(stream);
+        for (int i = 0; i < 10000; ++i) out << i << '\n';
+    }
+    string streamed = stream.str();
+    if (streamed.size() == 48890 && streamed.compare(0, 4, "0\n1\n") == 0) {
+        cout << "Test 2 passed: Stream target" << endl;
+        passed++;
+    } else {
+        cout << "Test 2 FAILED: Stream target" << endl;
+        failed++;
+    }
+
+    // Test 3: A fixed buffer stops at its capacity and reports truncation
+    char small[8];
+    ShapeWriter fixed(small, sizeof(small));
+    fixed << "abc" << 12345;
+    bool fits = !fixed.truncated() && fixed.size() == 8;
+    fixed << 'x';
+    if (fits && fixed.truncated() && string(small, 8) == "abc12345") {
+        cout << "Test 3 passed: Fixed buffer target" << endl;
+        passed++;
+    } else {
+        cout << "Test 3 FAILED: Fixed buffer target" << endl;
+        failed++;
+    }
+
+    // Summary
+    cout << "========== Test Summary ==========" << endl;
+    cout << "Passed: " << passed << ", Failed: " << failed << endl;
+    cout << "==================================\n" << endl;
+}
+
+
+// ==============================
+// Diagnostics Collector
+// ==============================
+// Transform outcomes that used to be printed as one warning per shape. While
+// a DiagnosticsCollector is active on a thread, Coordinates and the shape
+// classes record these codes into it instead of writing to cout; with no
+// collector active they print their usual warning.
+
+enum class ShapeDiagnostic {
+    TranslationSkipped,  // Translation would have made a coordinate negative
+    ScaleSkipped,        // Scaling factor was not greater than 0
+    SizeReset,           // Side or radius reset to 1.0 after scaling
+    Count
+};
+
+static constexpr int DIAGNOSTIC_KINDS = static_cast<int>(ShapeDiagnostic::Count);
+
+// Aggregated outcomes of one or more bulk operations
+struct DiagnosticsReport {
+    uint64_t counts[DIAGNOSTIC_KINDS] = {};     // Shapes affected, per outcome
+    vector<pair<size_t, uint32_t>> affected;    // (shape id, bitmask of outcomes), when ids are kept
+
+    static uint32_t bit(ShapeDiagnostic code) {
+        return uint32_t(1) << static_cast<int>(code);
+    }
+
+    uint64_t count(ShapeDiagnostic code) const {
+        return counts[static_cast<int>(code)];
+    }
+
+    uint64_t total() const {
+        uint64_t sum = 0;
+        for (uint64_t c : counts) {
+            sum += c;
+        }
+        return sum;
+    }
+
+    // Return the ids of the shapes that had an outcome, in increasing order
+    vector<size_t> affectedShapes(ShapeDiagnostic code) const {
+        vector<size_t> ids;
+        for (const pair<size_t, uint32_t>& entry : affected) {
+            if (entry.second & bit(code)) {
+                ids.push_back(entry.first);
+            }
+        }
+        sort(ids.begin(), ids.end());
+        return ids;
+    }
+
+    void merge(const DiagnosticsReport& other) {
+        for (int i = 0; i < DIAGNOSTIC_KINDS; ++i) {
+            counts[i] += other.counts[i];
+        }
+        affected.insert(affected.end(), other.affected.begin(), other.affected.end());
+    }
+
+    void clear() {
+        fill(counts, counts + DIAGNOSTIC_KINDS, uint64_t(0));
+        affected.clear();
+    }
+
+    // Write one summary line per outcome that occurred, e.g. "412,233 translations skipped"
+    void write(ShapeWriter& out) const {
+        static const char* const labels[DIAGNOSTIC_KINDS] = {
+            "translations skipped (negative coordinates)",
+            "scales skipped (factor must be greater than 0)",
+            "sizes reset to 1.0 after scaling"
+        };
+        if (total() == 0) {
+            out << "No warnings.\n";
+            return;
+        }
+        for (int i = 0; i < DIAGNOSTIC_KINDS; ++i) {
+            if (counts[i] == 0) {
+                continue;
+            }
+            // Digits grouped in thousands
+            string digits = to_string(counts[i]);
+            for (int pos = static_cast<int>(digits.size()) - 3; pos > 0; pos -= 3) {
+                digits.insert(static_cast<size_t>(pos), 1, ',');
+            }
+            out << digits << ' ' << labels[i] << '\n';
+        }
+    }
+};
+
+// Routes the diagnostics raised on the current thread into a report for as
+// long as it is alive. Collectors nest; the innermost one receives the codes.
+// Between beginShape() calls the outcomes of one shape are merged, so a
+// shape counts once per outcome even if several of its points were skipped.
+class DiagnosticsCollector {
+private:
+    static thread_local DiagnosticsCollector* active;
+
+    DiagnosticsCollector* previous;
+    DiagnosticsReport& report;
+    bool keepIds;
+    bool tracking = false;  // Inside a beginShape() block
+    size_t shape = 0;
+    uint32_t mask = 0;      // Outcomes of the current shape
+
+public:
+    explicit DiagnosticsCollector(DiagnosticsReport& target, bool keepShapeIds = false)
+        : previous(active), report(target), keepIds(keepShapeIds) {
+        active = this;
+    }
+
+    DiagnosticsCollector(const DiagnosticsCollector&) = delete;
+    DiagnosticsCollector& operator=(const DiagnosticsCollector&) = delete;
+
+    // Return the collector of the current thread, or nullptr
+    static DiagnosticsCollector* current() {
+        return active;
+    }
+
+    // Attribute the following outcomes to the shape with the given id
+    void beginShape(size_t id) {
+        finishShape();
+        tracking = true;
+        shape = id;
+    }
+
+    // Close the current shape and add its outcomes to the report
+    void finishShape() {
+        if (tracking && mask != 0) {
+            for (int i = 0; i < DIAGNOSTIC_KINDS; ++i) {
+                if (mask & (uint32_t(1) << i)) {
+                    report.counts[i]++;
+                }
+            }
+            if (keepIds) {
+                report.affected.push_back(make_pair(shape, mask));
+            }
+        }
+        tracking = false;
+        mask = 0;
+    }
+
+    void add(ShapeDiagnostic code, uint64_t times) {
+        if (tracking) {
+            mask |= DiagnosticsReport::bit(code);
+        } else {
+            report.counts[static_cast<int>(code)] += times;
+        }
+    }
+
+    ~DiagnosticsCollector() {
+        finishShape();
+        active = previous;
+    }
+};
+
+thread_local DiagnosticsCollector* DiagnosticsCollector::active = nullptr;
+
+// Record an outcome in the thread's collector. Returns false when no
+// collector is active, in which case the caller prints its warning.
+bool reportDiagnostic(ShapeDiagnostic code, uint64_t times = 1) {
+    DiagnosticsCollector* collector = DiagnosticsCollector::current();
+    if (collector == nullptr) {
+        return false;
+    }
+    collector->add(code, times);
+    return true;
+}
 
 
 // Coordinates Class
@@ -45,19 +418,26 @@ public:
     }
 
     // Method to move the point by dx and dy (only if result remains positive)
-    void translate(int dx, int dy) {
+    // Returns false when the translation was skipped
+    bool translate(int dx, int dy) {
         if ((x + dx) >= 0 && (y + dy) >= 0) {
             x += dx;
             y += dy;
+            return true;
         } else {
-            cout << "Warning: Translation would result in negative coordinates. Operation skipped." << endl;
+            if (!reportDiagnostic(ShapeDiagnostic::TranslationSkipped)) {
+                cout << "Warning: Translation would result in negative coordinates. Operation skipped." << endl;
+            }
+            return false;
         }
     }
 
     // Method to scale the point by a factor (multiply if sign=true, divide if false)
     void scale(int factor, bool sign) {
         if (factor <= 0) {
-            cout << "Warning: Scaling factor must be greater than 0. Operation skipped." << endl;
+            if (!reportDiagnostic(ShapeDiagnostic::ScaleSkipped)) {
+                cout << "Warning: Scaling factor must be greater than 0. Operation skipped." << endl;
+            }
             return;
         }
 
@@ -74,7 +454,17 @@ public:
 
     // Method to return a string representing the coordinates
     string display() const {
-        return "X = " + to_string(x) + ", Y = " + to_string(y);
+        string result;
+        {
+            ShapeWriter out(result);
+            write(out);
+        }
+        return result;
+    }
+
+    // Method to write the coordinates without building a string
+    void write(ShapeWriter& out) const {
+        out << "X = " << x << ", Y = " << y;
     }
 };
 
@@ -200,14 +590,90 @@ void test_coordinate_class() {
 }
 
 
+// Axis-aligned bounding box of a shape
+struct BoundingBox {
+    double minX, minY, maxX, maxY;
+
+    // Check whether two boxes share at least one point
+    bool overlaps(const BoundingBox& other) const {
+        return minX <= other.maxX && other.minX <= maxX &&
+               minY <= other.maxY && other.minY <= maxY;
+    }
+
+    // Smallest box containing both boxes
+    BoundingBox merge(const BoundingBox& other) const {
+        return BoundingBox{min(minX, other.minX), min(minY, other.minY),
+                           max(maxX, other.maxX), max(maxY, other.maxY)};
+    }
+};
+
+// Selects the spatial index kept by a ShapeList
+enum class SpatialIndexKind { None, UniformGrid, RTree };
+
+// Identifies the concrete type behind a Shape pointer
+enum class ShapeKind { Rectangle, Square, Circle, Triangle };
+
 //
 // Abstract Shape Class
 // 
 class Shape {
+private:
+    // Memoized metrics, recomputed only after a change of size
+    mutable double cachedArea = 0.0;
+    mutable double cachedPerimeter = 0.0;
+    mutable bool areaValid = false;
+    mutable bool perimeterValid = false;
+
+    // Cached bounding box, shifted by translate() and multiplied by scale()
+    mutable BoundingBox cachedBox = BoundingBox{0.0, 0.0, 0.0, 0.0};
+    mutable bool boxValid = false;
+
 protected:
     Coordinates position; // Position of the shape (e.g., top-left or center)
     int sides;            // Number of sides of the shape
 
+    // Pure virtual method to compute area (must be overridden)
+    virtual double computeArea() const = 0;
+
+    // Pure virtual method to compute perimeter (must be overridden)
+    virtual double computePerimeter() const = 0;
+
+    // Virtual method to compute the area covered by the shape (can be overridden)
+    virtual BoundingBox computeBoundingBox() const {
+        double x = position.getX(), y = position.getY();
+        return BoundingBox{x, y, x, y};
+    }
+
+    // Mark the cached area and perimeter as stale
+    void invalidateMetrics() {
+        areaValid = false;
+        perimeterValid = false;
+    }
+
+    // Mark the cached bounding box as stale
+    void invalidateBox() {
+        boxValid = false;
+    }
+
+    // Move the cached bounding box along with every point of the shape
+    void shiftBox(int dx, int dy) {
+        cachedBox = BoundingBox{cachedBox.minX + dx, cachedBox.minY + dy, cachedBox.maxX + dx, cachedBox.maxY + dy};
+    }
+
+    // Follow scale(): multiplying scales every point and size alike; integer
+    // division truncates positions but not sizes, so the box is recomputed
+    void scaleBox(int factor, bool sign) {
+        if (factor <= 0) {
+            return;
+        }
+        if (!sign) {
+            boxValid = false;
+            return;
+        }
+        double f = static_cast<double>(factor);
+        cachedBox = BoundingBox{cachedBox.minX * f, cachedBox.minY * f, cachedBox.maxX * f, cachedBox.maxY * f};
+    }
+
 public:
     // Constructor: sets number of sides and initial position
     // Constructor: validates number of sides 
@@ -237,29 +703,82 @@ public:
     void setCoordinates(Coordinates newCoord) {
       
             position = newCoord;
+            invalidateBox();
        
     }
 
     // Translate shape: only perform if resulting position stays non-negative
+    // (moving a shape keeps its size, so the cached metrics stay valid)
     virtual void translate(int dx, int dy) {
-            position.translate(dx, dy);
+            if (position.translate(dx, dy)) {
+                shiftBox(dx, dy);
+            }
+    }
+
+    // Check that every point moved by translate() stays non-negative for any
+    // offset of at least (minDx, minDy), so no translation would be skipped
+    virtual bool fitsTranslation(int minDx, int minDy) const {
+        return position.getX() + minDx >= 0 && position.getY() + minDy >= 0;
     }
 
     // Scale shape: only perform if factor is strictly greater than 0
     virtual void scale(int factor, bool sign) {
 
         position.scale(factor, sign); // This only scales the position
+        if (factor > 0) {
+            invalidateMetrics();
+            scaleBox(factor, sign);
+        }
     }
 
-    // Pure virtual method to compute area (must be overridden)
-    virtual double getArea() const = 0;
+    // Return the area, computing it only when the cache is stale
+    double getArea() const {
+        if (!areaValid) {
+            cachedArea = computeArea();
+            areaValid = true;
+        }
+        return cachedArea;
+    }
 
-    // Pure virtual method to compute perimeter (must be overridden)
-    virtual double getPerimeter() const = 0;
+    // Return the perimeter, computing it only when the cache is stale
+    double getPerimeter() const {
+        if (!perimeterValid) {
+            cachedPerimeter = computePerimeter();
+            perimeterValid = true;
+        }
+        return cachedPerimeter;
+    }
+
+    // Return the area covered by the shape, computing it only when the cache is stale
+    const BoundingBox& getBoundingBox() const {
+        if (!boxValid) {
+            cachedBox = computeBoundingBox();
+            boxValid = true;
+        }
+        return cachedBox;
+    }
+
+    // Pure virtual method to report the concrete shape type (must be overridden)
+    virtual ShapeKind getKind() const = 0;
 
-    // Virtual method to return general shape info (can be overridden)
-    virtual string display() const {
-        return "Shape with " + to_string(sides) + " sides at " + position.display();
+    // Pure virtual method to return a heap-allocated copy (must be overridden)
+    virtual Shape* clone() const = 0;
+
+    // Method to return general shape info
+    // (built from write(), so both always produce the same text)
+    string display() const {
+        string result;
+        {
+            ShapeWriter out(result);
+            write(out);
+        }
+        return result;
+    }
+
+    // Virtual method to write the shape info into a writer (can be overridden)
+    virtual void write(ShapeWriter& out) const {
+        out << "Shape with " << sides << " sides at ";
+        position.write(out);
     }
 
     // Virtual destructor
@@ -365,20 +884,50 @@ public:
         }
     }
 
-    // Override getArea()
-    double getArea() const override {
+    // Area and perimeter formulas, shared with the columnar storage
+    static double areaOf(double width, double length) {
         return width * length;
     }
 
-    // Override getPerimeter()
-    double getPerimeter() const override {
+    static double perimeterOf(double width, double length) {
         return 2 * (width + length);
     }
 
+    // Getters for the dimensions
+    double getWidth() const {
+        return width;
+    }
+
+    double getLength() const {
+        return length;
+    }
+
+    // Override computeArea()
+    double computeArea() const override {
+        return areaOf(width, length);
+    }
+
+    // Override computePerimeter()
+    double computePerimeter() const override {
+        return perimeterOf(width, length);
+    }
+
+    // Override getKind()
+    ShapeKind getKind() const override {
+        return ShapeKind::Rectangle;
+    }
+
+    // Override clone()
+    Shape* clone() const override {
+        return new Rectangle(*this);
+    }
+
     // Override scale(): update dimensions as well as position
     void scale(int factor, bool sign) override {
         if (factor <= 0) {
-            cout << "Warning: Scaling factor must be greater than 0. Operation skipped." << endl;
+            if (!reportDiagnostic(ShapeDiagnostic::ScaleSkipped)) {
+                cout << "Warning: Scaling factor must be greater than 0. Operation skipped." << endl;
+            }
             return;
         }
 
@@ -396,13 +945,20 @@ public:
 
     }
 
-    // Override display()
-    string display() const override {
-        return "Rectangle at " + position.display() +
-               ", Width = " + to_string(width) +
-               ", Length = " + to_string(length) +
-               ", Area = " + to_string(getArea()) +
-               ", Perimeter = " + to_string(getPerimeter());
+    // Override computeBoundingBox(): the position is the top-left corner
+    BoundingBox computeBoundingBox() const override {
+        double x = position.getX(), y = position.getY();
+        return BoundingBox{x, y, x + width, y + length};
+    }
+
+    // Override write()
+    void write(ShapeWriter& out) const override {
+        out << "Rectangle at ";
+        position.write(out);
+        out << ", Width = " << width
+            << ", Length = " << length
+            << ", Area = " << getArea()
+            << ", Perimeter = " << getPerimeter();
     }
 };
 
@@ -535,20 +1091,46 @@ public:
         }
     }
 
-    // Override getArea()
-    double getArea() const override {
+    // Area and perimeter formulas, shared with the columnar storage
+    static double areaOf(double side) {
         return side * side;
     }
 
-    // Override getPerimeter()
-    double getPerimeter() const override {
+    static double perimeterOf(double side) {
         return 4 * side;
     }
 
+    // Getter for the side length
+    double getSide() const {
+        return side;
+    }
+
+    // Override computeArea()
+    double computeArea() const override {
+        return areaOf(side);
+    }
+
+    // Override computePerimeter()
+    double computePerimeter() const override {
+        return perimeterOf(side);
+    }
+
+    // Override getKind()
+    ShapeKind getKind() const override {
+        return ShapeKind::Square;
+    }
+
+    // Override clone()
+    Shape* clone() const override {
+        return new Square(*this);
+    }
+
     // Override scale() with validation
     void scale(int factor, bool sign) override {
         if (factor <= 0) {
-            cout << "Warning: Scaling factor must be greater than 0. Operation skipped." << endl;
+            if (!reportDiagnostic(ShapeDiagnostic::ScaleSkipped)) {
+                cout << "Warning: Scaling factor must be greater than 0. Operation skipped." << endl;
+            }
             return;
         }
 
@@ -564,17 +1146,27 @@ public:
 
         // Ensure side remains valid
         if (side <= 0) {
-            cout << "Warning: Scaling resulted in invalid side length. Resetting to 1.0." << endl;
+            if (!reportDiagnostic(ShapeDiagnostic::SizeReset)) {
+                cout << "Warning: Scaling resulted in invalid side length. Resetting to 1.0." << endl;
+            }
             side = 1.0;
+            invalidateBox();
         }
     }
 
-    // Override display()
-    string display() const override {
-        return "Square at " + position.display() +
-               ", Side = " + to_string(side) +
-               ", Area = " + to_string(getArea()) +
-               ", Perimeter = " + to_string(getPerimeter());
+    // Override computeBoundingBox(): the position is the top-left corner
+    BoundingBox computeBoundingBox() const override {
+        double x = position.getX(), y = position.getY();
+        return BoundingBox{x, y, x + side, y + side};
+    }
+
+    // Override write()
+    void write(ShapeWriter& out) const override {
+        out << "Square at ";
+        position.write(out);
+        out << ", Side = " << side
+            << ", Area = " << getArea()
+            << ", Perimeter = " << getPerimeter();
     }
 };
 
@@ -713,20 +1305,46 @@ public:
         }
     }
 
-    // Override getArea()
-    double getArea() const override {
+    // Area and perimeter formulas, shared with the columnar storage
+    static double areaOf(double radius) {
         return M_PI * radius * radius;  // M_PI is a standard constant for π from <cmath>
     }
 
-    // Override getPerimeter()
-    double getPerimeter() const override {
+    static double perimeterOf(double radius) {
         return 2 * M_PI * radius;
     }
 
+    // Getter for the radius
+    double getRadius() const {
+        return radius;
+    }
+
+    // Override computeArea()
+    double computeArea() const override {
+        return areaOf(radius);
+    }
+
+    // Override computePerimeter()
+    double computePerimeter() const override {
+        return perimeterOf(radius);
+    }
+
+    // Override getKind()
+    ShapeKind getKind() const override {
+        return ShapeKind::Circle;
+    }
+
+    // Override clone()
+    Shape* clone() const override {
+        return new Circle(*this);
+    }
+
     // Override scale(): multiply or divide the radius and scale position
     void scale(int factor, bool sign) override {
         if (factor <= 0) {
-            cout << "Warning: Scaling factor must be greater than 0. Operation skipped." << endl;
+            if (!reportDiagnostic(ShapeDiagnostic::ScaleSkipped)) {
+                cout << "Warning: Scaling factor must be greater than 0. Operation skipped." << endl;
+            }
             return;
         }
 
@@ -742,17 +1360,27 @@ public:
 
         // Ensure radius remains valid
         if (radius <= 0) {
-            cout << "Warning: Radius became non-positive after scaling. Resetting to 1.0." << endl;
+            if (!reportDiagnostic(ShapeDiagnostic::SizeReset)) {
+                cout << "Warning: Radius became non-positive after scaling. Resetting to 1.0." << endl;
+            }
             radius = 1.0;
+            invalidateBox();
         }
     }
 
-    // Override display()
-    string display() const override {
-        return "Circle at " + position.display() +
-               ", Radius = " + to_string(radius) +
-               ", Area = " + to_string(getArea()) +
-               ", Perimeter = " + to_string(getPerimeter());
+    // Override computeBoundingBox(): the position is the centre
+    BoundingBox computeBoundingBox() const override {
+        double x = position.getX(), y = position.getY();
+        return BoundingBox{x - radius, y - radius, x + radius, y + radius};
+    }
+
+    // Override write()
+    void write(ShapeWriter& out) const override {
+        out << "Circle at ";
+        position.write(out);
+        out << ", Radius = " << radius
+            << ", Area = " << getArea()
+            << ", Perimeter = " << getPerimeter();
     }
 };
 
@@ -877,20 +1505,20 @@ public:
     this->position1 = position1 ; this->position2 = position2 ; this->position3 = position3 ;
    }  
 
-   // Override getPerimeter()
-   double getPerimeter() const override {
+   // Perimeter formula, shared with the columnar storage
+   static double perimeterOf( const Coordinates& p1 , const Coordinates& p2 , const Coordinates& p3 ) {
 
     // calculates the three sides of the triangles and return thier sum  
-    double side1 = position1.distance( position2 ) ; 
-    double side2 = position1.distance ( position3 ) ; 
-    double side3 = position2.distance( position3 ) ; 
+    double side1 = p1.distance( p2 ) ; 
+    double side2 = p1.distance ( p3 ) ; 
+    double side3 = p2.distance( p3 ) ; 
 
     return side1 + side2 + side3 ; 
 
    }
-   
-   // Override getArea()
-   double getArea() const override {
+
+   // Area formula, shared with the columnar storage
+   static double areaOf( const Coordinates& p1 , const Coordinates& p2 , const Coordinates& p3 ) {
     
     /* 
     calculate the are of triangle using this formula : 
@@ -904,9 +1532,9 @@ public:
     */
 
     // calculates the three sides of the triangles
-    double side1 = position1.distance( position2 ) ; 
-    double side2 = position1.distance ( position3 ) ; 
-    double side3 = position2.distance( position3 ) ; 
+    double side1 = p1.distance( p2 ) ; 
+    double side2 = p1.distance ( p3 ) ; 
+    double side3 = p2.distance( p3 ) ; 
 
     double s =  ( side1 + side2 + side3 ) / 2.0 ;  // semiperimeter  calculation 
 
@@ -914,14 +1542,54 @@ public:
 
    }
 
+   // Getters for the three vertices
+   Coordinates getPosition1() const { return position1 ; }
+   Coordinates getPosition2() const { return position2 ; }
+   Coordinates getPosition3() const { return position3 ; }
+
+   // Override computePerimeter()
+   double computePerimeter() const override {
+    return perimeterOf( position1 , position2 , position3 ) ; 
+   }
+   
+   // Override computeArea()
+   double computeArea() const override {
+    return areaOf( position1 , position2 , position3 ) ; 
+   }
+
+   // Override getKind()
+   ShapeKind getKind() const override {
+    return ShapeKind::Triangle ; 
+   }
+
+   // Override clone()
+   Shape* clone() const override {
+    return new Triangle( *this ) ; 
+   }
+
    // override translate() 
    void translate( int dx , int dy ) override {
 
     // translate all the three positions 
-    position1.translate( dx , dy ) ;
-    position2.translate( dx , dy ) ; 
-    position3.translate( dx , dy ) ; 
+    int moved = position1.translate( dx , dy ) ;
+    moved += position2.translate( dx , dy ) ; 
+    moved += position3.translate( dx , dy ) ; 
+
+    // if only some vertices moved, the triangle changed shape
+    if ( moved == 1 || moved == 2 ) {
+        invalidateMetrics() ; 
+        invalidateBox() ; 
+    } else if ( moved == 3 ) {
+        shiftBox( dx , dy ) ; 
+    }
+
+   }
 
+   // override fitsTranslation(): translate() moves the three vertices
+   bool fitsTranslation( int minDx , int minDy ) const override {
+    return position1.getX() + minDx >= 0 && position1.getY() + minDy >= 0 &&
+           position2.getX() + minDx >= 0 && position2.getY() + minDy >= 0 &&
+           position3.getX() + minDx >= 0 && position3.getY() + minDy >= 0 ; 
    }
 
    // override scale()
@@ -933,251 +1601,9724 @@ public:
         position2.scale( factor, sign ) ;
         position3.scale( factor, sign ) ;
 
+        if ( factor > 0 ) {
+            invalidateMetrics() ; 
+            scaleBox( factor , sign ) ; 
+        }
+
    }
 
-   // Override display()
-   string display() const override {
-    return "Triangle At " + position1.display() + " | "+ position2.display() + " | " + position3.display() +
-    ", Area = " + to_string(getArea()) +
-    ", Perimeter = " + to_string(getPerimeter());
-    
+   // Override computeBoundingBox(): the box around the three vertices
+   BoundingBox computeBoundingBox() const override {
+    double xs[3] = { double( position1.getX() ) , double( position2.getX() ) , double( position3.getX() ) } ; 
+    double ys[3] = { double( position1.getY() ) , double( position2.getY() ) , double( position3.getY() ) } ; 
+    return BoundingBox{ *min_element( xs , xs + 3 ) , *min_element( ys , ys + 3 ) ,
+                        *max_element( xs , xs + 3 ) , *max_element( ys , ys + 3 ) } ; 
+   }
+
+   // Override write()
+   void write( ShapeWriter& out ) const override {
+    out << "Triangle At " ; 
+    position1.write( out ) ; 
+    out << " | " ; 
+    position2.write( out ) ; 
+    out << " | " ; 
+    position3.write( out ) ; 
+    out << ", Area = " << getArea() << ", Perimeter = " << getPerimeter() ; 
    }
    
    
 } ;
 
 
-// ShapeList Class
 
-class ShapeList {
-private:
-    vector<Shape*> listofShapes;  // Stores a list of shapes using polymorphism
+// ==============================
+// Test function for Triangle class
+// ==============================
+void test_triangle_class() {
+    cout << "\n========== Running test_triangle_class() ==========" << endl;
 
-public:
-    // Add a shape to the list
-    void addShape(Shape* s) {
-        if (s != nullptr) {
-            listofShapes.push_back(s);
-        }
+    int passed = 0, failed = 0;
+
+    // Test 1: Valid constructor (3-4-5 right triangle)
+    Triangle t1(Coordinates(0, 0), Coordinates(4, 0), Coordinates(0, 3));
+    if (t1.getSides() == 3 && fabs(t1.getArea() - 6.0) < 0.001 && fabs(t1.getPerimeter() - 12.0) < 0.001) {
+        cout << "Test 1 passed: Valid constructor and calculations" << endl;
+        passed++;
+    } else {
+        cout << "Test 1 FAILED: Constructor or calculations" << endl;
+        failed++;
     }
 
-    // Translate all shapes in the list by (dx, dy)
+    // Test 2: Translate keeps the (cached) area and moves every vertex
+    t1.translate(5, 5);
+    if (t1.getPosition1().getX() == 5 && t1.getPosition3().getY() == 8 &&
+        fabs(t1.getArea() - 6.0) < 0.001 && fabs(t1.getPerimeter() - 12.0) < 0.001) {
+        cout << "Test 2 passed: Valid translate" << endl;
+        passed++;
+    } else {
+        cout << "Test 2 FAILED: Translate" << endl;
+        failed++;
+    }
+
+    // Test 3: A translate that skips some vertices changes the shape, so the cache must refresh
+    Triangle t2(Coordinates(0, 0), Coordinates(4, 0), Coordinates(10, 3));
+    t2.getArea();
+    t2.translate(-4, 0);  // Only the second and third vertices can move
+    double expected = Triangle::areaOf(Coordinates(0, 0), Coordinates(0, 0), Coordinates(6, 3));
+    if (t2.getPosition1().getX() == 0 && t2.getPosition2().getX() == 0 &&
+        fabs(t2.getArea() - expected) < 0.001) {
+        cout << "Test 3 passed: Partial translate refreshes the area" << endl;
+        passed++;
+    } else {
+        cout << "Test 3 FAILED: Partial translate" << endl;
+        failed++;
+    }
+
+    // Test 4: Scale invalidates the cached metrics
+    t1.scale(2, true);
+    if (fabs(t1.getArea() - 24.0) < 0.001 && fabs(t1.getPerimeter() - 24.0) < 0.001) {
+        cout << "Test 4 passed: Scale *2" << endl;
+        passed++;
+    } else {
+        cout << "Test 4 FAILED: Scale *2" << endl;
+        failed++;
+    }
+
+    // Test 5: Invalid scale keeps the triangle unchanged
+    t1.scale(0, true);
+    if (fabs(t1.getArea() - 24.0) < 0.001) {
+        cout << "Test 5 passed: Invalid scale skipped" << endl;
+        passed++;
+    } else {
+        cout << "Test 5 FAILED: Invalid scale" << endl;
+        failed++;
+    }
+
+    // Test 6: Display content check
+    string output = t1.display();
+    if (output.find("Triangle") != string::npos && output.find("Area = 24.000000") != string::npos) {
+        cout << "Test 6 passed: Display formatting" << endl;
+        passed++;
+    } else {
+        cout << "Test 6 FAILED: Display check" << endl;
+        failed++;
+    }
+
+    // Test 7: The cached box follows full and partial translations and scaling
+    Triangle t3(Coordinates(2, 6), Coordinates(9, 1), Coordinates(5, 4));
+    t3.getBoundingBox();
+    t3.translate(3, 1);
+    BoundingBox moved = t3.getBoundingBox();
+    t3.translate(-6, 0);  // Only the second and third vertices can move
+    BoundingBox partial = t3.getBoundingBox();
+    t3.scale(3, true);
+    BoundingBox tripled = t3.getBoundingBox();
+    t3.scale(2, false);
+    BoundingBox halved = t3.getBoundingBox();
+    if (moved.minX == 5 && moved.minY == 2 && moved.maxX == 12 && moved.maxY == 7 &&
+        partial.minX == 2 && partial.maxX == 6 && tripled.minX == 6 && tripled.maxY == 21 &&
+        halved.minX == 3 && halved.maxX == 9 && halved.maxY == 10) {
+        cout << "Test 7 passed: Cached bounding box" << endl;
+        passed++;
+    } else {
+        cout << "Test 7 FAILED: Cached bounding box" << endl;
+        failed++;
+    }
+
+    // Summary
+    cout << "========== Test Summary ==========" << endl;
+    cout << "Passed: " << passed << ", Failed: " << failed << endl;
+    cout << "==================================\n" << endl;
+}
+
+// ==============================
+// Batch area/perimeter kernels
+// ==============================
+// Each kernel fills out[0..n) from column arrays, using AVX2 (4 lanes) or
+// SSE2 (2 lanes) when the compiler targets them and plain scalar code
+// otherwise. The vector paths use the same operation order as the
+// areaOf()/perimeterOf() helpers of each shape.
+
+#if defined(__AVX2__)
+typedef __m256d SimdDouble;
+const size_t SIMD_WIDTH = 4;
+inline SimdDouble simdLoad(const double* p) { return _mm256_loadu_pd(p); }
+inline SimdDouble simdLoadInts(const int* p) { return _mm256_cvtepi32_pd(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))); }
+inline void simdStore(double* p, SimdDouble v) { _mm256_storeu_pd(p, v); }
+inline SimdDouble simdSet(double v) { return _mm256_set1_pd(v); }
+inline SimdDouble simdAdd(SimdDouble a, SimdDouble b) { return _mm256_add_pd(a, b); }
+inline SimdDouble simdSub(SimdDouble a, SimdDouble b) { return _mm256_sub_pd(a, b); }
+inline SimdDouble simdMul(SimdDouble a, SimdDouble b) { return _mm256_mul_pd(a, b); }
+inline SimdDouble simdDiv(SimdDouble a, SimdDouble b) { return _mm256_div_pd(a, b); }
+inline SimdDouble simdSqrt(SimdDouble a) { return _mm256_sqrt_pd(a); }
+#elif defined(__SSE2__)
+typedef __m128d SimdDouble;
+const size_t SIMD_WIDTH = 2;
+inline SimdDouble simdLoad(const double* p) { return _mm_loadu_pd(p); }
+inline SimdDouble simdLoadInts(const int* p) { return _mm_cvtepi32_pd(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p))); }
+inline void simdStore(double* p, SimdDouble v) { _mm_storeu_pd(p, v); }
+inline SimdDouble simdSet(double v) { return _mm_set1_pd(v); }
+inline SimdDouble simdAdd(SimdDouble a, SimdDouble b) { return _mm_add_pd(a, b); }
+inline SimdDouble simdSub(SimdDouble a, SimdDouble b) { return _mm_sub_pd(a, b); }
+inline SimdDouble simdMul(SimdDouble a, SimdDouble b) { return _mm_mul_pd(a, b); }
+inline SimdDouble simdDiv(SimdDouble a, SimdDouble b) { return _mm_div_pd(a, b); }
+inline SimdDouble simdSqrt(SimdDouble a) { return _mm_sqrt_pd(a); }
+#else
+// Scalar fallback: one lane, so the vector loops below handle every element
+typedef double SimdDouble;
+const size_t SIMD_WIDTH = 1;
+inline SimdDouble simdLoad(const double* p) { return *p; }
+inline SimdDouble simdLoadInts(const int* p) { return *p; }
+inline void simdStore(double* p, SimdDouble v) { *p = v; }
+inline SimdDouble simdSet(double v) { return v; }
+inline SimdDouble simdAdd(SimdDouble a, SimdDouble b) { return a + b; }
+inline SimdDouble simdSub(SimdDouble a, SimdDouble b) { return a - b; }
+inline SimdDouble simdMul(SimdDouble a, SimdDouble b) { return a * b; }
+inline SimdDouble simdDiv(SimdDouble a, SimdDouble b) { return a / b; }
+inline SimdDouble simdSqrt(SimdDouble a) { return sqrt(a); }
+#endif
+
+// Distance between two integer points, one lane per triangle
+inline SimdDouble simdDistance(const int* ax, const int* ay, const int* bx, const int* by) {
+    SimdDouble dx = simdSub(simdLoadInts(bx), simdLoadInts(ax));
+    SimdDouble dy = simdSub(simdLoadInts(by), simdLoadInts(ay));
+    return simdSqrt(simdAdd(simdMul(dx, dx), simdMul(dy, dy)));
+}
+
+void rectangleAreaKernel(const double* width, const double* length, double* out, size_t n) {
+    size_t i = 0;
+    for (; i + SIMD_WIDTH <= n; i += SIMD_WIDTH) {
+        simdStore(out + i, simdMul(simdLoad(width + i), simdLoad(length + i)));
+    }
+    for (; i < n; ++i) {
+        out[i] = Rectangle::areaOf(width[i], length[i]);
+    }
+}
+
+void rectanglePerimeterKernel(const double* width, const double* length, double* out, size_t n) {
+    size_t i = 0;
+    SimdDouble two = simdSet(2.0);
+    for (; i + SIMD_WIDTH <= n; i += SIMD_WIDTH) {
+        simdStore(out + i, simdMul(two, simdAdd(simdLoad(width + i), simdLoad(length + i))));
+    }
+    for (; i < n; ++i) {
+        out[i] = Rectangle::perimeterOf(width[i], length[i]);
+    }
+}
+
+void squareAreaKernel(const double* side, double* out, size_t n) {
+    size_t i = 0;
+    for (; i + SIMD_WIDTH <= n; i += SIMD_WIDTH) {
+        SimdDouble s = simdLoad(side + i);
+        simdStore(out + i, simdMul(s, s));
+    }
+    for (; i < n; ++i) {
+        out[i] = Square::areaOf(side[i]);
+    }
+}
+
+void squarePerimeterKernel(const double* side, double* out, size_t n) {
+    size_t i = 0;
+    SimdDouble four = simdSet(4.0);
+    for (; i + SIMD_WIDTH <= n; i += SIMD_WIDTH) {
+        simdStore(out + i, simdMul(four, simdLoad(side + i)));
+    }
+    for (; i < n; ++i) {
+        out[i] = Square::perimeterOf(side[i]);
+    }
+}
+
+void circleAreaKernel(const double* radius, double* out, size_t n) {
+    size_t i = 0;
+    SimdDouble pi = simdSet(M_PI);
+    for (; i + SIMD_WIDTH <= n; i += SIMD_WIDTH) {
+        SimdDouble r = simdLoad(radius + i);
+        simdStore(out + i, simdMul(simdMul(pi, r), r));
+    }
+    for (; i < n; ++i) {
+        out[i] = Circle::areaOf(radius[i]);
+    }
+}
+
+void circlePerimeterKernel(const double* radius, double* out, size_t n) {
+    size_t i = 0;
+    SimdDouble twoPi = simdSet(2 * M_PI);
+    for (; i + SIMD_WIDTH <= n; i += SIMD_WIDTH) {
+        simdStore(out + i, simdMul(twoPi, simdLoad(radius + i)));
+    }
+    for (; i < n; ++i) {
+        out[i] = Circle::perimeterOf(radius[i]);
+    }
+}
+
+// Triangle vertices are passed as six integer columns
+void triangleAreaKernel(const int* x1, const int* y1, const int* x2, const int* y2,
+                        const int* x3, const int* y3, double* out, size_t n) {
+    size_t i = 0;
+    SimdDouble two = simdSet(2.0);
+    for (; i + SIMD_WIDTH <= n; i += SIMD_WIDTH) {
+        SimdDouble a = simdDistance(x1 + i, y1 + i, x2 + i, y2 + i);
+        SimdDouble b = simdDistance(x1 + i, y1 + i, x3 + i, y3 + i);
+        SimdDouble c = simdDistance(x2 + i, y2 + i, x3 + i, y3 + i);
+        SimdDouble s = simdDiv(simdAdd(simdAdd(a, b), c), two);  // semiperimeter
+        SimdDouble product = simdMul(simdMul(simdMul(s, simdSub(s, a)), simdSub(s, b)), simdSub(s, c));
+        simdStore(out + i, simdSqrt(product));
+    }
+    for (; i < n; ++i) {
+        out[i] = Triangle::areaOf(Coordinates(x1[i], y1[i]), Coordinates(x2[i], y2[i]), Coordinates(x3[i], y3[i]));
+    }
+}
+
+void trianglePerimeterKernel(const int* x1, const int* y1, const int* x2, const int* y2,
+                             const int* x3, const int* y3, double* out, size_t n) {
+    size_t i = 0;
+    for (; i + SIMD_WIDTH <= n; i += SIMD_WIDTH) {
+        SimdDouble a = simdDistance(x1 + i, y1 + i, x2 + i, y2 + i);
+        SimdDouble b = simdDistance(x1 + i, y1 + i, x3 + i, y3 + i);
+        SimdDouble c = simdDistance(x2 + i, y2 + i, x3 + i, y3 + i);
+        simdStore(out + i, simdAdd(simdAdd(a, b), c));
+    }
+    for (; i < n; ++i) {
+        out[i] = Triangle::perimeterOf(Coordinates(x1[i], y1[i]), Coordinates(x2[i], y2[i]), Coordinates(x3[i], y3[i]));
+    }
+}
+
+
+// ==============================
+// SlabPool Class
+// ==============================
+// Allocates objects of one type from contiguous slabs. Each new slab is
+// twice the size of the previous one (up to a cap), freed slots are
+// reused first, and all slabs are released together by the destructor.
+// Live objects are not destroyed on release: Shape subclasses hold only
+// trivially destructible members, so their destructors do nothing.
+template <typename T>
+class SlabPool {
+private:
+    struct Slot {
+        alignas(T) unsigned char bytes[sizeof(T)];
+    };
+
+    struct Slab {
+        unique_ptr<Slot[]> slots;
+        size_t capacity;
+    };
+
+    static constexpr size_t FIRST_SLAB = 64;
+    static constexpr size_t MAX_SLAB = 65536;
+
+    vector<Slab> slabs;
+    size_t used = 0;       // Slots handed out from the last slab
+    vector<T*> freeSlots;  // Slots returned by destroy()
+
+public:
+    SlabPool() = default;
+    SlabPool(const SlabPool&) = delete;
+    SlabPool& operator=(const SlabPool&) = delete;
+
+    // Construct an object in the next free slot
+    template <typename... Args>
+    T* create(Args&&... args) {
+        void* slot;
+        if (!freeSlots.empty()) {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        } else {
+            if (slabs.empty() || used == slabs.back().capacity) {
+                size_t capacity = slabs.empty() ? FIRST_SLAB : min(slabs.back().capacity * 2, MAX_SLAB);
+                slabs.push_back(Slab{unique_ptr<Slot[]>(new Slot[capacity]), capacity});
+                used = 0;
+            }
+            slot = slabs.back().slots[used++].bytes;
+        }
+        return new (slot) T(forward<Args>(args)...);
+    }
+
+    // Destroy an object and keep its slot for reuse
+    void destroy(T* object) {
+        object->~T();
+        freeSlots.push_back(object);
+    }
+
+    // Check whether an object lives in one of this pool's slabs
+    bool owns(const void* object) const {
+        const Slot* p = static_cast<const Slot*>(object);
+        for (const Slab& slab : slabs) {
+            if (p >= slab.slots.get() && p < slab.slots.get() + slab.capacity) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+// ==============================
+// ShapeArena Class
+// ==============================
+// One SlabPool per Shape subclass, so shapes of a type sit contiguously
+class ShapeArena {
+private:
+    SlabPool<Rectangle> rectangles;
+    SlabPool<Square> squares;
+    SlabPool<Circle> circles;
+    SlabPool<Triangle> triangles;
+
+    SlabPool<Rectangle>& poolFor(Rectangle*) { return rectangles; }
+    SlabPool<Square>& poolFor(Square*) { return squares; }
+    SlabPool<Circle>& poolFor(Circle*) { return circles; }
+    SlabPool<Triangle>& poolFor(Triangle*) { return triangles; }
+
+public:
+    // Construct a shape of type T inside the arena
+    template <typename T, typename... Args>
+    T* create(Args&&... args) {
+        return poolFor(static_cast<T*>(nullptr)).create(forward<Args>(args)...);
+    }
+
+    // Check whether a shape was created by this arena
+    bool owns(const Shape* s) const {
+        switch (s->getKind()) {
+            case ShapeKind::Rectangle: return rectangles.owns(s);
+            case ShapeKind::Square:    return squares.owns(s);
+            case ShapeKind::Circle:    return circles.owns(s);
+            case ShapeKind::Triangle:  return triangles.owns(s);
+        }
+        return false;
+    }
+
+    // Destroy an arena shape and recycle its slot
+    void destroy(Shape* s) {
+        switch (s->getKind()) {
+            case ShapeKind::Rectangle: rectangles.destroy(static_cast<Rectangle*>(s)); break;
+            case ShapeKind::Square:    squares.destroy(static_cast<Square*>(s)); break;
+            case ShapeKind::Circle:    circles.destroy(static_cast<Circle*>(s)); break;
+            case ShapeKind::Triangle:  triangles.destroy(static_cast<Triangle*>(s)); break;
+        }
+    }
+};
+
+
+// ==============================
+// WorkStealingPool Class
+// ==============================
+// Reusable thread pool for data-parallel loops. Each worker owns a task
+// queue: it pops its own most recent task first and steals the oldest
+// task from another worker when its queue runs dry.
+class WorkStealingPool {
+private:
+    struct WorkerQueue {
+        mutex lock;
+        deque<function<void()>> tasks;
+    };
+
+    vector<unique_ptr<WorkerQueue>> queues;  // One queue per worker
+    vector<thread> workers;
+    mutex sleepLock;
+    condition_variable wakeUp;
+    atomic<int> queued;  // Tasks pushed but not yet popped
+    bool stopping;
+
+    // Pop from the back of our own queue, or steal from the front of another
+    bool popTask(size_t self, function<void()>& task) {
+        {
+            lock_guard<mutex> guard(queues[self]->lock);
+            if (!queues[self]->tasks.empty()) {
+                task = move(queues[self]->tasks.back());
+                queues[self]->tasks.pop_back();
+                queued--;
+                return true;
+            }
+        }
+        return stealTask(self + 1, task);
+    }
+
+    // Take the oldest task of the first non-empty queue, starting from a given worker
+    bool stealTask(size_t start, function<void()>& task) {
+        for (size_t k = 0; k < queues.size(); ++k) {
+            WorkerQueue& victim = *queues[(start + k) % queues.size()];
+            lock_guard<mutex> guard(victim.lock);
+            if (!victim.tasks.empty()) {
+                task = move(victim.tasks.front());
+                victim.tasks.pop_front();
+                queued--;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void workerLoop(size_t self) {
+        function<void()> task;
+        while (true) {
+            if (popTask(self, task)) {
+                task();
+                continue;
+            }
+            unique_lock<mutex> guard(sleepLock);
+            wakeUp.wait(guard, [this] { return stopping || queued.load() > 0; });
+            if (stopping && queued.load() <= 0) {
+                return;
+            }
+        }
+    }
+
+public:
+    // Start threadCount workers (at least one)
+    explicit WorkStealingPool(int threadCount) : queued(0), stopping(false) {
+        if (threadCount < 1) {
+            cout << "Warning: Thread count must be positive. Defaulting to 1." << endl;
+            threadCount = 1;
+        }
+        for (int i = 0; i < threadCount; ++i) {
+            queues.push_back(unique_ptr<WorkerQueue>(new WorkerQueue()));
+        }
+        for (int i = 0; i < threadCount; ++i) {
+            workers.emplace_back(&WorkStealingPool::workerLoop, this, static_cast<size_t>(i));
+        }
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    // Getter for the number of worker threads
+    int getThreadCount() const {
+        return static_cast<int>(workers.size());
+    }
+
+    // Split [0, count) into chunks of grainSize and run body(begin, end) on each.
+    // The calling thread helps with the chunks and returns once all are done.
+    void parallelFor(size_t count, size_t grainSize, const function<void(size_t, size_t)>& body) {
+        if (grainSize == 0) {
+            grainSize = 1;
+        }
+        size_t chunks = (count + grainSize - 1) / grainSize;
+        if (chunks <= 1) {
+            body(0, count);
+            return;
+        }
+
+        size_t remaining = chunks;
+        mutex doneLock;
+        condition_variable done;
+
+        queued += static_cast<int>(chunks);
+        for (size_t c = 0; c < chunks; ++c) {
+            size_t begin = c * grainSize;
+            size_t end = min(count, begin + grainSize);
+            WorkerQueue& target = *queues[c % queues.size()];
+            lock_guard<mutex> guard(target.lock);
+            target.tasks.push_back([&body, &remaining, &doneLock, &done, begin, end] {
+                body(begin, end);
+                // Decrement under the lock so parallelFor cannot return mid-notify
+                lock_guard<mutex> finished(doneLock);
+                if (--remaining == 0) {
+                    done.notify_all();
+                }
+            });
+        }
+        {
+            lock_guard<mutex> guard(sleepLock);
+        }
+        wakeUp.notify_all();
+
+        // Help out instead of blocking straight away
+        function<void()> task;
+        while (stealTask(0, task)) {
+            task();
+        }
+        unique_lock<mutex> guard(doneLock);
+        done.wait(guard, [&remaining] { return remaining == 0; });
+    }
+
+    // Destructor: finish queued work, then join every worker
+    ~WorkStealingPool() {
+        {
+            lock_guard<mutex> guard(sleepLock);
+            stopping = true;
+        }
+        wakeUp.notify_all();
+        for (thread& t : workers) {
+            t.join();
+        }
+    }
+};
+
+
+// ==============================
+// SpatialIndex Class
+// ==============================
+// Abstract index over shape bounding boxes. Shapes are identified by an
+// integer id (their ShapeList position).
+class SpatialIndex {
+protected:
+    // Map a box through x * factor + dx, y * factor + dy, with the same
+    // arithmetic a translate (factor 1) or multiplying scale (no offset) of
+    // the shape applies to its own box
+    static BoundingBox mapped(const BoundingBox& b, double factor, double dx, double dy) {
+        return BoundingBox{b.minX * factor + dx, b.minY * factor + dy, b.maxX * factor + dx, b.maxY * factor + dy};
+    }
+
+public:
+    // Replace the whole content with boxes[0..n), box i having id i
+    virtual void build(const vector<BoundingBox>& boxes) = 0;
+
+    // Add one box
+    virtual void insert(int id, const BoundingBox& box) = 0;
+
+    // Remove one box; the ids above it move down by one, as list positions do
+    virtual void erase(int id) = 0;
+
+    // Map every box through x * factor + dx, y * factor + dy (factor > 0)
+    virtual void transform(double factor, double dx, double dy) = 0;
+
+    // Append to out the ids of every box overlapping the query box
+    virtual void query(const BoundingBox& area, vector<int>& out) = 0;
+
+    // Virtual destructor
+    virtual ~SpatialIndex() {}
+};
+
+// ==============================
+// UniformGridIndex Class
+// ==============================
+// Hashes every box into the square cells it covers. Boxes covering too
+// many cells are kept in a separate list that every query scans.
+// transform() moves and scales the grid itself (origin and cell size)
+// along with the boxes, so the cells stay valid without rehashing.
+class UniformGridIndex : public SpatialIndex {
+private:
+    static constexpr long long MAX_CELLS_PER_BOX = 256;
+
+    double baseCellSize;                            // Cell size at build()
+    double cellSize;
+    double originX = 0.0, originY = 0.0;            // Corner of cell (0, 0)
+    bool moved = false;                             // transform() was called since build()
+    vector<BoundingBox> boxes;                      // Box of every id
+    unordered_map<uint64_t, vector<int>> cells;     // Cell key -> ids
+    vector<int> oversized;                          // Ids of boxes covering too many cells
+    vector<unsigned> lastSeen;                      // Query stamp per id, to report each id once
+    unsigned stamp = 0;
+
+    long long cellOf(double v, double origin) const {
+        return static_cast<long long>(floor((v - origin) / cellSize));
+    }
+
+    // Pack the low 32 bits of each cell coordinate; shifting unsigned keeps
+    // negative cells well defined
+    static uint64_t key(long long cx, long long cy) {
+        return (static_cast<uint64_t>(cx) << 32) ^ (static_cast<uint64_t>(cy) & 0xffffffffULL);
+    }
+
+    // Report id once per query if its box really overlaps
+    void report(int id, const BoundingBox& area, vector<int>& out) {
+        if (lastSeen[id] != stamp && boxes[id].overlaps(area)) {
+            lastSeen[id] = stamp;
+            out.push_back(id);
+        }
+    }
+
+public:
+    // Constructor with validation of the cell size
+    explicit UniformGridIndex(double size) {
+        if (size <= 0) {
+            cout << "Warning: Cell size must be positive. Defaulting to 64." << endl;
+            size = 64.0;
+        }
+        baseCellSize = size;
+        cellSize = size;
+    }
+
+    void build(const vector<BoundingBox>& all) override {
+        boxes.clear();
+        cells.clear();
+        oversized.clear();
+        lastSeen.clear();
+        cellSize = baseCellSize;
+        originX = originY = 0.0;
+        moved = false;
+        for (size_t i = 0; i < all.size(); ++i) {
+            insert(static_cast<int>(i), all[i]);
+        }
+    }
+
+    void insert(int id, const BoundingBox& box) override {
+        if (id >= static_cast<int>(boxes.size())) {
+            boxes.resize(id + 1);
+            lastSeen.resize(id + 1, 0);
+        }
+        boxes[id] = box;
+        long long x0 = cellOf(box.minX, originX), x1 = cellOf(box.maxX, originX);
+        long long y0 = cellOf(box.minY, originY), y1 = cellOf(box.maxY, originY);
+        if ((x1 - x0 + 1) * (y1 - y0 + 1) > MAX_CELLS_PER_BOX) {
+            oversized.push_back(id);
+            return;
+        }
+        for (long long cx = x0; cx <= x1; ++cx) {
+            for (long long cy = y0; cy <= y1; ++cy) {
+                cells[key(cx, cy)].push_back(id);
+            }
+        }
+    }
+
+    void query(const BoundingBox& area, vector<int>& out) override {
+        stamp++;
+        for (int id : oversized) {
+            report(id, area, out);
+        }
+        // Once the grid has moved, a box can sit a rounding error away from
+        // the cells it was hashed into, so the query reaches slightly further
+        double margin = moved ? cellSize * 1e-6 : 0.0;
+        long long x0 = cellOf(area.minX - margin, originX), x1 = cellOf(area.maxX + margin, originX);
+        long long y0 = cellOf(area.minY - margin, originY), y1 = cellOf(area.maxY + margin, originY);
+        // A query larger than the table is cheaper as a walk over the occupied cells
+        if ((x1 - x0 + 1) * (y1 - y0 + 1) > static_cast<long long>(cells.size())) {
+            for (const auto& cell : cells) {
+                for (int id : cell.second) report(id, area, out);
+            }
+            return;
+        }
+        for (long long cx = x0; cx <= x1; ++cx) {
+            for (long long cy = y0; cy <= y1; ++cy) {
+                auto it = cells.find(key(cx, cy));
+                if (it != cells.end()) {
+                    for (int id : it->second) report(id, area, out);
+                }
+            }
+        }
+    }
+
+    void erase(int id) override {
+        if (id < 0 || id >= static_cast<int>(boxes.size())) {
+            return;
+        }
+        boxes.erase(boxes.begin() + id);
+        lastSeen.erase(lastSeen.begin() + id);
+        // One pass drops the id and renumbers the ones above it
+        auto renumber = [id](vector<int>& ids) {
+            size_t kept = 0;
+            for (int other : ids) {
+                if (other != id) {
+                    ids[kept++] = other > id ? other - 1 : other;
+                }
+            }
+            ids.resize(kept);
+        };
+        renumber(oversized);
+        for (auto it = cells.begin(); it != cells.end();) {
+            renumber(it->second);
+            it = it->second.empty() ? cells.erase(it) : next(it);
+        }
+    }
+
+    void transform(double factor, double dx, double dy) override {
+        for (BoundingBox& b : boxes) {
+            b = mapped(b, factor, dx, dy);
+        }
+        originX = originX * factor + dx;
+        originY = originY * factor + dy;
+        cellSize *= factor;
+        moved = true;
+    }
+};
+
+// ==============================
+// RTreeIndex Class
+// ==============================
+// Static R-tree bulk-loaded with Sort-Tile-Recursive packing. Boxes
+// inserted after build() go to an overflow list that queries scan until
+// the next build(). A removed box leaves an empty leaf slot, and
+// transform() maps the node boxes in place, which keeps every node around
+// its children.
+class RTreeIndex : public SpatialIndex {
+private:
+    static constexpr int NODE_CAPACITY = 16;
+
+    struct Node {
+        BoundingBox box;
+        int begin, end;  // Range in items (leaf) or in nodes (inner node)
+        bool leaf;
+    };
+
+    vector<BoundingBox> boxes;  // Box of every id
+    vector<int> items;          // Ids in leaf order, -1 once removed
+    vector<Node> nodes;         // Every level, children stored contiguously
+    int root = -1;
+    vector<int> overflow;       // Ids inserted since the last build()
+
+    // Sort-Tile-Recursive order: vertical slices by x centre, each sorted by y centre
+    template <typename T, typename BoxOf>
+    static void strSort(vector<T>& v, BoxOf boxOf) {
+        auto centerX = [&boxOf](const T& a) { const BoundingBox& b = boxOf(a); return b.minX + b.maxX; };
+        auto centerY = [&boxOf](const T& a) { const BoundingBox& b = boxOf(a); return b.minY + b.maxY; };
+        sort(v.begin(), v.end(), [&](const T& a, const T& b) { return centerX(a) < centerX(b); });
+        size_t groups = (v.size() + NODE_CAPACITY - 1) / NODE_CAPACITY;
+        size_t sliceSize = static_cast<size_t>(ceil(sqrt(static_cast<double>(groups)))) * NODE_CAPACITY;
+        for (size_t start = 0; start < v.size(); start += sliceSize) {
+            size_t stop = min(v.size(), start + sliceSize);
+            sort(v.begin() + start, v.begin() + stop, [&](const T& a, const T& b) { return centerY(a) < centerY(b); });
+        }
+    }
+
+public:
+    void build(const vector<BoundingBox>& all) override {
+        boxes = all;
+        nodes.clear();
+        overflow.clear();
+        items.resize(boxes.size());
+        iota(items.begin(), items.end(), 0);
+        root = -1;
+        if (items.empty()) {
+            return;
+        }
+
+        strSort(items, [this](int id) -> const BoundingBox& { return boxes[id]; });
+        vector<Node> level;
+        for (size_t start = 0; start < items.size(); start += NODE_CAPACITY) {
+            size_t stop = min(items.size(), start + NODE_CAPACITY);
+            BoundingBox box = boxes[items[start]];
+            for (size_t i = start + 1; i < stop; ++i) box = box.merge(boxes[items[i]]);
+            level.push_back(Node{box, static_cast<int>(start), static_cast<int>(stop), true});
+        }
+
+        // Pack each level into parents until a single root remains
+        while (level.size() > 1) {
+            strSort(level, [](const Node& n) -> const BoundingBox& { return n.box; });
+            int base = static_cast<int>(nodes.size());
+            nodes.insert(nodes.end(), level.begin(), level.end());
+            vector<Node> parents;
+            for (size_t start = 0; start < level.size(); start += NODE_CAPACITY) {
+                size_t stop = min(level.size(), start + NODE_CAPACITY);
+                BoundingBox box = level[start].box;
+                for (size_t i = start + 1; i < stop; ++i) box = box.merge(level[i].box);
+                parents.push_back(Node{box, base + static_cast<int>(start), base + static_cast<int>(stop), false});
+            }
+            level.swap(parents);
+        }
+        root = static_cast<int>(nodes.size());
+        nodes.push_back(level[0]);
+    }
+
+    void insert(int id, const BoundingBox& box) override {
+        if (id >= static_cast<int>(boxes.size())) {
+            boxes.resize(id + 1);
+        }
+        boxes[id] = box;
+        overflow.push_back(id);
+    }
+
+    void query(const BoundingBox& area, vector<int>& out) override {
+        // Re-pack once the overflow list is a sizeable part of the tree
+        if (overflow.size() > 1024 && overflow.size() > boxes.size() / 8) {
+            vector<BoundingBox> all = boxes;
+            build(all);
+        }
+        for (int id : overflow) {
+            if (boxes[id].overlaps(area)) out.push_back(id);
+        }
+        if (root < 0) {
+            return;
+        }
+        vector<int> stack(1, root);
+        while (!stack.empty()) {
+            const Node& n = nodes[stack.back()];
+            stack.pop_back();
+            if (!n.box.overlaps(area)) {
+                continue;
+            }
+            for (int i = n.begin; i < n.end; ++i) {
+                if (n.leaf) {
+                    if (items[i] >= 0 && boxes[items[i]].overlaps(area)) out.push_back(items[i]);
+                } else {
+                    stack.push_back(i);
+                }
+            }
+        }
+    }
+
+    void erase(int id) override {
+        if (id < 0 || id >= static_cast<int>(boxes.size())) {
+            return;
+        }
+        boxes.erase(boxes.begin() + id);
+        for (int& item : items) {
+            item = item == id ? -1 : (item > id ? item - 1 : item);
+        }
+        size_t kept = 0;
+        for (int other : overflow) {
+            if (other != id) {
+                overflow[kept++] = other > id ? other - 1 : other;
+            }
+        }
+        overflow.resize(kept);
+    }
+
+    void transform(double factor, double dx, double dy) override {
+        for (BoundingBox& b : boxes) {
+            b = mapped(b, factor, dx, dy);
+        }
+        for (Node& n : nodes) {
+            n.box = mapped(n.box, factor, dx, dy);
+        }
+    }
+
+    // Number of boxes waiting in the overflow list
+    size_t overflowSize() const {
+        return overflow.size();
+    }
+};
+
+
+// ==============================
+// MetricIndex Class
+// ==============================
+// Ordered index of the shapes' areas and perimeters. Each (metric, kind)
+// pair keeps a sorted run plus an unsorted delta buffer for recent inserts.
+// Keys are stored divided by a per-run multiplier, so a scale that changes
+// every key of a run by the same factor is applied in O(1). Runs whose keys
+// change non-uniformly (triangles after an integer division or a clamped
+// translation) are marked stale and rebuilt by the owner before a query.
+// Keys reached through a multiplier can differ from getArea() by rounding,
+// so a shape within an ulp or two of a range bound may fall either side.
+
+// Keys kept by a MetricIndex
+enum class ShapeMetric { Area, Perimeter };
+
+class MetricIndex {
+private:
+    static constexpr size_t DELTA_LIMIT = 256;  // Delta entries merged into the run at once
+
+    typedef pair<double, Shape*> Entry;  // (stored key, shape), actual key = stored * multiplier
+
+    struct Run {
+        vector<Entry> sorted;    // Ascending by stored key
+        vector<Entry> delta;     // Not yet merged
+        double multiplier = 1.0;
+        bool stale = false;
+    };
+
+    Run runs[2][4];  // [metric][kind]
+
+    static double keyOf(Shape* s, int metric) {
+        return metric == 0 ? s->getArea() : s->getPerimeter();
+    }
+
+    static void mergeDelta(Run& run) {
+        if (run.delta.empty()) {
+            return;
+        }
+        sort(run.delta.begin(), run.delta.end());
+        size_t middle = run.sorted.size();
+        run.sorted.insert(run.sorted.end(), run.delta.begin(), run.delta.end());
+        inplace_merge(run.sorted.begin(), run.sorted.begin() + middle, run.sorted.end());
+        run.delta.clear();
+    }
+
+    // Remove a shape from one run; the stored key is found again up to rounding
+    static void eraseFrom(Run& run, Shape* s, double stored) {
+        for (size_t i = 0; i < run.delta.size(); ++i) {
+            if (run.delta[i].second == s) {
+                run.delta[i] = run.delta.back();
+                run.delta.pop_back();
+                return;
+            }
+        }
+        double slack = fabs(stored) * 1e-9;
+        auto it = lower_bound(run.sorted.begin(), run.sorted.end(), Entry(stored - slack, nullptr));
+        for (; it != run.sorted.end() && it->first <= stored + slack; ++it) {
+            if (it->second == s) {
+                run.sorted.erase(it);
+                return;
+            }
+        }
+        // Not where its key says (rounding beyond the slack): search the whole run
+        for (it = run.sorted.begin(); it != run.sorted.end(); ++it) {
+            if (it->second == s) {
+                run.sorted.erase(it);
+                return;
+            }
+        }
+    }
+
+    // Number of keys in a run below x (or at most x), with x an actual key
+    static size_t countBelow(const Run& run, double x, bool inclusive) {
+        double stored = x / run.multiplier;
+        if (inclusive) {
+            return upper_bound(run.sorted.begin(), run.sorted.end(), stored,
+                               [](double v, const Entry& e) { return v < e.first; }) - run.sorted.begin();
+        }
+        return lower_bound(run.sorted.begin(), run.sorted.end(), stored,
+                           [](const Entry& e, double v) { return e.first < v; }) - run.sorted.begin();
+    }
+
+public:
+    // Rebuild every run from a list of shapes
+    void build(const vector<Shape*>& shapes) {
+        for (int m = 0; m < 2; ++m) {
+            for (int k = 0; k < 4; ++k) {
+                runs[m][k] = Run();
+                runs[m][k].stale = true;
+            }
+        }
+        rebuildStale(shapes);
+    }
+
+    // Check whether a query needs rebuildStale() first
+    bool hasStale() const {
+        for (int k = 0; k < 4; ++k) {
+            if (runs[0][k].stale) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Rebuild the runs marked stale from the current shapes
+    void rebuildStale(const vector<Shape*>& shapes) {
+        for (int m = 0; m < 2; ++m) {
+            bool any = false;
+            for (int k = 0; k < 4; ++k) {
+                if (runs[m][k].stale) {
+                    runs[m][k].sorted.clear();
+                    runs[m][k].delta.clear();
+                    runs[m][k].multiplier = 1.0;
+                    any = true;
+                }
+            }
+            if (!any) {
+                continue;
+            }
+            for (Shape* s : shapes) {
+                Run& run = runs[m][static_cast<int>(s->getKind())];
+                if (run.stale) {
+                    run.sorted.push_back(Entry(keyOf(s, m), s));
+                }
+            }
+            for (int k = 0; k < 4; ++k) {
+                if (runs[m][k].stale) {
+                    sort(runs[m][k].sorted.begin(), runs[m][k].sorted.end());
+                    runs[m][k].stale = false;
+                }
+            }
+        }
+    }
+
+    void insert(Shape* s) {
+        int k = static_cast<int>(s->getKind());
+        for (int m = 0; m < 2; ++m) {
+            Run& run = runs[m][k];
+            if (run.stale) {
+                continue;
+            }
+            run.delta.push_back(Entry(keyOf(s, m) / run.multiplier, s));
+            if (run.delta.size() >= DELTA_LIMIT) {
+                mergeDelta(run);
+            }
+        }
+    }
+
+    // Remove a shape; its metrics must still be the ones the index holds
+    void erase(Shape* s) {
+        int k = static_cast<int>(s->getKind());
+        for (int m = 0; m < 2; ++m) {
+            Run& run = runs[m][k];
+            if (!run.stale) {
+                eraseFrom(run, s, keyOf(s, m) / run.multiplier);
+            }
+        }
+    }
+
+    // Mark the runs of one shape type for rebuilding
+    void invalidate(ShapeKind kind) {
+        runs[0][static_cast<int>(kind)].stale = true;
+        runs[1][static_cast<int>(kind)].stale = true;
+    }
+
+    // Follow ShapeList::scale(): floating-point sizes scale every key of a
+    // run alike; triangle vertices are integers, so dividing them truncates
+    void scale(int factor, bool sign) {
+        if (factor <= 0) {
+            return;
+        }
+        double f = sign ? static_cast<double>(factor) : 1.0 / factor;
+        for (int k = 0; k < 4; ++k) {
+            if (!sign && k == static_cast<int>(ShapeKind::Triangle)) {
+                invalidate(ShapeKind::Triangle);
+                continue;
+            }
+            runs[0][k].multiplier *= f * f;
+            runs[1][k].multiplier *= f;
+        }
+    }
+
+    // Merge every delta buffer, so that queries only search sorted runs
+    void compact() {
+        for (int m = 0; m < 2; ++m) {
+            for (int k = 0; k < 4; ++k) {
+                mergeDelta(runs[m][k]);
+            }
+        }
+    }
+
+    // Shapes with lo <= key <= hi, in increasing key order (after compact())
+    void range(ShapeMetric metric, double lo, double hi, vector<pair<double, Shape*>>& out) const {
+        int m = static_cast<int>(metric);
+        out.clear();
+        for (int k = 0; k < 4; ++k) {
+            const Run& run = runs[m][k];
+            size_t first = countBelow(run, lo, false);
+            size_t last = countBelow(run, hi, true);
+            for (size_t i = first; i < last; ++i) {
+                out.push_back(Entry(run.sorted[i].first * run.multiplier, run.sorted[i].second));
+            }
+        }
+        sort(out.begin(), out.end());
+    }
+
+    // The count largest (or smallest) shapes, largest (or smallest) first (after compact())
+    void top(ShapeMetric metric, size_t count, bool largest, vector<pair<double, Shape*>>& out) const {
+        int m = static_cast<int>(metric);
+        out.clear();
+        size_t next[4], remaining[4];
+        for (int k = 0; k < 4; ++k) {
+            remaining[k] = runs[m][k].sorted.size();
+            next[k] = largest ? remaining[k] : 0;
+        }
+        while (out.size() < count) {
+            int best = -1;
+            double bestKey = 0.0;
+            for (int k = 0; k < 4; ++k) {
+                if (remaining[k] == 0) {
+                    continue;
+                }
+                const Run& run = runs[m][k];
+                double key = run.sorted[largest ? next[k] - 1 : next[k]].first * run.multiplier;
+                if (best < 0 || (largest ? key > bestKey : key < bestKey)) {
+                    best = k;
+                    bestKey = key;
+                }
+            }
+            if (best < 0) {
+                break;
+            }
+            const Run& run = runs[m][best];
+            size_t i = largest ? --next[best] : next[best]++;
+            remaining[best]--;
+            out.push_back(Entry(bestKey, run.sorted[i].second));
+        }
+    }
+
+    // Nearest-rank percentile (0-100) of the keys, or -1.0 when empty (after compact()).
+    // Binary search in each run for the entry whose rank across all runs matches.
+    double percentile(ShapeMetric metric, double p) const {
+        int m = static_cast<int>(metric);
+        size_t total = 0;
+        for (int k = 0; k < 4; ++k) {
+            total += runs[m][k].sorted.size();
+        }
+        if (total == 0) {
+            return -1.0;
+        }
+        size_t rank = static_cast<size_t>(ceil(min(max(p, 0.0), 100.0) / 100.0 * static_cast<double>(total)));
+        rank = max(rank, static_cast<size_t>(1));
+        for (int k = 0; k < 4; ++k) {
+            const Run& run = runs[m][k];
+            size_t lo = 0, hi = run.sorted.size();
+            // Find the first entry of this run with at least rank keys <= it
+            while (lo < hi) {
+                size_t mid = (lo + hi) / 2;
+                double key = run.sorted[mid].first * run.multiplier;
+                size_t atMost = mid + 1;
+                for (int other = 0; other < 4; ++other) {
+                    if (other != k) {
+                        atMost += countBelow(runs[m][other], key, true);
+                    }
+                }
+                if (atMost >= rank) {
+                    hi = mid;
+                } else {
+                    lo = mid + 1;
+                }
+            }
+            if (lo == run.sorted.size()) {
+                continue;
+            }
+            double key = run.sorted[lo].first * run.multiplier;
+            size_t below = lo;
+            for (int other = 0; other < 4; ++other) {
+                if (other != k) {
+                    below += countBelow(runs[m][other], key, false);
+                }
+            }
+            if (below < rank) {
+                return key;
+            }
+        }
+        return -1.0;
+    }
+};
+
+
+// ==============================
+// OverlapDetector Class
+// ==============================
+// Finds every pair of overlapping shapes. The broad phase is sweep and
+// prune: boxes are sorted on the axis with the wider spread, and each box
+// is only compared with the boxes that start before it ends on that axis
+// and overlap it on the other, within stripes of the other axis. Candidate
+// pairs then get an exact test for their pair of types. Shapes that touch count as overlapping, as in
+// BoundingBox::overlaps().
+
+class OverlapDetector {
+public:
+    // Exact geometry of one shape, copied out of the Shape objects once
+    struct Geometry {
+        ShapeKind kind;
+        BoundingBox box;        // Rectangles and squares are their box
+        double cx, cy, r;       // Circle
+        double px[3], py[3];    // Triangle vertices
+    };
+
+    static Geometry geometryOf(const Shape* s) {
+        Geometry g;
+        g.kind = s->getKind();
+        g.box = s->getBoundingBox();
+        g.cx = g.cy = g.r = 0.0;
+        if (g.kind == ShapeKind::Circle) {
+            const Circle* c = static_cast<const Circle*>(s);
+            g.cx = c->getCoordinates().getX();
+            g.cy = c->getCoordinates().getY();
+            g.r = c->getRadius();
+        } else if (g.kind == ShapeKind::Triangle) {
+            const Triangle* t = static_cast<const Triangle*>(s);
+            Coordinates p[3] = {t->getPosition1(), t->getPosition2(), t->getPosition3()};
+            for (int i = 0; i < 3; ++i) {
+                g.px[i] = p[i].getX();
+                g.py[i] = p[i].getY();
+            }
+        }
+        return g;
+    }
+
+private:
+    // Project a convex polygon on an axis
+    static void project(const double* xs, const double* ys, int n, double ax, double ay, double& lo, double& hi) {
+        lo = hi = xs[0] * ax + ys[0] * ay;
+        for (int i = 1; i < n; ++i) {
+            double d = xs[i] * ax + ys[i] * ay;
+            lo = min(lo, d);
+            hi = max(hi, d);
+        }
+    }
+
+    // Separating axis test between two convex polygons, using their edge normals
+    static bool polygonsOverlap(const double* ax, const double* ay, int an, const double* bx, const double* by, int bn) {
+        for (int pass = 0; pass < 2; ++pass) {
+            const double* xs = pass == 0 ? ax : bx;
+            const double* ys = pass == 0 ? ay : by;
+            int n = pass == 0 ? an : bn;
+            for (int i = 0; i < n; ++i) {
+                int j = (i + 1) % n;
+                double nx = ys[j] - ys[i], ny = xs[i] - xs[j];
+                if (nx == 0.0 && ny == 0.0) {
+                    continue;  // Degenerate edge
+                }
+                double alo, ahi, blo, bhi;
+                project(ax, ay, an, nx, ny, alo, ahi);
+                project(bx, by, bn, nx, ny, blo, bhi);
+                if (ahi < blo || bhi < alo) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // Squared distance from a point to the segment (x1, y1)-(x2, y2)
+    static double segmentDistance2(double px, double py, double x1, double y1, double x2, double y2) {
+        double dx = x2 - x1, dy = y2 - y1;
+        double length2 = dx * dx + dy * dy;
+        double t = length2 > 0.0 ? ((px - x1) * dx + (py - y1) * dy) / length2 : 0.0;
+        t = min(max(t, 0.0), 1.0);
+        double ex = x1 + t * dx - px, ey = y1 + t * dy - py;
+        return ex * ex + ey * ey;
+    }
+
+    static bool triangleContains(const Geometry& t, double x, double y) {
+        double d[3];
+        for (int i = 0; i < 3; ++i) {
+            int j = (i + 1) % 3;
+            d[i] = (t.px[j] - t.px[i]) * (y - t.py[i]) - (t.py[j] - t.py[i]) * (x - t.px[i]);
+        }
+        bool hasNegative = d[0] < 0 || d[1] < 0 || d[2] < 0;
+        bool hasPositive = d[0] > 0 || d[1] > 0 || d[2] > 0;
+        return !(hasNegative && hasPositive);
+    }
+
+    static bool circleBox(const Geometry& c, const BoundingBox& box) {
+        double nx = min(max(c.cx, box.minX), box.maxX);
+        double ny = min(max(c.cy, box.minY), box.maxY);
+        return (nx - c.cx) * (nx - c.cx) + (ny - c.cy) * (ny - c.cy) <= c.r * c.r;
+    }
+
+    static bool circleTriangle(const Geometry& c, const Geometry& t) {
+        if (triangleContains(t, c.cx, c.cy)) {
+            return true;
+        }
+        for (int i = 0; i < 3; ++i) {
+            int j = (i + 1) % 3;
+            if (segmentDistance2(c.cx, c.cy, t.px[i], t.py[i], t.px[j], t.py[j]) <= c.r * c.r) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static bool boxTriangle(const BoundingBox& box, const Geometry& t) {
+        double bx[4] = {box.minX, box.maxX, box.maxX, box.minX};
+        double by[4] = {box.minY, box.minY, box.maxY, box.maxY};
+        return polygonsOverlap(bx, by, 4, t.px, t.py, 3);
+    }
+
+public:
+    // Exact overlap test for any pair of shape types
+    static bool overlaps(const Geometry& a, const Geometry& b) {
+        if (!a.box.overlaps(b.box)) {
+            return false;
+        }
+        bool aCircle = a.kind == ShapeKind::Circle, bCircle = b.kind == ShapeKind::Circle;
+        bool aTriangle = a.kind == ShapeKind::Triangle, bTriangle = b.kind == ShapeKind::Triangle;
+        if (aCircle && bCircle) {
+            double dx = a.cx - b.cx, dy = a.cy - b.cy, reach = a.r + b.r;
+            return dx * dx + dy * dy <= reach * reach;
+        }
+        if (aCircle || bCircle) {
+            const Geometry& c = aCircle ? a : b;
+            const Geometry& other = aCircle ? b : a;
+            return other.kind == ShapeKind::Triangle ? circleTriangle(c, other) : circleBox(c, other.box);
+        }
+        if (aTriangle && bTriangle) {
+            return polygonsOverlap(a.px, a.py, 3, b.px, b.py, 3);
+        }
+        if (aTriangle || bTriangle) {
+            return aTriangle ? boxTriangle(b.box, a) : boxTriangle(a.box, b);
+        }
+        return true;  // Rectangles and squares: the boxes already overlap
+    }
+
+    // Report every overlapping pair (i, j), i < j, of shapes[] to onPair.
+    // With a pool, chunks of the sweep run in parallel and each chunk hands
+    // its pairs to onPair as soon as it finishes; onPair is never called
+    // concurrently. Returns the number of pairs.
+    static size_t findPairs(const vector<Shape*>& shapes, WorkStealingPool* pool, size_t grain,
+                            const function<void(int, int)>& onPair) {
+        size_t n = shapes.size();
+        vector<Geometry> geometry(n);
+        for (size_t i = 0; i < n; ++i) {
+            geometry[i] = geometryOf(shapes[i]);
+        }
+
+        // Sweep along the axis where the boxes are spread wider
+        double lo[2] = {0.0, 0.0}, hi[2] = {0.0, 0.0};
+        for (size_t i = 0; i < n; ++i) {
+            const BoundingBox& b = geometry[i].box;
+            lo[0] = i == 0 ? b.minX : min(lo[0], b.minX);
+            hi[0] = i == 0 ? b.maxX : max(hi[0], b.maxX);
+            lo[1] = i == 0 ? b.minY : min(lo[1], b.minY);
+            hi[1] = i == 0 ? b.maxY : max(hi[1], b.maxY);
+        }
+        bool sweepX = hi[0] - lo[0] >= hi[1] - lo[1];
+
+        vector<int> order(n);
+        iota(order.begin(), order.end(), 0);
+        sort(order.begin(), order.end(), [&geometry, sweepX](int a, int b) {
+            double ka = sweepX ? geometry[a].box.minX : geometry[a].box.minY;
+            double kb = sweepX ? geometry[b].box.minX : geometry[b].box.minY;
+            return ka < kb || (ka == kb && a < b);
+        });
+
+        // Extents in sweep order, packed so the inner loop reads memory linearly
+        vector<double> start(n), stop(n), crossLo(n), crossHi(n);
+        double crossSum = 0.0;
+        for (size_t s = 0; s < n; ++s) {
+            const BoundingBox& b = geometry[order[s]].box;
+            start[s] = sweepX ? b.minX : b.minY;
+            stop[s] = sweepX ? b.maxX : b.maxY;
+            crossLo[s] = sweepX ? b.minY : b.minX;
+            crossHi[s] = sweepX ? b.maxY : b.maxX;
+            crossSum += crossHi[s] - crossLo[s];
+        }
+
+        // A single sweep compares each box with every box in its slice of the
+        // sweep axis, which on a square scene is a large part of the scene.
+        // So the cross axis is cut into stripes a few boxes wide, each swept
+        // on its own; a pair is reported only by the stripe holding the lower
+        // edge of its cross-axis overlap, so it is reported once.
+        double crossMin = sweepX ? lo[1] : lo[0];
+        double crossRange = sweepX ? hi[1] - lo[1] : hi[0] - lo[0];
+        double stripeWidth = n > 0 ? max(4.0 * crossSum / static_cast<double>(n), 1.0) : 1.0;
+        size_t stripeCount = static_cast<size_t>(crossRange / stripeWidth) + 1;
+        stripeCount = min(stripeCount, max(n / 16, static_cast<size_t>(1)));
+        stripeWidth = max(crossRange / static_cast<double>(stripeCount), 1e-9);
+        auto stripeOf = [crossMin, stripeWidth, stripeCount](double v) {
+            double k = floor((v - crossMin) / stripeWidth);
+            return static_cast<size_t>(min(max(k, 0.0), static_cast<double>(stripeCount - 1)));
+        };
+        vector<vector<uint32_t>> stripes(stripeCount);  // Sweep positions, in sweep order
+        for (size_t s = 0; s < n; ++s) {
+            for (size_t k = stripeOf(crossLo[s]), last = stripeOf(crossHi[s]); k <= last; ++k) {
+                stripes[k].push_back(static_cast<uint32_t>(s));
+            }
+        }
+
+        mutex reportLock;
+        atomic<size_t> total(0);
+        auto sweep = [&](size_t firstStripe, size_t lastStripe) {
+            vector<pair<int, int>> found;
+            for (size_t k = firstStripe; k < lastStripe; ++k) {
+                const vector<uint32_t>& members = stripes[k];
+                for (size_t i = 0; i < members.size(); ++i) {
+                    uint32_t s = members[i];
+                    double reach = stop[s], low = crossLo[s], high = crossHi[s];
+                    for (size_t j = i + 1; j < members.size() && start[members[j]] <= reach; ++j) {
+                        uint32_t t = members[j];
+                        if (crossLo[t] <= high && low <= crossHi[t] && stripeOf(max(low, crossLo[t])) == k &&
+                            overlaps(geometry[order[s]], geometry[order[t]])) {
+                            found.push_back(make_pair(min(order[s], order[t]), max(order[s], order[t])));
+                        }
+                    }
+                }
+            }
+            if (!found.empty()) {
+                lock_guard<mutex> lock(reportLock);
+                for (const pair<int, int>& p : found) {
+                    onPair(p.first, p.second);
+                }
+                total += found.size();
+            }
+        };
+
+        // Chunks of stripes holding about grain boxes each
+        size_t stripeGrain = max(static_cast<size_t>(1), stripeCount * grain / max(n, static_cast<size_t>(1)));
+        if (pool == nullptr || n <= grain) {
+            sweep(0, stripeCount);
+        } else {
+            pool->parallelFor(stripeCount, stripeGrain, sweep);
+        }
+        return total;
+    }
+};
+
+
+// ==============================
+// HitTester Class
+// ==============================
+// Point-in-shape queries for many points at once. The shapes are copied
+// into per-type arrays (boxes for Rectangle and Square, centre and squared
+// radius for Circle, barycentric setup for Triangle, a segment for a
+// triangle with collinear vertices) and bucketed in a
+// uniform grid. Query points are sorted by cell; each shape of a cell is
+// then tested against all of the cell's points in a branch-free loop that
+// the compiler can vectorize, with no virtual calls.
+
+// Shapes containing each query point: the positions for point i are
+// shapes[offsets[i]] .. shapes[offsets[i + 1] - 1], in increasing order
+struct HitResults {
+    vector<size_t> offsets;
+    vector<int> shapes;
+
+    size_t hitCount(size_t point) const {
+        return offsets[point + 1] - offsets[point];
+    }
+
+    const int* hits(size_t point) const {
+        return shapes.data() + offsets[point];
+    }
+};
+
+class HitTester {
+private:
+    static constexpr size_t MAX_CELLS_PER_SHAPE = 1024;  // Larger shapes are tested against every point
+    static constexpr uint32_t KIND_SHIFT = 30;
+    static constexpr uint32_t INDEX_MASK = (uint32_t(1) << KIND_SHIFT) - 1;
+
+    enum { BOXES = 0, CIRCLES = 1, TRIANGLES = 2, SEGMENTS = 3 };
+
+    struct Boxes {
+        vector<double> minX, minY, maxX, maxY;
+        vector<int> pos;
+    } boxes;
+
+    struct Circles {
+        vector<double> cx, cy, r2;
+        vector<int> pos;
+    } circles;
+
+    // Point P is inside when u >= 0, v >= 0 and u + v <= 1, with
+    // u = (d11 * (v0 . w) - d01 * (v1 . w)) * inv, v = (d00 * (v1 . w) - d01 * (v0 . w)) * inv,
+    // w = P - A, v0 = C - A, v1 = B - A
+    struct Triangles {
+        vector<double> ax, ay, v0x, v0y, v1x, v1y, d00, d01, d11, inv;
+        vector<int> pos;
+    } triangles;
+
+    // Zero-area triangles, as the segment A + t (B - A), 0 <= t <= 1, through
+    // their two farthest vertices; inv = 1 / |B - A|^2, or 0 for a single point
+    struct Segments {
+        vector<double> ax, ay, dx, dy, inv;
+        vector<int> pos;
+    } segments;
+
+    double originX = 0.0, originY = 0.0, cellSize = 1.0;
+    size_t columns = 0, rows = 0;
+    vector<uint32_t> cellStart;  // CSR offsets into cellItems, one per cell plus one
+    vector<uint32_t> cellItems;  // (kind << KIND_SHIFT) | index into the per-type arrays
+    vector<uint32_t> oversized;  // Items tested against every point
+
+    static uint32_t item(int kind, size_t index) {
+        return (static_cast<uint32_t>(kind) << KIND_SHIFT) | static_cast<uint32_t>(index);
+    }
+
+    size_t columnOf(double x) const {
+        double c = floor((x - originX) / cellSize);
+        return static_cast<size_t>(min(max(c, 0.0), static_cast<double>(columns - 1)));
+    }
+
+    size_t rowOf(double y) const {
+        double r = floor((y - originY) / cellSize);
+        return static_cast<size_t>(min(max(r, 0.0), static_cast<double>(rows - 1)));
+    }
+
+    // Mark inside[k] for each of the m points (px, py) contained in one item
+    void test(uint32_t entry, const double* px, const double* py, size_t m, unsigned char* inside) const {
+        size_t i = entry & INDEX_MASK;
+        switch (entry >> KIND_SHIFT) {
+            case BOXES: {
+                double x0 = boxes.minX[i], y0 = boxes.minY[i], x1 = boxes.maxX[i], y1 = boxes.maxY[i];
+                for (size_t k = 0; k < m; ++k) {
+                    inside[k] = (px[k] >= x0) & (px[k] <= x1) & (py[k] >= y0) & (py[k] <= y1);
+                }
+                break;
+            }
+            case CIRCLES: {
+                double cx = circles.cx[i], cy = circles.cy[i], r2 = circles.r2[i];
+                for (size_t k = 0; k < m; ++k) {
+                    double dx = px[k] - cx, dy = py[k] - cy;
+                    inside[k] = dx * dx + dy * dy <= r2;
+                }
+                break;
+            }
+            case SEGMENTS: {
+                double ax = segments.ax[i], ay = segments.ay[i], dx = segments.dx[i], dy = segments.dy[i];
+                double inv = segments.inv[i];
+                const double eps = 1e-12;  // Same tolerance as the triangle edges
+                bool single = inv == 0.0;
+                for (size_t k = 0; k < m; ++k) {
+                    double wx = px[k] - ax, wy = py[k] - ay;
+                    double t = (wx * dx + wy * dy) * inv;       // Position along the segment
+                    double off = (wx * dy - wy * dx) * inv;     // Distance from the line, in segment lengths
+                    inside[k] = single ? (wx == 0.0) & (wy == 0.0)
+                                       : (t >= -eps) & (t <= 1.0 + eps) & (off >= -eps) & (off <= eps);
+                }
+                break;
+            }
+            default: {
+                const Triangles& t = triangles;
+                double ax = t.ax[i], ay = t.ay[i], v0x = t.v0x[i], v0y = t.v0y[i], v1x = t.v1x[i], v1y = t.v1y[i];
+                double d00 = t.d00[i], d01 = t.d01[i], d11 = t.d11[i], inv = t.inv[i];
+                const double eps = 1e-12;  // Points on an edge count as inside
+                for (size_t k = 0; k < m; ++k) {
+                    double wx = px[k] - ax, wy = py[k] - ay;
+                    double d02 = v0x * wx + v0y * wy, d12 = v1x * wx + v1y * wy;
+                    double u = (d11 * d02 - d01 * d12) * inv;
+                    double v = (d00 * d12 - d01 * d02) * inv;
+                    inside[k] = (u >= -eps) & (v >= -eps) & (u + v <= 1.0 + eps);
+                }
+                break;
+            }
+        }
+    }
+
+    int positionOf(uint32_t entry) const {
+        size_t i = entry & INDEX_MASK;
+        switch (entry >> KIND_SHIFT) {
+            case BOXES: return boxes.pos[i];
+            case CIRCLES: return circles.pos[i];
+            case SEGMENTS: return segments.pos[i];
+            default: return triangles.pos[i];
+        }
+    }
+
+public:
+    // Copy the shapes' geometry and bucket it in the grid
+    void build(const vector<Shape*>& shapes) {
+        boxes = Boxes();
+        circles = Circles();
+        triangles = Triangles();
+        segments = Segments();
+        vector<BoundingBox> itemBoxes;
+        vector<uint32_t> items;
+        double extent = 0.0;
+        BoundingBox scene{0.0, 0.0, 0.0, 0.0};
+        for (size_t p = 0; p < shapes.size(); ++p) {
+            Shape* s = shapes[p];
+            BoundingBox box = s->getBoundingBox();
+            scene = p == 0 ? box : scene.merge(box);
+            extent += max(box.maxX - box.minX, box.maxY - box.minY);
+            if (s->getKind() == ShapeKind::Circle) {
+                Circle* c = static_cast<Circle*>(s);
+                items.push_back(item(CIRCLES, circles.pos.size()));
+                circles.cx.push_back(c->getCoordinates().getX());
+                circles.cy.push_back(c->getCoordinates().getY());
+                circles.r2.push_back(c->getRadius() * c->getRadius());
+                circles.pos.push_back(static_cast<int>(p));
+            } else if (s->getKind() == ShapeKind::Triangle) {
+                Triangle* t = static_cast<Triangle*>(s);
+                double ax = t->getPosition1().getX(), ay = t->getPosition1().getY();
+                double v0x = t->getPosition3().getX() - ax, v0y = t->getPosition3().getY() - ay;
+                double v1x = t->getPosition2().getX() - ax, v1y = t->getPosition2().getY() - ay;
+                double d00 = v0x * v0x + v0y * v0y, d01 = v0x * v1x + v0y * v1y, d11 = v1x * v1x + v1y * v1y;
+                double denom = d00 * d11 - d01 * d01;
+                if (denom == 0.0) {
+                    // Collinear vertices: the triangle is the segment between the two farthest apart
+                    double bx = t->getPosition2().getX(), by = t->getPosition2().getY();
+                    double d12 = (bx - ax - v0x) * (bx - ax - v0x) + (by - ay - v0y) * (by - ay - v0y);
+                    double sx = ax, sy = ay, ex = ax + v0x, ey = ay + v0y;  // A to C
+                    if (d11 > d00 && d11 >= d12) {
+                        ex = bx;  // A to B
+                        ey = by;
+                    } else if (d12 > d00 && d12 > d11) {
+                        sx = bx;  // B to C
+                        sy = by;
+                    }
+                    double len2 = (ex - sx) * (ex - sx) + (ey - sy) * (ey - sy);
+                    items.push_back(item(SEGMENTS, segments.pos.size()));
+                    segments.ax.push_back(sx);
+                    segments.ay.push_back(sy);
+                    segments.dx.push_back(ex - sx);
+                    segments.dy.push_back(ey - sy);
+                    segments.inv.push_back(len2 > 0.0 ? 1.0 / len2 : 0.0);
+                    segments.pos.push_back(static_cast<int>(p));
+                    itemBoxes.push_back(box);
+                    continue;
+                }
+                items.push_back(item(TRIANGLES, triangles.pos.size()));
+                triangles.ax.push_back(ax);
+                triangles.ay.push_back(ay);
+                triangles.v0x.push_back(v0x);
+                triangles.v0y.push_back(v0y);
+                triangles.v1x.push_back(v1x);
+                triangles.v1y.push_back(v1y);
+                triangles.d00.push_back(d00);
+                triangles.d01.push_back(d01);
+                triangles.d11.push_back(d11);
+                triangles.inv.push_back(1.0 / denom);
+                triangles.pos.push_back(static_cast<int>(p));
+            } else {
+                items.push_back(item(BOXES, boxes.pos.size()));
+                boxes.minX.push_back(box.minX);
+                boxes.minY.push_back(box.minY);
+                boxes.maxX.push_back(box.maxX);
+                boxes.maxY.push_back(box.maxY);
+                boxes.pos.push_back(static_cast<int>(p));
+            }
+            itemBoxes.push_back(box);
+        }
+
+        // Cells about twice the mean shape extent, at most a few per shape
+        size_t n = items.size();
+        originX = scene.minX;
+        originY = scene.minY;
+        double width = scene.maxX - scene.minX, height = scene.maxY - scene.minY;
+        cellSize = max(n > 0 ? 2.0 * extent / static_cast<double>(shapes.size()) : 1.0, 1e-9);
+        double maxCells = 4.0 * static_cast<double>(max(n, static_cast<size_t>(1)));
+        while ((floor(width / cellSize) + 1) * (floor(height / cellSize) + 1) > maxCells) {
+            cellSize *= 2.0;
+        }
+        columns = static_cast<size_t>(floor(width / cellSize)) + 1;
+        rows = static_cast<size_t>(floor(height / cellSize)) + 1;
+
+        // Count, then fill, the items of every cell
+        cellStart.assign(columns * rows + 1, 0);
+        oversized.clear();
+        vector<char> isOversized(n, 0);
+        for (size_t i = 0; i < n; ++i) {
+            const BoundingBox& b = itemBoxes[i];
+            size_t c0 = columnOf(b.minX), c1 = columnOf(b.maxX), r0 = rowOf(b.minY), r1 = rowOf(b.maxY);
+            if ((c1 - c0 + 1) * (r1 - r0 + 1) > MAX_CELLS_PER_SHAPE) {
+                isOversized[i] = 1;
+                oversized.push_back(items[i]);
+                continue;
+            }
+            for (size_t r = r0; r <= r1; ++r) {
+                for (size_t c = c0; c <= c1; ++c) {
+                    cellStart[r * columns + c + 1]++;
+                }
+            }
+        }
+        for (size_t c = 0; c < columns * rows; ++c) {
+            cellStart[c + 1] += cellStart[c];
+        }
+        cellItems.resize(cellStart.back());
+        vector<uint32_t> fillAt(cellStart.begin(), cellStart.end() - 1);
+        for (size_t i = 0; i < n; ++i) {
+            if (isOversized[i]) {
+                continue;
+            }
+            const BoundingBox& b = itemBoxes[i];
+            size_t c0 = columnOf(b.minX), c1 = columnOf(b.maxX), r0 = rowOf(b.minY), r1 = rowOf(b.maxY);
+            for (size_t r = r0; r <= r1; ++r) {
+                for (size_t c = c0; c <= c1; ++c) {
+                    cellItems[fillAt[r * columns + c]++] = items[i];
+                }
+            }
+        }
+    }
+
+    // Find the shapes containing each of the count points (xs[i], ys[i])
+    void query(const double* xs, const double* ys, size_t count, HitResults& out) const {
+        // Sort the points by cell; points outside the grid cannot hit anything
+        size_t cells = columns * rows;
+        const size_t OUTSIDE = cells;
+        vector<size_t> cellOf(count);
+        vector<uint32_t> pointStart(cells + 2, 0);
+        double endX = originX + static_cast<double>(columns) * cellSize;
+        double endY = originY + static_cast<double>(rows) * cellSize;
+        for (size_t i = 0; i < count; ++i) {
+            bool inGrid = cells > 0 && xs[i] >= originX && xs[i] <= endX && ys[i] >= originY && ys[i] <= endY;
+            cellOf[i] = inGrid ? rowOf(ys[i]) * columns + columnOf(xs[i]) : OUTSIDE;
+            pointStart[cellOf[i] + 1]++;
+        }
+        for (size_t c = 0; c <= cells; ++c) {
+            pointStart[c + 1] += pointStart[c];
+        }
+        vector<double> px(count), py(count);
+        vector<uint32_t> original(count);
+        vector<uint32_t> fillAt(pointStart.begin(), pointStart.end() - 1);
+        for (size_t i = 0; i < count; ++i) {
+            uint32_t slot = fillAt[cellOf[i]]++;
+            px[slot] = xs[i];
+            py[slot] = ys[i];
+            original[slot] = static_cast<uint32_t>(i);
+        }
+
+        vector<pair<uint32_t, int>> found;  // (point, shape position)
+        vector<unsigned char> inside(count);
+        auto collect = [&](uint32_t entry, size_t first, size_t m) {
+            test(entry, px.data() + first, py.data() + first, m, inside.data());
+            int position = positionOf(entry);
+            for (size_t k = 0; k < m; ++k) {
+                if (inside[k]) {
+                    found.push_back(make_pair(original[first + k], position));
+                }
+            }
+        };
+        for (size_t c = 0; c < cells; ++c) {
+            size_t first = pointStart[c], m = pointStart[c + 1] - first;
+            if (m == 0) {
+                continue;
+            }
+            for (uint32_t j = cellStart[c]; j < cellStart[c + 1]; ++j) {
+                collect(cellItems[j], first, m);
+            }
+        }
+        size_t inGrid = pointStart[cells];
+        for (uint32_t entry : oversized) {
+            collect(entry, 0, inGrid);
+        }
+
+        // Group the hits by point, shapes in increasing position
+        sort(found.begin(), found.end());
+        out.offsets.assign(count + 1, 0);
+        out.shapes.resize(found.size());
+        for (size_t i = 0; i < found.size(); ++i) {
+            out.offsets[found[i].first + 1]++;
+            out.shapes[i] = found[i].second;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            out.offsets[i + 1] += out.offsets[i];
+        }
+    }
+};
+
+
+// ==============================
+// ShapeListStats Class
+// ==============================
+// Optional per-operation instrumentation for ShapeList: call counts, shapes
+// touched and a latency histogram for every public operation. A list
+// without stats only pays a null-pointer check per call.
+
+// ShapeList operations that are counted and timed
+enum class ShapeOperation {
+    AddShape, RemoveShape, GetShape, TranslateShapes, Scale, Area, Perimeter,
+    Areas, Perimeters, Display, QueryRange, HitTest, Flush, Count
+};
+
+// HDR-style histogram of nanosecond latencies: exact below 8 ns, then every
+// power of two is split into 8 sub-buckets, so any recorded value is known
+// to within 12.5% over the whole 64-bit range with a fixed 496 counters.
+class LatencyHistogram {
+public:
+    static constexpr int SUB_BITS = 3;
+    static constexpr int SUB_BUCKETS = 1 << SUB_BITS;
+    static constexpr int BUCKETS = (64 - SUB_BITS + 1) * SUB_BUCKETS;
+
+private:
+    uint64_t counts[BUCKETS] = {};
+    uint64_t total = 0;
+    uint64_t sum = 0;
+    uint64_t largest = 0;
+
+public:
+    // Return the bucket that holds a value
+    static int bucketOf(uint64_t value) {
+        if (value < static_cast<uint64_t>(SUB_BUCKETS)) {
+            return static_cast<int>(value);
+        }
+#if defined(__GNUC__)
+        int msb = 63 - __builtin_clzll(value);
+#else
+        int msb = 0;
+        while ((value >> (msb + 1)) != 0) {
+            msb++;
+        }
+#endif
+        int shift = msb - SUB_BITS;
+        return (shift + 1) * SUB_BUCKETS + static_cast<int>((value >> shift) & (SUB_BUCKETS - 1));
+    }
+
+    // Return the highest value that falls into a bucket
+    static uint64_t highestIn(int bucket) {
+        if (bucket < SUB_BUCKETS) {
+            return static_cast<uint64_t>(bucket);
+        }
+        int shift = bucket / SUB_BUCKETS - 1;
+        uint64_t lowest = static_cast<uint64_t>(SUB_BUCKETS + bucket % SUB_BUCKETS) << shift;
+        return lowest + ((uint64_t(1) << shift) - 1);
+    }
+
+    void record(uint64_t value) {
+        counts[bucketOf(value)]++;
+        total++;
+        sum += value;
+        largest = max(largest, value);
+    }
+
+    uint64_t count() const {
+        return total;
+    }
+
+    uint64_t totalValue() const {
+        return sum;
+    }
+
+    uint64_t maxValue() const {
+        return largest;
+    }
+
+    double mean() const {
+        return total > 0 ? static_cast<double>(sum) / static_cast<double>(total) : 0.0;
+    }
+
+    // Return the upper bound of the bucket holding the p-th percentile (0-100)
+    uint64_t percentile(double p) const {
+        if (total == 0) {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(ceil(p / 100.0 * static_cast<double>(total)));
+        rank = max(rank, uint64_t(1));
+        uint64_t seen = 0;
+        for (int b = 0; b < BUCKETS; ++b) {
+            seen += counts[b];
+            if (seen >= rank) {
+                return min(highestIn(b), largest);
+            }
+        }
+        return largest;
+    }
+
+    // Add every value recorded by another histogram
+    void merge(const LatencyHistogram& other) {
+        for (int b = 0; b < BUCKETS; ++b) {
+            counts[b] += other.counts[b];
+        }
+        total += other.total;
+        sum += other.sum;
+        largest = max(largest, other.largest);
+    }
+
+    void reset() {
+        fill(counts, counts + BUCKETS, uint64_t(0));
+        total = 0;
+        sum = 0;
+        largest = 0;
+    }
+};
+
+class ShapeListStats {
+private:
+    static constexpr int OPERATIONS = static_cast<int>(ShapeOperation::Count);
+
+    struct Counter {
+        uint64_t calls = 0;
+        uint64_t shapes = 0;  // Shapes touched by those calls
+        LatencyHistogram latency;
+    };
+
+    Counter counters[OPERATIONS];
+    int depth = 0;  // Nesting of StatsScope objects; only the outermost call is recorded
+
+    friend class StatsScope;
+
+public:
+    static const char* name(ShapeOperation op) {
+        static const char* const names[OPERATIONS] = {
+            "addShape", "removeShape", "getShape", "translateShapes", "scale", "area", "perimeter",
+            "areas", "perimeters", "display", "queryRange", "hitTest", "flush"
+        };
+        return names[static_cast<int>(op)];
+    }
+
+    void record(ShapeOperation op, size_t shapes, uint64_t nanoseconds) {
+        Counter& c = counters[static_cast<int>(op)];
+        c.calls++;
+        c.shapes += shapes;
+        c.latency.record(nanoseconds);
+    }
+
+    uint64_t calls(ShapeOperation op) const {
+        return counters[static_cast<int>(op)].calls;
+    }
+
+    uint64_t shapes(ShapeOperation op) const {
+        return counters[static_cast<int>(op)].shapes;
+    }
+
+    const LatencyHistogram& latency(ShapeOperation op) const {
+        return counters[static_cast<int>(op)].latency;
+    }
+
+    void reset() {
+        for (Counter& c : counters) {
+            c.calls = 0;
+            c.shapes = 0;
+            c.latency.reset();
+        }
+    }
+
+    // Write one line per operation that was called, sorted by total time
+    void write(ShapeWriter& out) const {
+        vector<int> used;
+        for (int i = 0; i < OPERATIONS; ++i) {
+            if (counters[i].calls > 0) {
+                used.push_back(i);
+            }
+        }
+        sort(used.begin(), used.end(), [this](int a, int b) {
+            return counters[a].latency.totalValue() > counters[b].latency.totalValue();
+        });
+        out << "--- Operation Statistics ---\n";
+        if (used.empty()) {
+            out << "No operations recorded.\n";
+        }
+        for (int i : used) {
+            const Counter& c = counters[i];
+            out << name(static_cast<ShapeOperation>(i)) << ": " << c.calls << " calls, " << c.shapes
+                << " shapes, " << static_cast<double>(c.latency.totalValue()) / 1e6 << " ms total, p50 "
+                << c.latency.percentile(50.0) << " ns, p99 " << c.latency.percentile(99.0) << " ns, max "
+                << c.latency.maxValue() << " ns\n";
+        }
+    }
+
+    // Write every operation that was called as a JSON document
+    void writeJson(ShapeWriter& out) const {
+        out << "{\"operations\": [";
+        bool first = true;
+        for (int i = 0; i < OPERATIONS; ++i) {
+            const Counter& c = counters[i];
+            if (c.calls == 0) {
+                continue;
+            }
+            out << (first ? "\n" : ",\n");
+            first = false;
+            out << "  {\"name\": \"" << name(static_cast<ShapeOperation>(i)) << "\", \"calls\": " << c.calls
+                << ", \"shapes\": " << c.shapes
+                << ", \"total_ns\": " << c.latency.totalValue()
+                << ", \"mean_ns\": " << c.latency.mean()
+                << ", \"p50_ns\": " << c.latency.percentile(50.0)
+                << ", \"p90_ns\": " << c.latency.percentile(90.0)
+                << ", \"p99_ns\": " << c.latency.percentile(99.0)
+                << ", \"p999_ns\": " << c.latency.percentile(99.9)
+                << ", \"max_ns\": " << c.latency.maxValue() << "}";
+        }
+        out << (first ? "]}\n" : "\n]}\n");
+    }
+};
+
+// Times one ShapeList call and records it when the scope ends. Calls made
+// from inside another instrumented call (area() reading through getShape(),
+// for example) are not recorded separately.
+class StatsScope {
+private:
+    ShapeListStats* stats;
+    ShapeOperation op;
+    size_t shapes;
+    bool outermost = false;
+    chrono::steady_clock::time_point start;
+
+public:
+    StatsScope(ShapeListStats* s, ShapeOperation operation, size_t touched)
+        : stats(s), op(operation), shapes(touched) {
+        if (stats != nullptr) {
+            outermost = stats->depth++ == 0;
+            if (outermost) {
+                start = chrono::steady_clock::now();
+            }
+        }
+    }
+
+    StatsScope(const StatsScope&) = delete;
+    StatsScope& operator=(const StatsScope&) = delete;
+
+    // Correct the number of shapes once the call knows it
+    void setShapes(size_t touched) {
+        shapes = touched;
+    }
+
+    ~StatsScope() {
+        if (stats != nullptr) {
+            stats->depth--;
+            if (outermost) {
+                auto elapsed = chrono::steady_clock::now() - start;
+                stats->record(op, shapes, static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(elapsed).count()));
+            }
+        }
+    }
+};
+
+
+// Running totals over the shapes of a ShapeList, indexed by ShapeKind
+struct SceneAggregates {
+    size_t count = 0;
+    size_t countByKind[4] = {};
+    double areaByKind[4] = {};
+    double perimeterByKind[4] = {};
+    BoundingBox bounds{0.0, 0.0, 0.0, 0.0};  // Box around every shape (all zero when empty)
+
+    size_t countOf(ShapeKind kind) const {
+        return countByKind[static_cast<int>(kind)];
+    }
+
+    double totalArea() const {
+        return areaByKind[0] + areaByKind[1] + areaByKind[2] + areaByKind[3];
+    }
+
+    double totalPerimeter() const {
+        return perimeterByKind[0] + perimeterByKind[1] + perimeterByKind[2] + perimeterByKind[3];
+    }
+
+    double meanArea() const {
+        return count > 0 ? totalArea() / static_cast<double>(count) : 0.0;
+    }
+
+    double meanPerimeter() const {
+        return count > 0 ? totalPerimeter() / static_cast<double>(count) : 0.0;
+    }
+};
+
+
+class ShapeList;
+
+// Receives every change made to a ShapeList (see WriteAheadLog). A change is
+// reported before the list returns from it; changed() follows once the list
+// is consistent again, so the receiver may read the whole list there.
+class ShapeListLog {
+public:
+    virtual void logAdd(const Shape* s) = 0;
+    virtual void logRemove(int pos) = 0;
+    virtual void logTranslate(int dx, int dy) = 0;
+    virtual void logScale(int factor, bool sign) = 0;
+    virtual void changed(ShapeList& list) = 0;
+    virtual ~ShapeListLog() {}
+};
+
+
+// ShapeList Class
+
+class ShapeList {
+private:
+    friend class ShapeSnapshot;   // Reads the shapes without counting getShape() calls
+
+    vector<Shape*> listofShapes;  // Stores a list of shapes using polymorphism
+    ShapeArena arena;             // Owns the shapes built by createShape()
+    size_t heapShapes = 0;        // Shapes added with addShape(), deleted one by one
+    unique_ptr<WorkStealingPool> pool;  // Set when transforms run in parallel
+    size_t grainSize = 4096;            // Shapes per parallel chunk
+
+    // A transform recorded while deferred mode is on. Consecutive translations
+    // are composed into one run; scales are kept one by one, because repeated
+    // integer division and floating-point scaling do not compose exactly.
+    struct PendingTransform {
+        bool isScale;
+        int factor;                    // Scale factor (scale only)
+        bool sign;                     // Multiply or divide (scale only)
+        vector<pair<int, int>> steps;  // Individual (dx, dy) calls of a translation run
+        int sumDx, sumDy;              // Offset of the whole run
+        int minDx, minDy;              // Lowest running offset reached during the run
+    };
+
+    vector<BoundingBox> shapeBoxes;  // Packed bounding boxes, in list order
+    bool boxesStale = false;         // Regather shapeBoxes before the next read
+
+    unique_ptr<SpatialIndex> spatialIndex;  // Optional index over the shapes' bounding boxes
+    bool indexStale = false;                // Rebuild the index before the next query
+
+    HitTester hitTester;     // Per-type geometry and grid for hitTest()
+    bool hitStale = true;    // Rebuild hitTester before the next hit test
+
+    unique_ptr<MetricIndex> metricIndex;        // Optional ordered index on area and perimeter
+    unordered_map<const Shape*, int> positionOf;  // Shape positions for metric query results
+    bool positionsStale = false;                // Rebuild positionOf before the next query
+
+    unique_ptr<ShapeListStats> stats;  // Per-operation counters, when enabled
+    ShapeListLog* changeLog = nullptr;  // Receives every change, when set (not owned)
+
+    // Scene totals kept up to date on add, remove and transform. A transform
+    // that cannot be applied analytically marks the affected part stale and
+    // aggregates() rescans it on the next read.
+    SceneAggregates totals;
+    bool kindStale[4] = {};    // Per-kind area/perimeter sums need a rescan
+    bool boundsStale = false;  // Scene bounding box needs a rescan
+
+    bool diagnosticsMode = false;   // Collect transform warnings instead of printing them
+    bool diagnosticsIds = false;    // Also keep the positions of the affected shapes
+    DiagnosticsReport diagnostics;  // Collected since the last clearDiagnostics()
+    mutex diagnosticsLock;          // Guards diagnostics while parallel chunks merge
+
+    bool deferred = false;             // Record transforms instead of applying them
+    vector<PendingTransform> pending;  // Transforms not yet applied to every shape
+    vector<size_t> applied;            // Per shape: pending transforms it already received
+    size_t sealed = 0;                 // Pending transforms that some shape already received
+
+    // Apply fn to every shape index, on the pool when parallel execution is enabled
+    // In diagnostics mode each chunk collects its warnings and merges them once.
+    void forEachIndex(const function<void(size_t)>& fn) {
+        if (pool == nullptr || listofShapes.size() <= grainSize) {
+            if (diagnosticsMode) {
+                DiagnosticsCollector collector(diagnostics, diagnosticsIds);
+                for (size_t i = 0; i < listofShapes.size(); ++i) {
+                    collector.beginShape(i);
+                    fn(i);
+                }
+                return;
+            }
+            for (size_t i = 0; i < listofShapes.size(); ++i) {
+                fn(i);
+            }
+            return;
+        }
+        pool->parallelFor(listofShapes.size(), grainSize, [this, &fn](size_t begin, size_t end) {
+            if (diagnosticsMode) {
+                DiagnosticsReport local;
+                {
+                    DiagnosticsCollector collector(local, diagnosticsIds);
+                    for (size_t i = begin; i < end; ++i) {
+                        collector.beginShape(i);
+                        fn(i);
+                    }
+                }
+                if (local.total() > 0) {
+                    lock_guard<mutex> lock(diagnosticsLock);
+                    diagnostics.merge(local);
+                }
+                return;
+            }
+            for (size_t i = begin; i < end; ++i) {
+                fn(i);
+            }
+        });
+    }
+
+    // Apply fn to every shape, on the pool when parallel execution is enabled
+    void forEachShape(const function<void(Shape*)>& fn) {
+        forEachIndex([this, &fn](size_t i) {
+            if (listofShapes[i] != nullptr) {
+                fn(listofShapes[i]);
+            }
+        });
+    }
+
+    // Apply one recorded transform with the same result as the eager call(s).
+    // A translation run is applied in one step when none of its calls would be
+    // skipped for this shape, and replayed call by call otherwise.
+    static void applyTransform(Shape* s, const PendingTransform& t) {
+        if (t.isScale) {
+            s->scale(t.factor, t.sign);
+        } else if (s->fitsTranslation(t.minDx, t.minDy)) {
+            s->translate(t.sumDx, t.sumDy);
+        } else {
+            for (const pair<int, int>& step : t.steps) {
+                s->translate(step.first, step.second);
+            }
+        }
+    }
+
+    // Bring one shape up to date with the pending transforms
+    void catchUp(size_t pos) {
+        for (size_t k = applied[pos]; k < pending.size(); ++k) {
+            applyTransform(listofShapes[pos], pending[k]);
+        }
+        applied[pos] = pending.size();
+    }
+
+    // Bring one shape up to date outside a bulk loop, collecting its warnings in diagnostics mode
+    void catchUpShape(size_t pos) {
+        if (!diagnosticsMode) {
+            catchUp(pos);
+            return;
+        }
+        DiagnosticsCollector collector(diagnostics, diagnosticsIds);
+        collector.beginShape(pos);
+        catchUp(pos);
+    }
+
+    // Start tracking per-shape progress when the first transform is recorded
+    void beginPending() {
+        if (pending.empty()) {
+            applied.assign(listofShapes.size(), 0);
+            sealed = 0;
+        }
+    }
+
+    // Record a translation, extending the last run if no shape has applied it yet
+    void recordTranslate(int dx, int dy) {
+        beginPending();
+        if (!pending.empty() && !pending.back().isScale && pending.size() > sealed) {
+            PendingTransform& run = pending.back();
+            run.steps.push_back(make_pair(dx, dy));
+            run.sumDx += dx;
+            run.sumDy += dy;
+            run.minDx = min(run.minDx, run.sumDx);
+            run.minDy = min(run.minDy, run.sumDy);
+            return;
+        }
+        PendingTransform run{false, 0, false, {make_pair(dx, dy)}, dx, dy, dx, dy};
+        pending.push_back(run);
+    }
+
+    // Record a scale
+    void recordScale(int factor, bool sign) {
+        beginPending();
+        PendingTransform t{true, factor, sign, {}, 0, 0, 0, 0};
+        pending.push_back(t);
+    }
+
+    // Add a shape's area, perimeter and box to the totals
+    void addToTotals(Shape* s) {
+        int k = static_cast<int>(s->getKind());
+        totals.count++;
+        totals.countByKind[k]++;
+        if (!kindStale[k]) {
+            totals.areaByKind[k] += s->getArea();
+            totals.perimeterByKind[k] += s->getPerimeter();
+        }
+        if (!boundsStale) {
+            BoundingBox box = s->getBoundingBox();
+            totals.bounds = totals.count == 1 ? box : totals.bounds.merge(box);
+        }
+    }
+
+    // Take a removed shape out of the totals
+    void removeFromTotals(Shape* s) {
+        int k = static_cast<int>(s->getKind());
+        totals.count--;
+        totals.countByKind[k]--;
+        if (totals.countByKind[k] == 0) {
+            // Reset exactly rather than keep the rounding left by the subtractions
+            totals.areaByKind[k] = 0.0;
+            totals.perimeterByKind[k] = 0.0;
+            kindStale[k] = false;
+        } else if (!kindStale[k]) {
+            totals.areaByKind[k] -= s->getArea();
+            totals.perimeterByKind[k] -= s->getPerimeter();
+        }
+        if (totals.count == 0) {
+            totals.bounds = BoundingBox{0.0, 0.0, 0.0, 0.0};
+            boundsStale = false;
+        } else if (!boundsStale) {
+            // Only a shape on the edge of the scene box can shrink it
+            BoundingBox box = s->getBoundingBox();
+            boundsStale = box.minX <= totals.bounds.minX || box.minY <= totals.bounds.minY ||
+                          box.maxX >= totals.bounds.maxX || box.maxY >= totals.bounds.maxY;
+        }
+    }
+
+    // Update the totals for translateShapes(dx, dy). Every point a translate()
+    // moves lies inside the scene box, so if the box stays non-negative no
+    // translation is skipped: the box just shifts and no metric changes.
+    // Otherwise triangles that moved only some vertices change shape; returns
+    // true in that case.
+    bool translateTotals(int dx, int dy) {
+        if (totals.count == 0) {
+            return false;
+        }
+        if (!boundsStale && (dx >= 0 || totals.bounds.minX + dx >= 0) && (dy >= 0 || totals.bounds.minY + dy >= 0)) {
+            totals.bounds = BoundingBox{totals.bounds.minX + dx, totals.bounds.minY + dy,
+                                        totals.bounds.maxX + dx, totals.bounds.maxY + dy};
+            return false;
+        }
+        boundsStale = true;
+        kindStale[static_cast<int>(ShapeKind::Triangle)] = totals.countOf(ShapeKind::Triangle) > 0;
+        return kindStale[static_cast<int>(ShapeKind::Triangle)];
+    }
+
+    // Update the totals for scale(factor, sign). Multiplying scales every
+    // area by factor^2, every perimeter and the scene box by factor. Dividing
+    // does the same for the floating-point sizes, but integer division of
+    // positions and triangle vertices truncates, so those are rescanned.
+    void scaleTotals(int factor, bool sign) {
+        if (factor <= 0 || totals.count == 0) {
+            return;
+        }
+        double k = sign ? static_cast<double>(factor) : 1.0 / factor;
+        for (int i = 0; i < 4; ++i) {
+            totals.areaByKind[i] *= k * k;
+            totals.perimeterByKind[i] *= k;
+        }
+        if (!sign) {
+            boundsStale = true;
+            kindStale[static_cast<int>(ShapeKind::Triangle)] = totals.countOf(ShapeKind::Triangle) > 0;
+        } else if (!boundsStale) {
+            totals.bounds = BoundingBox{totals.bounds.minX * k, totals.bounds.minY * k,
+                                        totals.bounds.maxX * k, totals.bounds.maxY * k};
+        }
+    }
+
+    // Shift the packed boxes for translateShapes(dx, dy). Every point of a
+    // shape lies inside its box, so if no box would reach a negative
+    // coordinate no translation is skipped and every box moves by (dx, dy).
+    // Deferred and partly skipped translations regather the boxes instead.
+    void translateBoxes(int dx, int dy) {
+        if (boxesStale || deferred) {
+            boxesStale = true;
+            return;
+        }
+        double lowX = 0.0, lowY = 0.0;
+        for (const BoundingBox& b : shapeBoxes) {
+            lowX = min(lowX, b.minX + dx);
+            lowY = min(lowY, b.minY + dy);
+        }
+        if (lowX < 0.0 || lowY < 0.0) {
+            boxesStale = true;
+            return;
+        }
+        for (BoundingBox& b : shapeBoxes) {
+            b = BoundingBox{b.minX + dx, b.minY + dy, b.maxX + dx, b.maxY + dy};
+        }
+    }
+
+    // Scale the packed boxes for scale(factor, sign), as Shape::scaleBox() does
+    void scaleBoxes(int factor, bool sign) {
+        if (factor <= 0) {
+            return;
+        }
+        if (boxesStale || deferred || !sign) {
+            boxesStale = true;
+            return;
+        }
+        double f = static_cast<double>(factor);
+        for (BoundingBox& b : shapeBoxes) {
+            b = BoundingBox{b.minX * f, b.minY * f, b.maxX * f, b.maxY * f};
+        }
+    }
+
+    // Register a newly added shape, which must not receive earlier transforms
+    void trackNewShape() {
+        addToTotals(listofShapes.back());
+        hitStale = true;
+        if (!boxesStale) {
+            shapeBoxes.push_back(listofShapes.back()->getBoundingBox());
+        }
+        if (metricIndex != nullptr) {
+            metricIndex->insert(listofShapes.back());
+            if (!positionsStale) {
+                positionOf[listofShapes.back()] = size() - 1;
+            }
+        }
+        if (!pending.empty()) {
+            // The shape counts the last run as received, so later steps must start a new run
+            applied.push_back(pending.size());
+            sealed = pending.size();
+        }
+        if (spatialIndex != nullptr && !indexStale) {
+            if (pending.empty()) {
+                spatialIndex->insert(size() - 1, listofShapes.back()->getBoundingBox());
+            } else {
+                indexStale = true;
+            }
+        }
+        if (changeLog != nullptr) {
+            changeLog->logAdd(listofShapes.back());
+            changeLog->changed(*this);
+        }
+    }
+
+    // Make the spatial index match the current shapes
+    void refreshIndex() {
+        flush();
+        if (indexStale) {
+            spatialIndex->build(boundingBoxes());
+            indexStale = false;
+        }
+    }
+
+    // Bring the metric index and the shape positions up to date for a query
+    void refreshMetricIndex() {
+        if (metricIndex->hasStale()) {
+            flush();
+            metricIndex->rebuildStale(listofShapes);
+        }
+        metricIndex->compact();
+        if (positionsStale) {
+            positionOf.clear();
+            for (size_t i = 0; i < listofShapes.size(); ++i) {
+                positionOf[listofShapes[i]] = static_cast<int>(i);
+            }
+            positionsStale = false;
+        }
+    }
+
+    // Every shape's (metric, position), sorted, for queries without the index
+    vector<pair<double, int>> scanMetric(ShapeMetric metric) {
+        vector<double> values;
+        if (metric == ShapeMetric::Area) {
+            areas(values);
+        } else {
+            perimeters(values);
+        }
+        vector<pair<double, int>> keyed(values.size());
+        for (size_t i = 0; i < values.size(); ++i) {
+            keyed[i] = make_pair(values[i], static_cast<int>(i));
+        }
+        sort(keyed.begin(), keyed.end());
+        return keyed;
+    }
+
+    // Gather the shapes into per-type columns, run the batch kernels and
+    // scatter the results back into list order
+    void batchMetrics(vector<double>& out, bool wantArea) {
+        vector<double> width, length, side, radius;
+        vector<int> x1, y1, x2, y2, x3, y3;
+        vector<size_t> rectPos, squarePos, circlePos, trianglePos;
+
+        for (size_t i = 0; i < listofShapes.size(); ++i) {
+            Shape* s = listofShapes[i];
+            switch (s->getKind()) {
+                case ShapeKind::Rectangle: {
+                    Rectangle* r = static_cast<Rectangle*>(s);
+                    width.push_back(r->getWidth());
+                    length.push_back(r->getLength());
+                    rectPos.push_back(i);
+                    break;
+                }
+                case ShapeKind::Square:
+                    side.push_back(static_cast<Square*>(s)->getSide());
+                    squarePos.push_back(i);
+                    break;
+                case ShapeKind::Circle:
+                    radius.push_back(static_cast<Circle*>(s)->getRadius());
+                    circlePos.push_back(i);
+                    break;
+                case ShapeKind::Triangle: {
+                    Triangle* t = static_cast<Triangle*>(s);
+                    x1.push_back(t->getPosition1().getX()); y1.push_back(t->getPosition1().getY());
+                    x2.push_back(t->getPosition2().getX()); y2.push_back(t->getPosition2().getY());
+                    x3.push_back(t->getPosition3().getX()); y3.push_back(t->getPosition3().getY());
+                    trianglePos.push_back(i);
+                    break;
+                }
+            }
+        }
+
+        vector<double> rect(rectPos.size()), square(squarePos.size());
+        vector<double> circle(circlePos.size()), triangle(trianglePos.size());
+        if (wantArea) {
+            rectangleAreaKernel(width.data(), length.data(), rect.data(), rect.size());
+            squareAreaKernel(side.data(), square.data(), square.size());
+            circleAreaKernel(radius.data(), circle.data(), circle.size());
+            triangleAreaKernel(x1.data(), y1.data(), x2.data(), y2.data(), x3.data(), y3.data(),
+                               triangle.data(), triangle.size());
+        } else {
+            rectanglePerimeterKernel(width.data(), length.data(), rect.data(), rect.size());
+            squarePerimeterKernel(side.data(), square.data(), square.size());
+            circlePerimeterKernel(radius.data(), circle.data(), circle.size());
+            trianglePerimeterKernel(x1.data(), y1.data(), x2.data(), y2.data(), x3.data(), y3.data(),
+                                    triangle.data(), triangle.size());
+        }
+
+        out.resize(listofShapes.size());
+        for (size_t i = 0; i < rectPos.size(); ++i) out[rectPos[i]] = rect[i];
+        for (size_t i = 0; i < squarePos.size(); ++i) out[squarePos[i]] = square[i];
+        for (size_t i = 0; i < circlePos.size(); ++i) out[circlePos[i]] = circle[i];
+        for (size_t i = 0; i < trianglePos.size(); ++i) out[trianglePos[i]] = triangle[i];
+    }
+
+public:
+    // Add a shape to the list
+    void addShape(Shape* s) {
+        StatsScope scope(stats.get(), ShapeOperation::AddShape, s != nullptr ? 1 : 0);
+        if (s != nullptr) {
+            listofShapes.push_back(s);
+            heapShapes++;
+            trackNewShape();
+        }
+    }
+
+    // Construct a shape of type T in the list's arena and add it
+    template <typename T, typename... Args>
+    T* createShape(Args&&... args) {
+        StatsScope scope(stats.get(), ShapeOperation::AddShape, 1);
+        T* s = arena.create<T>(forward<Args>(args)...);
+        listofShapes.push_back(s);
+        trackNewShape();
+        return s;
+    }
+
+    // Run translateShapes() and scale() in chunks of grain shapes on a
+    // work-stealing pool; a thread count of 1 or less restores serial mode
+    void setParallelExecution(int threadCount, size_t grain = 4096) {
+        grainSize = grain > 0 ? grain : 1;
+        if (threadCount <= 1) {
+            pool.reset();
+        } else if (pool == nullptr || pool->getThreadCount() != threadCount) {
+            pool.reset(new WorkStealingPool(threadCount));
+        }
+    }
+
+    // Keep a spatial index over the shapes' bounding boxes: a uniform grid with
+    // the given cell size, or a bulk-loaded R-tree. Adds, removals and
+    // transforms that move every box exactly (translations that skip no shape,
+    // multiplying scales) update the index in place; other changes rebuild it
+    // at the next query.
+    void enableSpatialIndex(SpatialIndexKind kind, double cellSize = 64.0) {
+        if (kind == SpatialIndexKind::None) {
+            spatialIndex.reset();
+            return;
+        }
+        if (kind == SpatialIndexKind::UniformGrid) {
+            spatialIndex.reset(new UniformGridIndex(cellSize));
+        } else {
+            spatialIndex.reset(new RTreeIndex());
+        }
+        indexStale = true;
+    }
+
+    // Return the bounding box of every shape, in list order, packed for culling
+    // loops. Kept up to date on add, remove and eager transforms; otherwise
+    // gathered again from the shapes' cached boxes.
+    const vector<BoundingBox>& boundingBoxes() {
+        flush();
+        if (boxesStale) {
+            shapeBoxes.resize(listofShapes.size());
+            for (size_t i = 0; i < listofShapes.size(); ++i) {
+                shapeBoxes[i] = listofShapes[i]->getBoundingBox();
+            }
+            boxesStale = false;
+        }
+        return shapeBoxes;
+    }
+
+    // Return the positions of the shapes whose bounding box overlaps the rectangle
+    vector<int> queryRange(double minX, double minY, double maxX, double maxY) {
+        StatsScope scope(stats.get(), ShapeOperation::QueryRange, 0);
+        BoundingBox area{min(minX, maxX), min(minY, maxY), max(minX, maxX), max(minY, maxY)};
+        vector<int> found;
+        if (spatialIndex == nullptr) {
+            const vector<BoundingBox>& boxes = boundingBoxes();
+            for (size_t i = 0; i < boxes.size(); ++i) {
+                if (boxes[i].overlaps(area)) {
+                    found.push_back(static_cast<int>(i));
+                }
+            }
+            scope.setShapes(found.size());
+            return found;
+        }
+        refreshIndex();
+        spatialIndex->query(area, found);
+        sort(found.begin(), found.end());
+        scope.setShapes(found.size());
+        return found;
+    }
+
+    // Return the positions of the shapes whose bounding box contains the point
+    vector<int> queryPoint(double x, double y) {
+        return queryRange(x, y, x, y);
+    }
+
+    // Find the shapes that contain each point (xs[i], ys[i]), using the exact
+    // shape geometry rather than bounding boxes; edges count as inside. The
+    // per-type arrays and grid are rebuilt after the shapes change, so many
+    // points per call amortize that cost.
+    void hitTest(const vector<double>& xs, const vector<double>& ys, HitResults& out) {
+        size_t count = min(xs.size(), ys.size());
+        StatsScope scope(stats.get(), ShapeOperation::HitTest, count);
+        flush();
+        if (hitStale) {
+            hitTester.build(listofShapes);
+            hitStale = false;
+        }
+        hitTester.query(xs.data(), ys.data(), count, out);
+    }
+
+    // Return the positions of the shapes that contain the point
+    vector<int> shapesAt(double x, double y) {
+        HitResults hits;
+        hitTest(vector<double>(1, x), vector<double>(1, y), hits);
+        return hits.shapes;
+    }
+
+    // Count calls, shapes touched and latency of every operation; turning it
+    // off drops the collected data
+    void enableStats(bool enabled) {
+        if (!enabled) {
+            stats.reset();
+        } else if (stats == nullptr) {
+            stats.reset(new ShapeListStats());
+        }
+    }
+
+    // Return the collected statistics, or nullptr when they are disabled
+    ShapeListStats* getStats() {
+        return stats.get();
+    }
+
+    // Report every later change to log (nullptr detaches the current one)
+    void setChangeLog(ShapeListLog* log) {
+        changeLog = log;
+    }
+
+    // Call onPair(i, j), i < j, for every pair of overlapping shapes and
+    // return the number of pairs. Uses the parallel pool when enabled; pairs
+    // arrive in batches as parts of the sweep finish, in no particular order.
+    size_t findOverlaps(const function<void(int, int)>& onPair) {
+        flush();
+        return OverlapDetector::findPairs(listofShapes, pool.get(), grainSize, onPair);
+    }
+
+    // Keep an ordered index on area and perimeter for queryMetricRange(),
+    // topShapes() and metricPercentile(); without it they sort a full scan
+    void enableMetricIndex(bool enabled) {
+        if (!enabled) {
+            metricIndex.reset();
+            positionOf.clear();
+            return;
+        }
+        flush();
+        metricIndex.reset(new MetricIndex());
+        metricIndex->build(listofShapes);
+        positionsStale = true;
+    }
+
+    // Return the positions of the shapes whose metric lies in [lo, hi], in increasing metric order
+    vector<int> queryMetricRange(ShapeMetric metric, double lo, double hi) {
+        vector<int> found;
+        if (metricIndex == nullptr) {
+            for (const pair<double, int>& entry : scanMetric(metric)) {
+                if (entry.first >= lo && entry.first <= hi) {
+                    found.push_back(entry.second);
+                }
+            }
+            return found;
+        }
+        refreshMetricIndex();
+        vector<pair<double, Shape*>> entries;
+        metricIndex->range(metric, lo, hi, entries);
+        for (const pair<double, Shape*>& entry : entries) {
+            found.push_back(positionOf[entry.second]);
+        }
+        return found;
+    }
+
+    // Return the positions of the count largest (or smallest) shapes by a metric, largest (or smallest) first
+    vector<int> topShapes(ShapeMetric metric, size_t count, bool largest = true) {
+        vector<int> found;
+        if (metricIndex == nullptr) {
+            vector<pair<double, int>> keyed = scanMetric(metric);
+            if (largest) {
+                reverse(keyed.begin(), keyed.end());
+            }
+            for (size_t i = 0; i < keyed.size() && i < count; ++i) {
+                found.push_back(keyed[i].second);
+            }
+            return found;
+        }
+        refreshMetricIndex();
+        vector<pair<double, Shape*>> entries;
+        metricIndex->top(metric, count, largest, entries);
+        for (const pair<double, Shape*>& entry : entries) {
+            found.push_back(positionOf[entry.second]);
+        }
+        return found;
+    }
+
+    // Return the nearest-rank p-th percentile (0-100) of a metric, or -1.0 for an empty list
+    double metricPercentile(ShapeMetric metric, double p) {
+        if (metricIndex == nullptr) {
+            vector<pair<double, int>> keyed = scanMetric(metric);
+            if (keyed.empty()) {
+                return -1.0;
+            }
+            size_t rank = static_cast<size_t>(ceil(min(max(p, 0.0), 100.0) / 100.0 * static_cast<double>(keyed.size())));
+            return keyed[rank == 0 ? 0 : rank - 1].first;
+        }
+        refreshMetricIndex();
+        return metricIndex->percentile(metric, p);
+    }
+
+    // Return the scene totals: counts per type, total and mean area and
+    // perimeter, and the scene bounding box. Kept up to date in O(1) per add,
+    // remove and transform; only parts a transform made stale are rescanned.
+    // Changes made to a shape through a getShape() pointer are not tracked.
+    const SceneAggregates& aggregates() {
+        bool anyStale = boundsStale;
+        for (bool stale : kindStale) {
+            anyStale = anyStale || stale;
+        }
+        if (!anyStale) {
+            return totals;
+        }
+        flush();
+        for (int k = 0; k < 4; ++k) {
+            if (kindStale[k]) {
+                totals.areaByKind[k] = 0.0;
+                totals.perimeterByKind[k] = 0.0;
+            }
+        }
+        bool first = true;
+        for (Shape* s : listofShapes) {
+            int k = static_cast<int>(s->getKind());
+            if (kindStale[k]) {
+                totals.areaByKind[k] += s->getArea();
+                totals.perimeterByKind[k] += s->getPerimeter();
+            }
+            if (boundsStale) {
+                BoundingBox box = s->getBoundingBox();
+                totals.bounds = first ? box : totals.bounds.merge(box);
+                first = false;
+            }
+        }
+        fill(kindStale, kindStale + 4, false);
+        boundsStale = false;
+        return totals;
+    }
+
+    // Collect the warnings raised by translateShapes() and scale() into a
+    // report instead of printing one line per shape; with keepIds the
+    // positions of the affected shapes (at the time of the call) are kept too
+    void setDiagnosticsMode(bool enabled, bool keepIds = false) {
+        diagnosticsMode = enabled;
+        diagnosticsIds = enabled && keepIds;
+    }
+
+    // Return the warnings collected since the last clearDiagnostics()
+    const DiagnosticsReport& getDiagnostics() const {
+        return diagnostics;
+    }
+
+    void clearDiagnostics() {
+        diagnostics.clear();
+    }
+
+    // Run fn with its transform warnings collected into report, one count per
+    // shape as in diagnostics mode. In diagnostics mode they go to the list's
+    // own report instead, and report is left untouched.
+    template <typename Fn>
+    void collectDiagnostics(DiagnosticsReport& report, Fn fn) {
+        if (diagnosticsMode) {
+            fn();
+            return;
+        }
+        DiagnosticsReport kept;
+        swap(kept, diagnostics);
+        diagnosticsMode = true;
+        fn();
+        diagnosticsMode = false;
+        report.merge(diagnostics);
+        swap(kept, diagnostics);
+    }
+
+    // Return the collected warnings as one summary line per kind
+    string diagnosticsSummary() const {
+        string result;
+        {
+            ShapeWriter out(result);
+            diagnostics.write(out);
+        }
+        return result;
+    }
+
+    // Record translateShapes() and scale() calls and apply them only when a
+    // shape is read or flush() is called; turning it off flushes
+    void setDeferredTransforms(bool enabled) {
+        deferred = enabled;
+        if (!enabled) {
+            flush();
+        }
+    }
+
+    // Apply every pending transform to every shape
+    void flush() {
+        if (pending.empty()) {
+            return;
+        }
+        StatsScope scope(stats.get(), ShapeOperation::Flush, listofShapes.size());
+        forEachIndex([this](size_t i) { catchUp(i); });
+        pending.clear();
+        applied.clear();
+        sealed = 0;
+    }
+
+    // Translate all shapes in the list by (dx, dy)
+    void translateShapes(int dx, int dy) {
+        StatsScope scope(stats.get(), ShapeOperation::TranslateShapes, listofShapes.size());
+        if (translateTotals(dx, dy) && metricIndex != nullptr) {
+            metricIndex->invalidate(ShapeKind::Triangle);
+        }
+        bool boxesExact = !boxesStale;
+        translateBoxes(dx, dy);
+        if (spatialIndex != nullptr && !indexStale) {
+            if (boxesExact && !boxesStale) {
+                spatialIndex->transform(1.0, dx, dy);
+            } else {
+                indexStale = true;
+            }
+        }
+        hitStale = true;
+        if (changeLog != nullptr) {
+            changeLog->logTranslate(dx, dy);
+        }
+        if (deferred) {
+            recordTranslate(dx, dy);
+        } else {
+            forEachShape([dx, dy](Shape* s) { s->translate(dx, dy); });
+        }
+        if (changeLog != nullptr) {
+            changeLog->changed(*this);
+        }
+    }
+
+    // Return the number of shapes in the list
+    int size() const {
+        return static_cast<int>(listofShapes.size());
+    }
+
+    // Return the shape at a specific position (index starts at 0)
+    Shape* getShape(int pos) {
+        StatsScope scope(stats.get(), ShapeOperation::GetShape, 1);
+        if (pos >= 0 && pos < static_cast<int>(listofShapes.size())) {
+            if (!pending.empty()) {
+                catchUpShape(pos);
+                sealed = pending.size();
+            }
+            return listofShapes[pos];
+        }
+        cout << "Warning: Invalid position in getShape(). Returning nullptr." << endl;
+        return nullptr;
+    }
+
+    // Remove the shape at a specific position and return it (caller is responsible for deletion).
+    // Arena shapes are handed back as a heap copy so the caller can still delete them.
+    Shape* removeShape(int pos) {
+        StatsScope scope(stats.get(), ShapeOperation::RemoveShape, 1);
+        if (pos >= 0 && pos < static_cast<int>(listofShapes.size())) {
+            if (!pending.empty()) {
+                catchUpShape(pos);
+                applied.erase(applied.begin() + pos);
+            }
+            Shape* removed = listofShapes[pos];
+            listofShapes.erase(listofShapes.begin() + pos);
+            if (!boxesStale) {
+                shapeBoxes.erase(shapeBoxes.begin() + pos);
+            }
+            removeFromTotals(removed);
+            if (metricIndex != nullptr) {
+                metricIndex->erase(removed);
+                positionsStale = true;
+            }
+            if (spatialIndex != nullptr && !indexStale) {
+                spatialIndex->erase(pos);  // Later positions shift down by one
+            }
+            hitStale = true;
+            if (changeLog != nullptr) {
+                changeLog->logRemove(pos);
+                changeLog->changed(*this);
+            }
+            if (arena.owns(removed)) {
+                Shape* copy = removed->clone();
+                arena.destroy(removed);
+                return copy;
+            }
+            heapShapes--;
+            return removed;
+        }
+        cout << "Warning: Invalid position in removeShape()." << endl;
+        return nullptr;
+    }
+
+    // Return the area of the shape at a given position
+    double area(int pos) {
+        StatsScope scope(stats.get(), ShapeOperation::Area, 1);
+        Shape* s = getShape(pos);
+        if (s != nullptr) {
+            return s->getArea();
+        }
+        return -1.0;
+    }
+
+    // Return the perimeter of the shape at a given position
+    double perimeter(int pos) {
+        StatsScope scope(stats.get(), ShapeOperation::Perimeter, 1);
+        Shape* s = getShape(pos);
+        if (s != nullptr) {
+            return s->getPerimeter();
+        }
+        return -1.0;
+    }
+
+    // Fill out with the area of every shape, in list order
+    void areas(vector<double>& out) {
+        StatsScope scope(stats.get(), ShapeOperation::Areas, listofShapes.size());
+        flush();
+        batchMetrics(out, true);
+    }
+
+    // Fill out with the perimeter of every shape, in list order
+    void perimeters(vector<double>& out) {
+        StatsScope scope(stats.get(), ShapeOperation::Perimeters, listofShapes.size());
+        flush();
+        batchMetrics(out, false);
+    }
+
+    // Scale all shapes in the list
+    void scale(int factor, bool sign) {
+        StatsScope scope(stats.get(), ShapeOperation::Scale, listofShapes.size());
+        scaleTotals(factor, sign);
+        if (metricIndex != nullptr) {
+            metricIndex->scale(factor, sign);
+        }
+        bool boxesExact = !boxesStale;
+        scaleBoxes(factor, sign);
+        if (spatialIndex != nullptr && !indexStale && factor > 0) {
+            if (boxesExact && !boxesStale) {
+                spatialIndex->transform(static_cast<double>(factor), 0.0, 0.0);
+            } else {
+                indexStale = true;
+            }
+        }
+        hitStale = true;
+        if (changeLog != nullptr) {
+            changeLog->logScale(factor, sign);
+        }
+        if (deferred) {
+            recordScale(factor, sign);
+        } else {
+            forEachShape([factor, sign](Shape* s) { s->scale(factor, sign); });
+        }
+        if (changeLog != nullptr) {
+            changeLog->changed(*this);
+        }
+    }
+
+    // Display information about all shapes
+    string display() {
+        string result;
+        {
+            ShapeWriter out(result);
+            display(out);
+        }
+        return result;
+    }
+
+    // Write the shapes at positions [first, last) into a writer, with the same
+    // layout and numbering as display(); last = -1 means up to the end
+    void display(ShapeWriter& out, int first = 0, int last = -1) {
+        StatsScope scope(stats.get(), ShapeOperation::Display, 0);
+        flush();
+        int count = size();
+        if (last < 0 || last > count) {
+            last = count;
+        }
+        first = max(first, 0);
+        scope.setShapes(static_cast<size_t>(max(last - first, 0)));
+        out << "--- Shape List ---\n\n";
+        for (int i = first; i < last; ++i) {
+            out << "Shape " << i + 1 << ": ";
+            listofShapes[i]->write(out);
+            out << "\n\n";
+        }
+    }
+
+    // Stream the shapes at positions [first, last) to an output stream
+    void display(ostream& stream, int first = 0, int last = -1) {
+        ShapeWriter out(stream);
+        display(out, first, last);
+    }
+
+    // Destructor: delete the shapes added with addShape(); the arena releases
+    // its slabs in one go, so a list built with createShape() skips the loop
+    ~ShapeList() {
+        if (heapShapes > 0) {
+            for (Shape* s : listofShapes) {
+                if (!arena.owns(s)) {
+                    delete s;
+                }
+            }
+        }
+        listofShapes.clear();
+    }
+};
+
+
+
+// ==============================
+// Test function for ShapeList class
+// ==============================
+void test_shape_list_class() {
+    cout << "\n========== Running test_shape_list_class() ==========" << endl;
+
+    int passed = 0, failed = 0;
+
+    // Test 1: Add, size, area and perimeter by position
+    ShapeList eager;
+    eager.createShape<Rectangle>(Coordinates(10, 20), 5, 10);
+    eager.createShape<Circle>(Coordinates(3, 3), 2.0);
+    eager.createShape<Triangle>(Coordinates(2, 0), Coordinates(6, 0), Coordinates(2, 3));
+    if (eager.size() == 3 && fabs(eager.area(0) - 50.0) < 0.001 &&
+        fabs(eager.perimeter(2) - 12.0) < 0.001 && eager.area(3) < 0) {
+        cout << "Test 1 passed: Add and query shapes" << endl;
+        passed++;
+    } else {
+        cout << "Test 1 FAILED: Add and query shapes" << endl;
+        failed++;
+    }
+
+    // Test 2: Deferred transforms give the same result as eager ones, including
+    // skipped translations, integer division and shapes added mid-way
+    ShapeList lazy;
+    lazy.setDeferredTransforms(true);
+    lazy.createShape<Rectangle>(Coordinates(10, 20), 5, 10);
+    lazy.createShape<Circle>(Coordinates(3, 3), 2.0);
+    lazy.createShape<Triangle>(Coordinates(2, 0), Coordinates(6, 0), Coordinates(2, 3));
+    eager.translateShapes(-5, 1);
+    lazy.translateShapes(-5, 1);
+    eager.translateShapes(9, 2);
+    lazy.translateShapes(9, 2);
+    eager.scale(3, false);
+    lazy.scale(3, false);
+    eager.createShape<Square>(Coordinates(7, 7), 4.0);
+    lazy.createShape<Square>(Coordinates(7, 7), 4.0);
+    eager.translateShapes(1, 1);
+    lazy.translateShapes(1, 1);
+    bool sameArea = fabs(lazy.area(2) - eager.area(2)) < 0.001;  // Reads one shape mid-way
+    eager.translateShapes(-2, 0);
+    lazy.translateShapes(-2, 0);
+    eager.scale(2, true);
+    lazy.scale(2, true);
+    if (sameArea && lazy.display() == eager.display()) {
+        cout << "Test 2 passed: Deferred transforms match eager ones" << endl;
+        passed++;
+    } else {
+        cout << "Test 2 FAILED: Deferred transforms differ from eager ones" << endl;
+        failed++;
+    }
+
+    // Test 3: Removing a shape applies its pending transforms first
+    eager.translateShapes(4, 4);
+    lazy.translateShapes(4, 4);
+    Shape* a = eager.removeShape(1);
+    Shape* b = lazy.removeShape(1);
+    lazy.setDeferredTransforms(false);
+    if (a != nullptr && b != nullptr && a->display() == b->display() && lazy.display() == eager.display()) {
+        cout << "Test 3 passed: Remove with pending transforms" << endl;
+        passed++;
+    } else {
+        cout << "Test 3 FAILED: Remove with pending transforms" << endl;
+        failed++;
+    }
+    delete a;
+    delete b;
+
+    // Test 4: Range display keeps the global numbering and matches the full display
+    ostringstream range;
+    eager.display(range, 1, 2);
+    string full = eager.display();
+    string second = full.substr(full.find("Shape 2: "), full.find("Shape 3: ") - full.find("Shape 2: "));
+    if (range.str() == "--- Shape List ---\n\n" + second) {
+        cout << "Test 4 passed: Range display" << endl;
+        passed++;
+    } else {
+        cout << "Test 4 FAILED: Range display" << endl;
+        failed++;
+    }
+
+    // Test 5: Packed boxes stay equal to the shapes' boxes through every change
+    ShapeList packed;
+    packed.createShape<Rectangle>(Coordinates(4, 4), 2.5, 3.0);
+    packed.createShape<Circle>(Coordinates(10, 10), 3.0);
+    packed.createShape<Triangle>(Coordinates(1, 8), Coordinates(6, 2), Coordinates(9, 9));
+    packed.createShape<Square>(Coordinates(20, 0), 4.0);
+    auto boxesMatch = [&packed]() {
+        const vector<BoundingBox>& boxes = packed.boundingBoxes();
+        bool same = static_cast<int>(boxes.size()) == packed.size();
+        for (int i = 0; same && i < packed.size(); ++i) {
+            BoundingBox b = packed.getShape(i)->getBoundingBox();
+            same = b.minX == boxes[i].minX && b.minY == boxes[i].minY && b.maxX == boxes[i].maxX && b.maxY == boxes[i].maxY;
+        }
+        return same;
+    };
+    bool allMatch = boxesMatch();
+    packed.translateShapes(3, 2);
+    allMatch = allMatch && boxesMatch();
+    packed.scale(2, true);
+    allMatch = allMatch && boxesMatch();
+    packed.translateShapes(-5, 0);  // Skipped for some shapes
+    allMatch = allMatch && boxesMatch();
+    packed.scale(3, false);
+    delete packed.removeShape(1);
+    allMatch = allMatch && boxesMatch();
+    packed.setDeferredTransforms(true);
+    packed.translateShapes(1, 1);
+    packed.createShape<Circle>(Coordinates(30, 30), 1.5);
+    allMatch = allMatch && boxesMatch() && packed.boundingBoxes()[3].minX == 28.5;
+    if (allMatch) {
+        cout << "Test 5 passed: Packed bounding boxes" << endl;
+        passed++;
+    } else {
+        cout << "Test 5 FAILED: Packed bounding boxes" << endl;
+        failed++;
+    }
+
+    // Test 6: A shape added between two deferred translations receives the second one
+    ShapeList eagerAdd, lazyAdd;
+    lazyAdd.setDeferredTransforms(true);
+    eagerAdd.createShape<Square>(Coordinates(10, 10), 2.0);
+    lazyAdd.createShape<Square>(Coordinates(10, 10), 2.0);
+    eagerAdd.translateShapes(5, 5);
+    lazyAdd.translateShapes(5, 5);
+    eagerAdd.createShape<Circle>(Coordinates(0, 0), 1.0);
+    lazyAdd.createShape<Circle>(Coordinates(0, 0), 1.0);
+    eagerAdd.translateShapes(3, 3);
+    lazyAdd.translateShapes(3, 3);
+    lazyAdd.flush();
+    if (lazyAdd.display() == eagerAdd.display() && lazyAdd.getShape(1)->getCoordinates().getX() == 3) {
+        cout << "Test 6 passed: Shape added between deferred translations" << endl;
+        passed++;
+    } else {
+        cout << "Test 6 FAILED: Shape added between deferred translations" << endl;
+        failed++;
+    }
+
+    // Summary
+    cout << "========== Test Summary ==========" << endl;
+    cout << "Passed: " << passed << ", Failed: " << failed << endl;
+    cout << "==================================\n" << endl;
+}
+
+
+// ==============================
+// Test function for the spatial indexes
+// ==============================
+void test_spatial_index_class() {
+    cout << "\n========== Running test_spatial_index_class() ==========" << endl;
+
+    int passed = 0, failed = 0;
+
+    // Pseudo-random boxes of mixed sizes, including a few huge ones
+    vector<BoundingBox> boxes;
+    unsigned seed = 12345;
+    auto next = [&seed](int range) { seed = seed * 1103515245u + 12345u; return static_cast<int>((seed >> 8) % range); };
+    for (int i = 0; i < 3000; ++i) {
+        double x = next(5000), y = next(5000);
+        double size = (i % 500 == 0) ? 4000 : next(80) + 1;
+        boxes.push_back(BoundingBox{x, y, x + size, y + next(60) + 1});
+    }
+    vector<BoundingBox> queries;
+    for (int i = 0; i < 200; ++i) {
+        double x = next(5000), y = next(5000);
+        queries.push_back(BoundingBox{x, y, x + next(400), y + next(400)});
+    }
+
+    // Test 1 and 2: Grid and R-tree agree with a brute-force scan
+    UniformGridIndex grid(50.0);
+    RTreeIndex tree;
+    grid.build(boxes);
+    tree.build(boxes);
+    bool gridOk = true, treeOk = true;
+    for (const BoundingBox& q : queries) {
+        vector<int> expected, fromGrid, fromTree;
+        for (size_t i = 0; i < boxes.size(); ++i) {
+            if (boxes[i].overlaps(q)) expected.push_back(static_cast<int>(i));
+        }
+        grid.query(q, fromGrid);
+        tree.query(q, fromTree);
+        sort(fromGrid.begin(), fromGrid.end());
+        sort(fromTree.begin(), fromTree.end());
+        gridOk = gridOk && fromGrid == expected;
+        treeOk = treeOk && fromTree == expected;
+    }
+    if (gridOk) {
+        cout << "Test 1 passed: Uniform grid range queries" << endl;
+        passed++;
+    } else {
+        cout << "Test 1 FAILED: Uniform grid range queries" << endl;
+        failed++;
+    }
+    if (treeOk) {
+        cout << "Test 2 passed: R-tree range queries" << endl;
+        passed++;
+    } else {
+        cout << "Test 2 FAILED: R-tree range queries" << endl;
+        failed++;
+    }
+
+    // Test 3: ShapeList keeps both indexes in sync with add, remove, translate and scale
+    bool synced = true;
+    for (SpatialIndexKind kind : {SpatialIndexKind::UniformGrid, SpatialIndexKind::RTree}) {
+        ShapeList list;
+        list.enableSpatialIndex(kind, 10.0);
+        list.createShape<Rectangle>(Coordinates(0, 0), 5, 5);
+        list.createShape<Circle>(Coordinates(50, 50), 5.0);
+        synced = synced && list.queryPoint(3, 3) == vector<int>{0};
+        list.createShape<Square>(Coordinates(2, 2), 2.0);
+        synced = synced && list.queryPoint(3, 3) == vector<int>{0, 2};
+        delete list.removeShape(0);
+        synced = synced && list.queryPoint(3, 3) == vector<int>{1};
+        list.translateShapes(10, 0);
+        synced = synced && list.queryPoint(3, 3).empty() && list.queryPoint(13, 3) == vector<int>{1};
+        list.scale(2, true);
+        synced = synced && list.queryRange(115, 95, 125, 105) == vector<int>{0};
+    }
+    if (synced) {
+        cout << "Test 3 passed: ShapeList index stays in sync" << endl;
+        passed++;
+    } else {
+        cout << "Test 3 FAILED: ShapeList index out of sync" << endl;
+        failed++;
+    }
+
+    // Test 4: Erasing and transforming in place matches a brute-force scan of the same boxes
+    vector<BoundingBox> moved = boxes;
+    for (int id : {2999, 1500, 0, 700}) {
+        grid.erase(id);
+        tree.erase(id);
+        moved.erase(moved.begin() + id);
+    }
+    const double transforms[2][3] = {{1.0, 7.0, 3.0}, {3.0, 0.0, 0.0}};  // factor, dx, dy
+    for (const auto& t : transforms) {
+        grid.transform(t[0], t[1], t[2]);
+        tree.transform(t[0], t[1], t[2]);
+        for (BoundingBox& b : moved) {
+            b = BoundingBox{b.minX * t[0] + t[1], b.minY * t[0] + t[2], b.maxX * t[0] + t[1], b.maxY * t[0] + t[2]};
+        }
+    }
+    BoundingBox added{100.5, 100.5, 130.25, 140.0};
+    grid.insert(static_cast<int>(moved.size()), added);
+    tree.insert(static_cast<int>(moved.size()), added);
+    moved.push_back(added);
+    bool inPlace = tree.overflowSize() == 1;
+    for (const BoundingBox& q : queries) {
+        BoundingBox scaled{q.minX * 3, q.minY * 3, q.maxX * 3, q.maxY * 3};
+        vector<int> expected, fromGrid, fromTree;
+        for (size_t i = 0; i < moved.size(); ++i) {
+            if (moved[i].overlaps(scaled)) expected.push_back(static_cast<int>(i));
+        }
+        grid.query(scaled, fromGrid);
+        tree.query(scaled, fromTree);
+        sort(fromGrid.begin(), fromGrid.end());
+        sort(fromTree.begin(), fromTree.end());
+        inPlace = inPlace && fromGrid == expected && fromTree == expected;
+    }
+    if (inPlace) {
+        cout << "Test 4 passed: Erase and transform in place" << endl;
+        passed++;
+    } else {
+        cout << "Test 4 FAILED: Erase and transform in place" << endl;
+        failed++;
+    }
+
+    // Test 5: Edits interleaved with queries give the same answers as an unindexed list
+    bool interleaved = true;
+    for (SpatialIndexKind kind : {SpatialIndexKind::UniformGrid, SpatialIndexKind::RTree}) {
+        ShapeList indexed, plain;
+        indexed.enableSpatialIndex(kind, 25.0);
+        for (int step = 0; step < 600 && interleaved; ++step) {
+            int op = next(10);
+            if (op < 5 || plain.size() < 5) {
+                int x = next(500) + 20, y = next(500) + 20, size = next(30) + 1;
+                if (op % 2 == 0) {
+                    indexed.createShape<Circle>(Coordinates(x, y), size);
+                    plain.createShape<Circle>(Coordinates(x, y), size);
+                } else {
+                    indexed.createShape<Triangle>(Coordinates(x, y), Coordinates(x + size, y), Coordinates(x, y + size));
+                    plain.createShape<Triangle>(Coordinates(x, y), Coordinates(x + size, y), Coordinates(x, y + size));
+                }
+            } else if (op < 7) {
+                int pos = next(plain.size());
+                delete indexed.removeShape(pos);
+                delete plain.removeShape(pos);
+            } else if (op < 9) {
+                int dx = next(7) - 3, dy = next(7) - 3;
+                indexed.translateShapes(dx, dy);
+                plain.translateShapes(dx, dy);
+            } else if (step % 50 == 9) {
+                indexed.scale(2, true);
+                plain.scale(2, true);
+            }
+            double qx = next(1200), qy = next(1200), qw = next(200), qh = next(200);
+            interleaved = indexed.queryRange(qx, qy, qx + qw, qy + qh) == plain.queryRange(qx, qy, qx + qw, qy + qh);
+        }
+    }
+    if (interleaved) {
+        cout << "Test 5 passed: Interleaved edits and queries" << endl;
+        passed++;
+    } else {
+        cout << "Test 5 FAILED: Interleaved edits and queries" << endl;
+        failed++;
+    }
+
+    // Summary
+    cout << "========== Test Summary ==========" << endl;
+    cout << "Passed: " << passed << ", Failed: " << failed << endl;
+    cout << "==================================\n" << endl;
+}
+
+// ==============================
+// Test function for WorkStealingPool class
+// ==============================
+void test_work_stealing_pool_class() {
+    cout << "\n========== Running test_work_stealing_pool_class() ==========" << endl;
+
+    int passed = 0, failed = 0;
+
+    // Test 1: Every index is visited exactly once
+    WorkStealingPool pool(4);
+    vector<int> visits(10000, 0);
+    pool.parallelFor(visits.size(), 64, [&visits](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) visits[i]++;
+    });
+    bool once = true;
+    for (int v : visits) once = once && v == 1;
+    if (pool.getThreadCount() == 4 && once) {
+        cout << "Test 1 passed: parallelFor covers the range once" << endl;
+        passed++;
+    } else {
+        cout << "Test 1 FAILED: parallelFor coverage" << endl;
+        failed++;
+    }
+
+    // Test 2: The pool is reusable and handles ranges smaller than one chunk
+    atomic<long> sum(0);
+    for (int round = 0; round < 20; ++round) {
+        pool.parallelFor(100, 7, [&sum](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) sum += static_cast<long>(i);
+        });
+    }
+    pool.parallelFor(3, 64, [&sum](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) sum += 1;
+    });
+    if (sum.load() == 20 * 4950 + 3) {
+        cout << "Test 2 passed: Pool reused across calls" << endl;
+        passed++;
+    } else {
+        cout << "Test 2 FAILED: Pool reuse" << endl;
+        failed++;
+    }
+
+    // Test 3: Parallel ShapeList transforms match the serial path, including skipped translations
+    ShapeList serial, parallel;
+    parallel.setParallelExecution(3, 16);
+    for (int i = 0; i < 200; ++i) {
+        serial.addShape(new Rectangle(Coordinates(i, 2 * i), 1 + i % 5, 2 + i % 3));
+        parallel.addShape(new Rectangle(Coordinates(i, 2 * i), 1 + i % 5, 2 + i % 3));
+        serial.addShape(new Triangle(Coordinates(i, 0), Coordinates(i + 4, 9), Coordinates(3, i)));
+        parallel.addShape(new Triangle(Coordinates(i, 0), Coordinates(i + 4, 9), Coordinates(3, i)));
+    }
+    serial.translateShapes(-2, 1);
+    parallel.translateShapes(-2, 1);
+    serial.scale(3, true);
+    parallel.scale(3, true);
+    serial.scale(2, false);
+    parallel.scale(2, false);
+    if (serial.display() == parallel.display()) {
+        cout << "Test 3 passed: Parallel transforms match serial" << endl;
+        passed++;
+    } else {
+        cout << "Test 3 FAILED: Parallel transforms differ from serial" << endl;
+        failed++;
+    }
+
+    // Summary
+    cout << "========== Test Summary ==========" << endl;
+    cout << "Passed: " << passed << ", Failed: " << failed << endl;
+    cout << "==================================\n" << endl;
+}
+
+// ==============================
+// Test function for ShapeArena class
+// ==============================
+void test_shape_arena_class() {
+    cout << "\n========== Running test_shape_arena_class() ==========" << endl;
+
+    int passed = 0, failed = 0;
+
+    // Test 1: Shapes of one type are packed next to each other
+    ShapeArena arena;
+    Circle* c1 = arena.create<Circle>(Coordinates(1, 1), 2.0);
+    Circle* c2 = arena.create<Circle>(Coordinates(2, 2), 3.0);
+    Rectangle* r1 = arena.create<Rectangle>(Coordinates(3, 3), 4, 5);
+    if (c2 == c1 + 1 && arena.owns(c1) && arena.owns(r1) && fabs(r1->getArea() - 20.0) < 0.001) {
+        cout << "Test 1 passed: Contiguous construction" << endl;
+        passed++;
+    } else {
+        cout << "Test 1 FAILED: Contiguous construction" << endl;
+        failed++;
+    }
+
+    // Test 2: Destroyed slots are reused and heap shapes are not owned
+    arena.destroy(c1);
+    Circle* c3 = arena.create<Circle>(Coordinates(4, 4), 1.0);
+    Circle heapless(Coordinates(0, 0), 1.0);
+    if (c3 == c1 && !arena.owns(&heapless)) {
+        cout << "Test 2 passed: Slot reuse and ownership" << endl;
+        passed++;
+    } else {
+        cout << "Test 2 FAILED: Slot reuse and ownership" << endl;
+        failed++;
+    }
+
+    // Test 3: ShapeList hands back removed arena shapes as deletable copies
+    ShapeList list;
+    list.createShape<Square>(Coordinates(5, 5), 3.0);
+    list.addShape(new Rectangle(Coordinates(6, 6), 2, 3));
+    for (int i = 0; i < 500; ++i) {
+        list.createShape<Triangle>(Coordinates(i, 0), Coordinates(i + 3, 0), Coordinates(i, 4));
+    }
+    Shape* square = list.removeShape(0);
+    Shape* rectangle = list.removeShape(0);
+    if (square != nullptr && rectangle != nullptr && list.size() == 500 &&
+        square->getKind() == ShapeKind::Square && fabs(square->getArea() - 9.0) < 0.001 &&
+        fabs(list.area(499) - 6.0) < 0.001) {
+        cout << "Test 3 passed: Remove from arena-backed list" << endl;
+        passed++;
+    } else {
+        cout << "Test 3 FAILED: Remove from arena-backed list" << endl;
+        failed++;
+    }
+    delete square;
+    delete rectangle;
+
+    // Summary
+    cout << "========== Test Summary ==========" << endl;
+    cout << "Passed: " << passed << ", Failed: " << failed << endl;
+    cout << "==================================\n" << endl;
+}
+
+
+// ==============================
+// Test function for ShapeListStats class
+// ==============================
+void test_shape_list_stats_class() {
+    cout << "\n========== Running test_shape_list_stats_class() ==========" << endl;
+
+    int passed = 0, failed = 0;
+
+    // Test 1: Histogram buckets stay within 12.5% and percentiles follow the data
+    LatencyHistogram histogram;
+    bool bounded = true;
+    for (uint64_t v : {uint64_t(0), uint64_t(7), uint64_t(8), uint64_t(1000), uint64_t(123456789), ~uint64_t(0)}) {
+        uint64_t high = LatencyHistogram::highestIn(LatencyHistogram::bucketOf(v));
+        bounded = bounded && high >= v && static_cast<double>(high - v) <= static_cast<double>(v) * 0.125 &&
+                  LatencyHistogram::bucketOf(v) < LatencyHistogram::BUCKETS;
+    }
+    for (uint64_t v = 1; v <= 1000; ++v) {
+        histogram.record(v);
+    }
+    uint64_t p50 = histogram.percentile(50.0);
+    if (bounded && histogram.count() == 1000 && p50 >= 500 && p50 <= 563 &&
+        histogram.percentile(100.0) == 1000 && histogram.maxValue() == 1000) {
+        cout << "Test 1 passed: Histogram precision" << endl;
+        passed++;
+    } else {
+        cout << "Test 1 FAILED: Histogram precision" << endl;
+        failed++;
+    }
+
+    // Test 2: Stats are off by default and count only outermost calls when on
+    ShapeList list;
+    bool offByDefault = list.getStats() == nullptr;
+    list.enableStats(true);
+    list.createShape<Rectangle>(Coordinates(10, 20), 5, 10);
+    list.createShape<Circle>(Coordinates(5, 5), 1.0);
+    list.area(0);
+    list.area(1);
+    list.translateShapes(1, 1);
+    list.display();
+    const ShapeListStats* stats = list.getStats();
+    if (offByDefault && stats != nullptr && stats->calls(ShapeOperation::AddShape) == 2 &&
+        stats->calls(ShapeOperation::Area) == 2 && stats->calls(ShapeOperation::GetShape) == 0 &&
+        stats->shapes(ShapeOperation::TranslateShapes) == 2 && stats->calls(ShapeOperation::Display) == 1 &&
+        stats->latency(ShapeOperation::Area).count() == 2) {
+        cout << "Test 2 passed: Operation counters" << endl;
+        passed++;
+    } else {
+        cout << "Test 2 FAILED: Operation counters" << endl;
+        failed++;
+    }
+
+    // Test 3: Text and JSON snapshots list the recorded operations
+    string text, json;
+    {
+        ShapeWriter textOut(text);
+        stats->write(textOut);
+        ShapeWriter jsonOut(json);
+        stats->writeJson(jsonOut);
+    }
+    if (text.find("area: 2 calls, 2 shapes") != string::npos &&
+        json.find("{\"name\": \"translateShapes\", \"calls\": 1, \"shapes\": 2") != string::npos &&
+        json.find("getShape") == string::npos) {
+        cout << "Test 3 passed: Stats snapshots" << endl;
+        passed++;
+    } else {
+        cout << "Test 3 FAILED: Stats snapshots" << endl;
+        failed++;
+    }
+
+    // Test 4: A rejected null shape is a call without shapes
+    list.addShape(nullptr);
+    if (stats->calls(ShapeOperation::AddShape) == 3 && stats->shapes(ShapeOperation::AddShape) == 2) {
+        cout << "Test 4 passed: Null shape not counted" << endl;
+        passed++;
+    } else {
+        cout << "Test 4 FAILED: Null shape not counted" << endl;
+        failed++;
+    }
+
+    // Summary
+    cout << "========== Test Summary ==========" << endl;
+    cout << "Passed: " << passed << ", Failed: " << failed << endl;
+    cout << "==================================\n" << endl;
+}
+
+
+// ==============================
+// Test function for SceneAggregates class
+// ==============================
+void test_scene_aggregates_class() {
+    cout << "\n========== Running test_scene_aggregates_class() ==========" << endl;
+
+    int passed = 0, failed = 0;
+
+    // Compare the running totals with a full pass over the list
+    auto matches = [](ShapeList& list) {
+        const SceneAggregates& totals = list.aggregates();
+        double area = 0.0, perimeter = 0.0;
+        BoundingBox bounds{0.0, 0.0, 0.0, 0.0};
+        for (int i = 0; i < list.size(); ++i) {
+            Shape* s = list.getShape(i);
+            area += s->getArea();
+            perimeter += s->getPerimeter();
+            bounds = i == 0 ? s->getBoundingBox() : bounds.merge(s->getBoundingBox());
+        }
+        return static_cast<int>(totals.count) == list.size() &&
+               fabs(totals.totalArea() - area) <= 1e-9 * max(1.0, area) &&
+               fabs(totals.totalPerimeter() - perimeter) <= 1e-9 * max(1.0, perimeter) &&
+               bounds.minX == totals.bounds.minX && bounds.minY == totals.bounds.minY &&
+               bounds.maxX == totals.bounds.maxX && bounds.maxY == totals.bounds.maxY;
+    };
+
+    // Test 1: Adding shapes updates counts, sums, means and the scene box
+    ShapeList list;
+    list.createShape<Rectangle>(Coordinates(10, 20), 5, 10);
+    list.createShape<Square>(Coordinates(1, 1), 3.0);
+    list.createShape<Circle>(Coordinates(30, 30), 2.0);
+    list.createShape<Triangle>(Coordinates(0, 0), Coordinates(4, 0), Coordinates(0, 3));
+    const SceneAggregates& totals = list.aggregates();
+    if (totals.count == 4 && totals.countOf(ShapeKind::Circle) == 1 &&
+        fabs(totals.totalArea() - (50.0 + 9.0 + M_PI * 4.0 + 6.0)) < 1e-9 &&
+        fabs(totals.meanPerimeter() - (30.0 + 12.0 + 4.0 * M_PI + 12.0) / 4.0) < 1e-9 &&
+        totals.bounds.maxX == 32.0 && totals.bounds.maxY == 32.0 && matches(list)) {
+        cout << "Test 1 passed: Totals on add" << endl;
+        passed++;
+    } else {
+        cout << "Test 1 FAILED: Totals on add" << endl;
+        failed++;
+    }
+
+    // Test 2: Multiplying scales the totals analytically, dividing and clamped
+    // translations rescan only what changed
+    list.scale(3, true);
+    bool multiplied = fabs(list.aggregates().totalArea() - 9.0 * (65.0 + M_PI * 4.0)) < 1e-9 && matches(list);
+    list.scale(2, false);
+    bool divided = matches(list);
+    list.translateShapes(-2, 5);  // The triangle's first vertex is clamped
+    if (multiplied && divided && matches(list)) {
+        cout << "Test 2 passed: Totals on scale and translate" << endl;
+        passed++;
+    } else {
+        cout << "Test 2 FAILED: Totals on scale and translate" << endl;
+        failed++;
+    }
+
+    // Test 3: Removing shapes, including the last of a type, and deferred transforms
+    delete list.removeShape(2);
+    bool removed = list.aggregates().countOf(ShapeKind::Circle) == 0 && matches(list);
+    list.setDeferredTransforms(true);
+    list.translateShapes(4, 4);
+    list.scale(2, true);
+    list.createShape<Circle>(Coordinates(1, 1), 1.0);
+    delete list.removeShape(0);
+    if (removed && matches(list)) {
+        cout << "Test 3 passed: Totals on remove and deferred transforms" << endl;
+        passed++;
+    } else {
+        cout << "Test 3 FAILED: Totals on remove and deferred transforms" << endl;
+        failed++;
+    }
+
+    // Summary
+    cout << "========== Test Summary ==========" << endl;
+    cout << "Passed: " << passed << ", Failed: " << failed << endl;
+    cout << "==================================\n" << endl;
+}
+
+
+// ==============================
+// Test function for MetricIndex class
+// ==============================
+void test_metric_index_class() {
+    cout << "\n========== Running test_metric_index_class() ==========" << endl;
+
+    int passed = 0, failed = 0;
+
+    // Two lists with the same shapes, one answering through the index and one by scanning
+    ShapeList indexed, scanned;
+    indexed.enableMetricIndex(true);
+    unsigned seed = 7;
+    auto next = [&seed](int range) {
+        seed = seed * 1103515245u + 12345u;
+        return static_cast<int>((seed >> 8) % static_cast<unsigned>(range));
+    };
+    auto addBoth = [&](int i) {
+        int x = next(200), y = next(200), a = 1 + next(40), b = 1 + next(40);
+        switch (i % 4) {
+            case 0:
+                indexed.createShape<Rectangle>(Coordinates(x, y), a, b);
+                scanned.createShape<Rectangle>(Coordinates(x, y), a, b);
+                break;
+            case 1:
+                indexed.createShape<Square>(Coordinates(x, y), a);
+                scanned.createShape<Square>(Coordinates(x, y), a);
+                break;
+            case 2:
+                indexed.createShape<Circle>(Coordinates(x, y), a);
+                scanned.createShape<Circle>(Coordinates(x, y), a);
+                break;
+            default:
+                indexed.createShape<Triangle>(Coordinates(x, y), Coordinates(x + a, y), Coordinates(x, y + b));
+                scanned.createShape<Triangle>(Coordinates(x, y), Coordinates(x + a, y), Coordinates(x, y + b));
+                break;
+        }
+    };
+    // Compare two answers by the metric values of the positions they name
+    auto sameValues = [](ShapeList& a, const vector<int>& pa, ShapeList& b, const vector<int>& pb, bool sorted) {
+        if (pa.size() != pb.size()) {
+            return false;
+        }
+        vector<double> va, vb;
+        for (int p : pa) va.push_back(a.area(p));
+        for (int p : pb) vb.push_back(b.area(p));
+        if (sorted) {
+            sort(va.begin(), va.end());
+            sort(vb.begin(), vb.end());
+        }
+        for (size_t i = 0; i < va.size(); ++i) {
+            if (fabs(va[i] - vb[i]) > 1e-6 * max(1.0, va[i])) {
+                return false;
+            }
+        }
+        return true;
+    };
+    auto agree = [&]() {
+        bool ok = true;
+        ok = ok && sameValues(indexed, indexed.queryMetricRange(ShapeMetric::Area, 100.25, 900.25),
+                              scanned, scanned.queryMetricRange(ShapeMetric::Area, 100.25, 900.25), true);
+        ok = ok && sameValues(indexed, indexed.topShapes(ShapeMetric::Area, 25),
+                              scanned, scanned.topShapes(ShapeMetric::Area, 25), false);
+        ok = ok && sameValues(indexed, indexed.topShapes(ShapeMetric::Area, 10, false),
+                              scanned, scanned.topShapes(ShapeMetric::Area, 10, false), false);
+        for (double p : {1.0, 50.0, 90.0, 100.0}) {
+            double a = indexed.metricPercentile(ShapeMetric::Perimeter, p);
+            double b = scanned.metricPercentile(ShapeMetric::Perimeter, p);
+            ok = ok && fabs(a - b) <= 1e-6 * max(1.0, b);
+        }
+        return ok;
+    };
+
+    // Test 1: Queries match a full scan after inserts beyond the delta buffer
+    for (int i = 0; i < 1500; ++i) {
+        addBoth(i);
+    }
+    vector<int> largest = indexed.topShapes(ShapeMetric::Area, 3);
+    if (agree() && largest.size() == 3 && indexed.area(largest[0]) >= indexed.area(largest[1]) &&
+        indexed.area(largest[1]) >= indexed.area(largest[2])) {
+        cout << "Test 1 passed: Range, top-k and percentile" << endl;
+        passed++;
+    } else {
+        cout << "Test 1 FAILED: Range, top-k and percentile" << endl;
+        failed++;
+    }
+
+    // Test 2: The index follows scaling, including truncating triangle division
+    indexed.scale(3, true);
+    scanned.scale(3, true);
+    bool multiplied = agree();
+    indexed.scale(2, false);
+    scanned.scale(2, false);
+    if (multiplied && agree()) {
+        cout << "Test 2 passed: Scale keeps the index consistent" << endl;
+        passed++;
+    } else {
+        cout << "Test 2 FAILED: Scale" << endl;
+        failed++;
+    }
+
+    // Test 3: Removals, further inserts and clamped translations
+    for (int i = 0; i < 200; ++i) {
+        int pos = next(indexed.size());
+        delete indexed.removeShape(pos);
+        delete scanned.removeShape(pos);
+    }
+    for (int i = 0; i < 300; ++i) {
+        addBoth(i);
+    }
+    indexed.setDiagnosticsMode(true);
+    scanned.setDiagnosticsMode(true);
+    indexed.translateShapes(-50, -50);
+    scanned.translateShapes(-50, -50);
+    if (agree() && indexed.metricPercentile(ShapeMetric::Area, 0.0) >= 0.0 && ShapeList().metricPercentile(ShapeMetric::Area, 50.0) < 0.0) {
+        cout << "Test 3 passed: Removal and translation" << endl;
+        passed++;
+    } else {
+        cout << "Test 3 FAILED: Removal and translation" << endl;
+        failed++;
+    }
+
+    // Summary
+    cout << "========== Test Summary ==========" << endl;
+    cout << "Passed: " << passed << ", Failed: " << failed << endl;
+    cout << "==================================\n" << endl;
+}
+
+
+// ==============================
+// Test function for OverlapDetector class
+// ==============================
+void test_overlap_detector_class() {
+    cout << "\n========== Running test_overlap_detector_class() ==========" << endl;
+
+    int passed = 0, failed = 0;
+
+    // Test 1: Exact tests for each pair of types
+    typedef OverlapDetector::Geometry Geometry;
+    Rectangle rect(Coordinates(0, 0), 10, 10);
+    Circle nearCorner(Coordinates(13, 13), 4.0);     // Box overlaps, corner is 4.24 away
+    Circle touching(Coordinates(13, 5), 3.0);
+    Circle farCircle(Coordinates(21, 5), 5.0);       // Touches `touching`
+    Triangle diagonal(Coordinates(12, 0), Coordinates(20, 0), Coordinates(12, 8));
+    Triangle inside(Coordinates(2, 2), Coordinates(6, 2), Coordinates(2, 6));
+    Triangle beyond(Coordinates(11, 20), Coordinates(30, 1), Coordinates(30, 20));
+    Geometry g[7] = {OverlapDetector::geometryOf(&rect), OverlapDetector::geometryOf(&nearCorner),
+                     OverlapDetector::geometryOf(&touching), OverlapDetector::geometryOf(&farCircle),
+                     OverlapDetector::geometryOf(&diagonal), OverlapDetector::geometryOf(&inside),
+                     OverlapDetector::geometryOf(&beyond)};
+    if (!OverlapDetector::overlaps(g[0], g[1]) && OverlapDetector::overlaps(g[0], g[2]) &&
+        OverlapDetector::overlaps(g[2], g[3]) && !OverlapDetector::overlaps(g[0], g[4]) &&
+        OverlapDetector::overlaps(g[0], g[5]) && OverlapDetector::overlaps(g[2], g[4]) &&
+        !OverlapDetector::overlaps(g[4], g[6]) && OverlapDetector::overlaps(g[1], g[6]) &&
+        !OverlapDetector::overlaps(g[2], g[6]) &&
+        OverlapDetector::overlaps(g[3], g[6])) {
+        cout << "Test 1 passed: Narrow phase" << endl;
+        passed++;
+    } else {
+        cout << "Test 1 FAILED: Narrow phase" << endl;
+        failed++;
+    }
+
+    // Test 2: Sweep and prune finds the same pairs as testing every pair, serially and in parallel
+    ShapeList scene;
+    unsigned seed = 11;
+    auto next = [&seed](int range) {
+        seed = seed * 1103515245u + 12345u;
+        return static_cast<int>((seed >> 8) % static_cast<unsigned>(range));
+    };
+    for (int i = 0; i < 1200; ++i) {
+        int x = next(1000), y = next(300), a = 1 + next(25), b = 1 + next(25);
+        switch (i % 4) {
+            case 0: scene.createShape<Rectangle>(Coordinates(x, y), a, b); break;
+            case 1: scene.createShape<Square>(Coordinates(x, y), a); break;
+            case 2: scene.createShape<Circle>(Coordinates(x, y), a); break;
+            default: scene.createShape<Triangle>(Coordinates(x, y), Coordinates(x + a, y + b), Coordinates(x, y + b)); break;
+        }
+    }
+    vector<pair<int, int>> expected;
+    for (int i = 0; i < scene.size(); ++i) {
+        Geometry gi = OverlapDetector::geometryOf(scene.getShape(i));
+        for (int j = i + 1; j < scene.size(); ++j) {
+            if (OverlapDetector::overlaps(gi, OverlapDetector::geometryOf(scene.getShape(j)))) {
+                expected.push_back(make_pair(i, j));
+            }
+        }
+    }
+    vector<pair<int, int>> serial, parallel;
+    size_t serialCount = scene.findOverlaps([&serial](int i, int j) { serial.push_back(make_pair(i, j)); });
+    scene.setParallelExecution(3, 64);
+    scene.findOverlaps([&parallel](int i, int j) { parallel.push_back(make_pair(i, j)); });
+    sort(serial.begin(), serial.end());
+    sort(parallel.begin(), parallel.end());
+    if (!expected.empty() && serial == expected && parallel == expected && serialCount == expected.size()) {
+        cout << "Test 2 passed: Broad phase matches all-pairs" << endl;
+        passed++;
+    } else {
+        cout << "Test 2 FAILED: Broad phase" << endl;
+        failed++;
+    }
+
+    // Summary
+    cout << "========== Test Summary ==========" << endl;
+    cout << "Passed: " << passed << ", Failed: " << failed << endl;
+    cout << "==================================\n" << endl;
+}
+
+
+// ==============================
+// Test function for HitTester class
+// ==============================
+void test_hit_tester_class() {
+    cout << "\n========== Running test_hit_tester_class() ==========" << endl;
+
+    int passed = 0, failed = 0;
+
+    // Test 1: Exact tests for each type, edges inclusive
+    ShapeList list;
+    list.createShape<Rectangle>(Coordinates(0, 0), 10, 4);
+    list.createShape<Circle>(Coordinates(20, 20), 5.0);
+    list.createShape<Triangle>(Coordinates(0, 10), Coordinates(10, 10), Coordinates(0, 20));
+    list.createShape<Square>(Coordinates(5, 2), 6.0);
+    vector<double> xs = {5, 24, 24, 5, 8, 10, 0, 100};
+    vector<double> ys = {3, 20, 24, 15, 18, 0, 10, 100};
+    HitResults hits;
+    list.hitTest(xs, ys, hits);
+    // (5, 3): rectangle and square; (24, 24): in the circle's box only;
+    // (5, 15): on the triangle's hypotenuse; (8, 18): beyond it
+    if (hits.hitCount(0) == 2 && hits.hits(0)[0] == 0 && hits.hits(0)[1] == 3 &&
+        hits.hitCount(1) == 1 && hits.hits(1)[0] == 1 && hits.hitCount(2) == 0 &&
+        hits.hitCount(3) == 1 && hits.hits(3)[0] == 2 && hits.hitCount(4) == 0 &&
+        hits.hitCount(5) == 1 && hits.hitCount(6) == 1 && hits.hitCount(7) == 0 &&
+        list.shapesAt(20, 16) == vector<int>(1, 1)) {
+        cout << "Test 1 passed: Per-type containment" << endl;
+        passed++;
+    } else {
+        cout << "Test 1 FAILED: Per-type containment" << endl;
+        failed++;
+    }
+
+    // Test 2: Batch results match a scan of every shape, including one shape
+    // covering the whole scene and after a transform
+    ShapeList scene;
+    unsigned seed = 29;
+    auto next = [&seed](int range) {
+        seed = seed * 1103515245u + 12345u;
+        return static_cast<int>((seed >> 8) % static_cast<unsigned>(range));
+    };
+    for (int i = 0; i < 1500; ++i) {
+        int x = next(2000), y = next(500), a = 1 + next(30), b = 1 + next(30);
+        switch (i % 4) {
+            case 0: scene.createShape<Rectangle>(Coordinates(x, y), a, b); break;
+            case 1: scene.createShape<Square>(Coordinates(x, y), a); break;
+            case 2: scene.createShape<Circle>(Coordinates(x, y), a); break;
+            default: scene.createShape<Triangle>(Coordinates(x, y), Coordinates(x + a, y + b), Coordinates(x, y + b)); break;
+        }
+    }
+    scene.createShape<Rectangle>(Coordinates(100, 100), 1800, 300);
+    auto contains = [](Shape* s, double x, double y) {
+        OverlapDetector::Geometry g = OverlapDetector::geometryOf(s);
+        if (g.kind == ShapeKind::Circle) {
+            return (x - g.cx) * (x - g.cx) + (y - g.cy) * (y - g.cy) <= g.r * g.r;
+        }
+        if (g.kind == ShapeKind::Triangle) {
+            double d[3];
+            for (int i = 0; i < 3; ++i) {
+                int j = (i + 1) % 3;
+                d[i] = (g.px[j] - g.px[i]) * (y - g.py[i]) - (g.py[j] - g.py[i]) * (x - g.px[i]);
+            }
+            bool negative = d[0] < 0 || d[1] < 0 || d[2] < 0, positive = d[0] > 0 || d[1] > 0 || d[2] > 0;
+            return !(negative && positive);
+        }
+        return x >= g.box.minX && x <= g.box.maxX && y >= g.box.minY && y <= g.box.maxY;
+    };
+    bool matches = true;
+    size_t total = 0;
+    for (int round = 0; round < 2 && matches; ++round) {
+        vector<double> px, py;
+        for (int i = 0; i < 3000; ++i) {
+            px.push_back(next(21000) / 10.0 - 50.0);
+            py.push_back(next(6000) / 10.0 - 50.0);
+        }
+        scene.hitTest(px, py, hits);
+        for (size_t i = 0; i < px.size() && matches; ++i) {
+            vector<int> expected;
+            for (int s = 0; s < scene.size(); ++s) {
+                if (contains(scene.getShape(s), px[i], py[i])) {
+                    expected.push_back(s);
+                }
+            }
+            matches = expected == vector<int>(hits.hits(i), hits.hits(i) + hits.hitCount(i));
+            total += expected.size();
+        }
+        scene.translateShapes(7, 3);
+    }
+    if (matches && total > 3000) {
+        cout << "Test 2 passed: Batch matches full scan" << endl;
+        passed++;
+    } else {
+        cout << "Test 2 FAILED: Batch matches full scan" << endl;
+        failed++;
+    }
+
+    // Test 3: Zero-area triangles are hit on their segment, edges inclusive
+    ShapeList flat;
+    flat.createShape<Triangle>(Coordinates(4, 0), Coordinates(0, 0), Coordinates(8, 0));    // Middle vertex first
+    flat.createShape<Triangle>(Coordinates(10, 10), Coordinates(16, 16), Coordinates(13, 13));
+    flat.createShape<Triangle>(Coordinates(30, 30), Coordinates(30, 30), Coordinates(30, 30));  // A single point
+    vector<double> fx = {0, 6, 8, 6, 9, 14, 14, 30, 30.5};
+    vector<double> fy = {0, 0, 0, 1, 0, 14, 15, 30, 30};
+    flat.hitTest(fx, fy, hits);
+    if (hits.hitCount(0) == 1 && hits.hitCount(1) == 1 && hits.hitCount(2) == 1 && hits.hitCount(3) == 0 &&
+        hits.hitCount(4) == 0 && hits.hitCount(5) == 1 && hits.hits(5)[0] == 1 && hits.hitCount(6) == 0 &&
+        hits.hitCount(7) == 1 && hits.hits(7)[0] == 2 && hits.hitCount(8) == 0) {
+        cout << "Test 3 passed: Degenerate triangles" << endl;
+        passed++;
+    } else {
+        cout << "Test 3 FAILED: Degenerate triangles" << endl;
+        failed++;
+    }
+
+    // Summary
+    cout << "========== Test Summary ==========" << endl;
+    cout << "Passed: " << passed << ", Failed: " << failed << endl;
+    cout << "==================================\n" << endl;
+}
+
+
+// ==============================
+// ColumnarShapeList Class
+// ==============================
+// Structure-of-arrays shape container with ShapeList's bulk operations
+// (add, remove, area, perimeter, translate, scale, display). Every shape
+// type keeps its fields in contiguous per-type columns, so
+// translateShapes() and scale() become linear sweeps over plain arrays
+// instead of a pointer chase and a virtual call per shape. Shapes exist
+// only as columns: they are read through typed accessors or copied out,
+// never edited in place. It is used by snapshots and selectable in --bench.
+class ColumnarShapeList {
+private:
+    friend class ShapeSnapshot;        // Writes the columns out as they are
+    friend class MappedShapeSnapshot;  // Loads the columns in bulk
+
+    // Maps a list position to the row of its shape inside the type columns
+    struct Entry {
+        ShapeKind kind;
+        int row;
+    };
+
+    struct RectangleColumns {
+        vector<int> x, y;
+        vector<double> width, length;
+    };
+
+    struct SquareColumns {
+        vector<int> x, y;
+        vector<double> side;
+    };
+
+    struct CircleColumns {
+        vector<int> x, y;
+        vector<double> radius;
+    };
+
+    // x, y hold the base Shape position, which Triangle keeps separately from its vertices
+    struct TriangleColumns {
+        vector<int> x, y;
+        vector<int> x1, y1, x2, y2, x3, y3;
+    };
+
+    vector<Entry> order;  // Insertion order, so positions match ShapeList
+    RectangleColumns rectangles;
+    SquareColumns squares;
+    CircleColumns circles;
+    TriangleColumns triangles;
+
+    // Move x and y by (dx, dy) unless the result would be negative; returns false if skipped
+    static bool translatePoint(int& x, int& y, int dx, int dy) {
+        int nx = x + dx;
+        int ny = y + dy;
+        bool valid = nx >= 0 && ny >= 0;
+        x = valid ? nx : x;
+        y = valid ? ny : y;
+        return valid;
+    }
+
+    // Apply a valid scale (factor > 0) to an integer column
+    static void scaleColumn(vector<int>& column, int factor, bool sign) {
+        if (sign) {
+            for (int& v : column) v *= factor;
+        } else {
+            for (int& v : column) v /= factor;
+        }
+    }
+
+    // Apply a valid scale (factor > 0) to a dimension column
+    static void scaleColumn(vector<double>& column, int factor, bool sign) {
+        if (sign) {
+            for (double& v : column) v *= factor;
+        } else {
+            for (double& v : column) v /= factor;
+        }
+    }
+
+    // Reset non-positive dimensions to 1.0, flagging the rows that were reset
+    // (reset is sized on the first one) and returning how many there were
+    static int resetInvalid(vector<double>& column, vector<char>& reset) {
+        int resets = 0;
+        for (size_t i = 0; i < column.size(); ++i) {
+            if (column[i] <= 0) {
+                column[i] = 1.0;
+                flagRow(reset, i, column.size());
+                resets++;
+            }
+        }
+        return resets;
+    }
+
+    static void flagRow(vector<char>& flags, size_t row, size_t rows) {
+        if (flags.empty()) {
+            flags.assign(rows, 0);
+        }
+        flags[row] = 1;
+    }
+
+    // Report an outcome after a sweep. With a collector active it counts once
+    // per shape for which flagged(entry) holds, under the shape's position, as
+    // ShapeList does through beginShape(), so both lists give the same
+    // summaries and ids. Otherwise the warning is printed once per point, as
+    // the Shape classes print it.
+    template <typename Flagged>
+    void reportShapes(ShapeDiagnostic code, int points, const char* warning, Flagged flagged) const {
+        DiagnosticsCollector* collector = DiagnosticsCollector::current();
+        if (collector == nullptr) {
+            for (int i = 0; i < points; ++i) {
+                cout << "Warning: " << warning << endl;
+            }
+            return;
+        }
+        for (size_t pos = 0; pos < order.size(); ++pos) {
+            if (flagged(order[pos])) {
+                collector->beginShape(pos);
+                collector->add(code, 1);
+            }
+        }
+        collector->finishShape();
+    }
+
+    // Erase one row from every column of a type
+    template <typename T>
+    static void eraseRow(vector<T>& column, int row) {
+        column.erase(column.begin() + row);
+    }
+
+    bool validPosition(int pos) const {
+        return pos >= 0 && pos < static_cast<int>(order.size());
+    }
+
+    // Run the batch kernels over each type's columns, then scatter into list order
+    void batchMetrics(vector<double>& out, bool wantArea) const {
+        const TriangleColumns& t = triangles;
+        vector<double> rect(rectangles.x.size()), square(squares.x.size());
+        vector<double> circle(circles.x.size()), triangle(t.x.size());
+        if (wantArea) {
+            rectangleAreaKernel(rectangles.width.data(), rectangles.length.data(), rect.data(), rect.size());
+            squareAreaKernel(squares.side.data(), square.data(), square.size());
+            circleAreaKernel(circles.radius.data(), circle.data(), circle.size());
+            triangleAreaKernel(t.x1.data(), t.y1.data(), t.x2.data(), t.y2.data(), t.x3.data(), t.y3.data(),
+                               triangle.data(), triangle.size());
+        } else {
+            rectanglePerimeterKernel(rectangles.width.data(), rectangles.length.data(), rect.data(), rect.size());
+            squarePerimeterKernel(squares.side.data(), square.data(), square.size());
+            circlePerimeterKernel(circles.radius.data(), circle.data(), circle.size());
+            trianglePerimeterKernel(t.x1.data(), t.y1.data(), t.x2.data(), t.y2.data(), t.x3.data(), t.y3.data(),
+                                    triangle.data(), triangle.size());
+        }
+
+        out.resize(order.size());
+        for (size_t i = 0; i < order.size(); ++i) {
+            int r = order[i].row;
+            switch (order[i].kind) {
+                case ShapeKind::Rectangle: out[i] = rect[r]; break;
+                case ShapeKind::Square:    out[i] = square[r]; break;
+                case ShapeKind::Circle:    out[i] = circle[r]; break;
+                case ShapeKind::Triangle:  out[i] = triangle[r]; break;
+            }
+        }
+    }
+
+    // Call fn with a stack copy of the shape at a given position
+    template <typename Fn>
+    void withShape(int pos, Fn fn) const {
+        const Entry& e = order[pos];
+        int r = e.row;
+        switch (e.kind) {
+            case ShapeKind::Rectangle:
+                fn(Rectangle(Coordinates(rectangles.x[r], rectangles.y[r]), rectangles.width[r], rectangles.length[r]));
+                break;
+            case ShapeKind::Square:
+                fn(Square(Coordinates(squares.x[r], squares.y[r]), squares.side[r]));
+                break;
+            case ShapeKind::Circle:
+                fn(Circle(Coordinates(circles.x[r], circles.y[r]), circles.radius[r]));
+                break;
+            case ShapeKind::Triangle: {
+                Triangle t(Coordinates(triangles.x1[r], triangles.y1[r]), Coordinates(triangles.x2[r], triangles.y2[r]),
+                           Coordinates(triangles.x3[r], triangles.y3[r]));
+                t.setCoordinates(Coordinates(triangles.x[r], triangles.y[r]));
+                fn(t);
+                break;
+            }
+        }
+    }
+
+    // Copy a shape's fields into the columns
+    void append(const Shape& s) {
+        Coordinates c = s.getCoordinates();
+        Entry e{s.getKind(), 0};
+        switch (e.kind) {
+            case ShapeKind::Rectangle: {
+                const Rectangle& r = static_cast<const Rectangle&>(s);
+                e.row = static_cast<int>(rectangles.x.size());
+                rectangles.x.push_back(c.getX());
+                rectangles.y.push_back(c.getY());
+                rectangles.width.push_back(r.getWidth());
+                rectangles.length.push_back(r.getLength());
+                break;
+            }
+            case ShapeKind::Square: {
+                const Square& sq = static_cast<const Square&>(s);
+                e.row = static_cast<int>(squares.x.size());
+                squares.x.push_back(c.getX());
+                squares.y.push_back(c.getY());
+                squares.side.push_back(sq.getSide());
+                break;
+            }
+            case ShapeKind::Circle: {
+                const Circle& ci = static_cast<const Circle&>(s);
+                e.row = static_cast<int>(circles.x.size());
+                circles.x.push_back(c.getX());
+                circles.y.push_back(c.getY());
+                circles.radius.push_back(ci.getRadius());
+                break;
+            }
+            case ShapeKind::Triangle: {
+                const Triangle& t = static_cast<const Triangle&>(s);
+                e.row = static_cast<int>(triangles.x.size());
+                triangles.x.push_back(c.getX());
+                triangles.y.push_back(c.getY());
+                triangles.x1.push_back(t.getPosition1().getX());
+                triangles.y1.push_back(t.getPosition1().getY());
+                triangles.x2.push_back(t.getPosition2().getX());
+                triangles.y2.push_back(t.getPosition2().getY());
+                triangles.x3.push_back(t.getPosition3().getX());
+                triangles.y3.push_back(t.getPosition3().getY());
+                break;
+            }
+        }
+        order.push_back(e);
+    }
+
+public:
+    // Add a shape to the list: its fields are copied into the columns and the
+    // shape itself is deleted, since the list takes ownership as ShapeList does
+    void addShape(Shape* s) {
+        if (s == nullptr) {
+            return;
+        }
+        append(*s);
+        delete s;
+    }
+
+    // Construct a shape of type T and copy its fields into the columns
+    template <typename T, typename... Args>
+    void createShape(Args&&... args) {
+        append(T(forward<Args>(args)...));
+    }
+
+    // Return the number of shapes in the list
+    int size() const {
+        return static_cast<int>(order.size());
+    }
+
+    // Translate all shapes in the list by (dx, dy), skipping any point that would go negative
+    void translateShapes(int dx, int dy) {
+        int skipped = 0;
+        vector<char> flagged[4];  // Per ShapeKind: rows with a skipped point
+        for (size_t i = 0; i < rectangles.x.size(); ++i) {
+            if (!translatePoint(rectangles.x[i], rectangles.y[i], dx, dy)) {
+                flagRow(flagged[0], i, rectangles.x.size());
+                skipped++;
+            }
+        }
+        for (size_t i = 0; i < squares.x.size(); ++i) {
+            if (!translatePoint(squares.x[i], squares.y[i], dx, dy)) {
+                flagRow(flagged[1], i, squares.x.size());
+                skipped++;
+            }
+        }
+        for (size_t i = 0; i < circles.x.size(); ++i) {
+            if (!translatePoint(circles.x[i], circles.y[i], dx, dy)) {
+                flagRow(flagged[2], i, circles.x.size());
+                skipped++;
+            }
+        }
+        // Triangle::translate moves the three vertices but not the base position
+        for (size_t i = 0; i < triangles.x.size(); ++i) {
+            int missed = !translatePoint(triangles.x1[i], triangles.y1[i], dx, dy);
+            missed += !translatePoint(triangles.x2[i], triangles.y2[i], dx, dy);
+            missed += !translatePoint(triangles.x3[i], triangles.y3[i], dx, dy);
+            if (missed > 0) {
+                flagRow(flagged[3], i, triangles.x.size());
+                skipped += missed;
+            }
+        }
+        // Same warnings as Coordinates::translate, emitted after the sweep
+        if (skipped > 0) {
+            reportShapes(ShapeDiagnostic::TranslationSkipped, skipped,
+                         "Translation would result in negative coordinates. Operation skipped.",
+                         [&flagged](const Entry& e) {
+                             const vector<char>& rows = flagged[static_cast<int>(e.kind)];
+                             return !rows.empty() && rows[e.row] != 0;
+                         });
+        }
+    }
+
+    // Return the type of the shape at a specific position (index starts at 0).
+    // Shapes live only as columns, so there is no Shape to hand out for editing.
+    ShapeKind getKind(int pos) const {
+        return order.at(pos).kind;
+    }
+
+    // Return the base position of the shape at a specific position
+    Coordinates getCoordinates(int pos) const {
+        const Entry& e = order.at(pos);
+        switch (e.kind) {
+            case ShapeKind::Rectangle: return Coordinates(rectangles.x[e.row], rectangles.y[e.row]);
+            case ShapeKind::Square:    return Coordinates(squares.x[e.row], squares.y[e.row]);
+            case ShapeKind::Circle:    return Coordinates(circles.x[e.row], circles.y[e.row]);
+            case ShapeKind::Triangle:  return Coordinates(triangles.x[e.row], triangles.y[e.row]);
+        }
+        return Coordinates(0, 0);
+    }
+
+    // Return a heap copy of the shape at a specific position (caller is
+    // responsible for deletion); changes made to it do not reach the columns
+    Shape* copyShape(int pos) const {
+        if (!validPosition(pos)) {
+            cout << "Warning: Invalid position in copyShape(). Returning nullptr." << endl;
+            return nullptr;
+        }
+        Shape* copy = nullptr;
+        withShape(pos, [&copy](const Shape& s) { copy = s.clone(); });
+        return copy;
+    }
+
+    // Remove the shape at a specific position and return it (caller is responsible for deletion)
+    Shape* removeShape(int pos) {
+        if (!validPosition(pos)) {
+            cout << "Warning: Invalid position in removeShape()." << endl;
+            return nullptr;
+        }
+        Shape* removed = copyShape(pos);
+        Entry e = order[pos];
+        switch (e.kind) {
+            case ShapeKind::Rectangle:
+                eraseRow(rectangles.x, e.row); eraseRow(rectangles.y, e.row);
+                eraseRow(rectangles.width, e.row); eraseRow(rectangles.length, e.row);
+                break;
+            case ShapeKind::Square:
+                eraseRow(squares.x, e.row); eraseRow(squares.y, e.row);
+                eraseRow(squares.side, e.row);
+                break;
+            case ShapeKind::Circle:
+                eraseRow(circles.x, e.row); eraseRow(circles.y, e.row);
+                eraseRow(circles.radius, e.row);
+                break;
+            case ShapeKind::Triangle:
+                eraseRow(triangles.x, e.row); eraseRow(triangles.y, e.row);
+                eraseRow(triangles.x1, e.row); eraseRow(triangles.y1, e.row);
+                eraseRow(triangles.x2, e.row); eraseRow(triangles.y2, e.row);
+                eraseRow(triangles.x3, e.row); eraseRow(triangles.y3, e.row);
+                break;
+        }
+        order.erase(order.begin() + pos);
+        // Later shapes of the same type moved up one row
+        for (size_t i = pos; i < order.size(); ++i) {
+            if (order[i].kind == e.kind) {
+                order[i].row--;
+            }
+        }
+        return removed;
+    }
+
+    // Return the area of the shape at a given position
+    double area(int pos) {
+        if (!validPosition(pos)) {
+            cout << "Warning: Invalid position in area()." << endl;
+            return -1.0;
+        }
+        int r = order[pos].row;
+        switch (order[pos].kind) {
+            case ShapeKind::Rectangle: return Rectangle::areaOf(rectangles.width[r], rectangles.length[r]);
+            case ShapeKind::Square:    return Square::areaOf(squares.side[r]);
+            case ShapeKind::Circle:    return Circle::areaOf(circles.radius[r]);
+            case ShapeKind::Triangle:
+                return Triangle::areaOf(Coordinates(triangles.x1[r], triangles.y1[r]),
+                                        Coordinates(triangles.x2[r], triangles.y2[r]),
+                                        Coordinates(triangles.x3[r], triangles.y3[r]));
+        }
+        return -1.0;
+    }
+
+    // Return the perimeter of the shape at a given position
+    double perimeter(int pos) {
+        if (!validPosition(pos)) {
+            cout << "Warning: Invalid position in perimeter()." << endl;
+            return -1.0;
+        }
+        int r = order[pos].row;
+        switch (order[pos].kind) {
+            case ShapeKind::Rectangle: return Rectangle::perimeterOf(rectangles.width[r], rectangles.length[r]);
+            case ShapeKind::Square:    return Square::perimeterOf(squares.side[r]);
+            case ShapeKind::Circle:    return Circle::perimeterOf(circles.radius[r]);
+            case ShapeKind::Triangle:
+                return Triangle::perimeterOf(Coordinates(triangles.x1[r], triangles.y1[r]),
+                                             Coordinates(triangles.x2[r], triangles.y2[r]),
+                                             Coordinates(triangles.x3[r], triangles.y3[r]));
+        }
+        return -1.0;
+    }
+
+    // Fill out with the area of every shape, in list order
+    void areas(vector<double>& out) const {
+        batchMetrics(out, true);
+    }
+
+    // Fill out with the perimeter of every shape, in list order
+    void perimeters(vector<double>& out) const {
+        batchMetrics(out, false);
+    }
+
+    // Scale all shapes in the list (multiply if sign=true, divide if false)
+    void scale(int factor, bool sign) {
+        if (factor <= 0) {
+            // Each shape prints once, except Triangle which prints once per vertex
+            int warnings = static_cast<int>(rectangles.x.size() + squares.x.size() + circles.x.size()) +
+                           3 * static_cast<int>(triangles.x.size());
+            if (warnings > 0) {
+                reportShapes(ShapeDiagnostic::ScaleSkipped, warnings,
+                             "Scaling factor must be greater than 0. Operation skipped.",
+                             [](const Entry&) { return true; });
+            }
+            return;
+        }
+
+        scaleColumn(rectangles.x, factor, sign);
+        scaleColumn(rectangles.y, factor, sign);
+        scaleColumn(rectangles.width, factor, sign);
+        scaleColumn(rectangles.length, factor, sign);
+
+        scaleColumn(squares.x, factor, sign);
+        scaleColumn(squares.y, factor, sign);
+        scaleColumn(squares.side, factor, sign);
+        vector<char> reset;
+        int resets = resetInvalid(squares.side, reset);
+        if (resets > 0) {
+            reportShapes(ShapeDiagnostic::SizeReset, resets,
+                         "Scaling resulted in invalid side length. Resetting to 1.0.",
+                         [&reset](const Entry& e) { return e.kind == ShapeKind::Square && reset[e.row] != 0; });
+        }
+
+        scaleColumn(circles.x, factor, sign);
+        scaleColumn(circles.y, factor, sign);
+        scaleColumn(circles.radius, factor, sign);
+        reset.clear();
+        resets = resetInvalid(circles.radius, reset);
+        if (resets > 0) {
+            reportShapes(ShapeDiagnostic::SizeReset, resets,
+                         "Radius became non-positive after scaling. Resetting to 1.0.",
+                         [&reset](const Entry& e) { return e.kind == ShapeKind::Circle && reset[e.row] != 0; });
+        }
+
+        // Triangle::scale only scales the vertices, not the base position
+        scaleColumn(triangles.x1, factor, sign);
+        scaleColumn(triangles.y1, factor, sign);
+        scaleColumn(triangles.x2, factor, sign);
+        scaleColumn(triangles.y2, factor, sign);
+        scaleColumn(triangles.x3, factor, sign);
+        scaleColumn(triangles.y3, factor, sign);
+    }
+
+    // Display information about all shapes
+    string display() const {
+        string result;
+        {
+            ShapeWriter out(result);
+            display(out);
+        }
+        return result;
+    }
+
+    // Write every shape into a writer, laid out as ShapeList::display()
+    void display(ShapeWriter& out) const {
+        out << "--- Shape List ---\n\n";
+        for (size_t i = 0; i < order.size(); ++i) {
+            out << "Shape " << i + 1 << ": ";
+            withShape(static_cast<int>(i), [&out](const Shape& s) { s.write(out); });
+            out << "\n\n";
+        }
+    }
+
+    // Stream every shape to an output stream
+    void display(ostream& stream) const {
+        ShapeWriter out(stream);
+        display(out);
+    }
+};
+
+
+// ==============================
+// Test function for ColumnarShapeList class
+// ==============================
+void test_columnar_shape_list_class() {
+    cout << "\n========== Running test_columnar_shape_list_class() ==========" << endl;
+
+    int passed = 0, failed = 0;
+
+    // Fill both backends with the same shapes
+    ShapeList pointers;
+    ColumnarShapeList columns;
+    pointers.addShape(new Triangle(Coordinates(50, 50), Coordinates(20, 70), Coordinates(70, 70)));
+    pointers.addShape(new Rectangle(Coordinates(100, 20), 10, 15));
+    pointers.addShape(new Circle(Coordinates(80, 100), 25));
+    pointers.addShape(new Square(Coordinates(90, 40), 20));
+    pointers.addShape(new Triangle(Coordinates(0, 0), Coordinates(30, 0), Coordinates(15, 25)));
+    columns.addShape(new Triangle(Coordinates(50, 50), Coordinates(20, 70), Coordinates(70, 70)));
+    columns.addShape(new Rectangle(Coordinates(100, 20), 10, 15));
+    columns.addShape(new Circle(Coordinates(80, 100), 25));
+    columns.addShape(new Square(Coordinates(90, 40), 20));
+    columns.addShape(new Triangle(Coordinates(0, 0), Coordinates(30, 0), Coordinates(15, 25)));
+
+    // Test 1: Same size and display output
+    if (columns.size() == 5 && columns.display() == pointers.display()) {
+        cout << "Test 1 passed: Columns match ShapeList after adding" << endl;
+        passed++;
+    } else {
+        cout << "Test 1 FAILED: Columns differ from ShapeList after adding" << endl;
+        failed++;
+    }
+
+    // Test 2: Area and perimeter per position
+    bool same = true;
+    for (int i = 0; i < 5; ++i) {
+        same = same && fabs(columns.area(i) - pointers.area(i)) < 0.001 &&
+               fabs(columns.perimeter(i) - pointers.perimeter(i)) < 0.001;
+    }
+    if (same) {
+        cout << "Test 2 passed: Area and perimeter" << endl;
+        passed++;
+    } else {
+        cout << "Test 2 FAILED: Area and perimeter" << endl;
+        failed++;
+    }
+
+    // Test 3: Translate with some skipped shapes, then scale both ways
+    pointers.translateShapes(-10, 5);
+    columns.translateShapes(-10, 5);
+    pointers.scale(3, true);
+    columns.scale(3, true);
+    pointers.scale(2, false);
+    columns.scale(2, false);
+    if (columns.display() == pointers.display()) {
+        cout << "Test 3 passed: Translate and scale match ShapeList" << endl;
+        passed++;
+    } else {
+        cout << "Test 3 FAILED: Translate and scale differ from ShapeList" << endl;
+        failed++;
+    }
+
+    // Test 4: Remove keeps the remaining positions in order
+    Shape* a = pointers.removeShape(1);
+    Shape* b = columns.removeShape(1);
+    if (a != nullptr && b != nullptr && a->display() == b->display() &&
+        columns.display() == pointers.display()) {
+        cout << "Test 4 passed: Remove shape" << endl;
+        passed++;
+    } else {
+        cout << "Test 4 FAILED: Remove shape" << endl;
+        failed++;
+    }
+    delete a;
+    delete b;
+
+    // Test 5: Invalid positions
+    if (columns.copyShape(10) == nullptr && columns.removeShape(-1) == nullptr && columns.area(10) < 0 &&
+        columns.getKind(0) == pointers.getShape(0)->getKind() &&
+        columns.getCoordinates(0).getX() == pointers.getShape(0)->getCoordinates().getX()) {
+        cout << "Test 5 passed: Invalid positions handled" << endl;
+        passed++;
+    } else {
+        cout << "Test 5 FAILED: Invalid positions" << endl;
+        failed++;
+    }
+
+    // Test 6: Batch areas and perimeters match the per-shape results on both backends
+    for (int i = 0; i < 9; ++i) {
+        pointers.addShape(new Triangle(Coordinates(i, 2 * i), Coordinates(3 * i + 4, i), Coordinates(i + 1, 5 * i + 7)));
+        columns.addShape(new Triangle(Coordinates(i, 2 * i), Coordinates(3 * i + 4, i), Coordinates(i + 1, 5 * i + 7)));
+        pointers.addShape(new Circle(Coordinates(i, i), 0.5 + i));
+        columns.addShape(new Circle(Coordinates(i, i), 0.5 + i));
+    }
+    vector<double> pointerAreas, pointerPerimeters, columnAreas, columnPerimeters;
+    pointers.areas(pointerAreas);
+    pointers.perimeters(pointerPerimeters);
+    columns.areas(columnAreas);
+    columns.perimeters(columnPerimeters);
+    same = static_cast<int>(pointerAreas.size()) == pointers.size() && columnAreas.size() == pointerAreas.size();
+    for (int i = 0; same && i < pointers.size(); ++i) {
+        same = fabs(pointerAreas[i] - pointers.area(i)) < 0.001 &&
+               fabs(pointerPerimeters[i] - pointers.perimeter(i)) < 0.001 &&
+               fabs(columnAreas[i] - pointerAreas[i]) < 0.001 &&
+               fabs(columnPerimeters[i] - pointerPerimeters[i]) < 0.001;
+    }
+    if (same) {
+        cout << "Test 6 passed: Batch areas and perimeters" << endl;
+        passed++;
+    } else {
+        cout << "Test 6 FAILED: Batch areas and perimeters" << endl;
+        failed++;
+    }
+
+    // Summary
+    cout << "========== Test Summary ==========" << endl;
+    cout << "Passed: " << passed << ", Failed: " << failed << endl;
+    cout << "==================================\n" << endl;
+}
+
+
+// ==============================
+// Test function for DiagnosticsCollector class
+// ==============================
+void test_diagnostics_collector_class() {
+    cout << "\n========== Running test_diagnostics_collector_class() ==========" << endl;
+
+    int passed = 0, failed = 0;
+
+    // Test 1: A collector captures warnings on its thread and restores the previous one
+    DiagnosticsReport outer, inner;
+    Coordinates point(1, 1);
+    bool uncollected = !reportDiagnostic(ShapeDiagnostic::ScaleSkipped);
+    {
+        DiagnosticsCollector first(outer);
+        point.translate(-5, 0);
+        {
+            DiagnosticsCollector second(inner);
+            point.scale(0, true);
+        }
+        point.translate(0, -5);
+    }
+    if (uncollected && outer.count(ShapeDiagnostic::TranslationSkipped) == 2 &&
+        inner.count(ShapeDiagnostic::ScaleSkipped) == 1 && outer.total() == 2 &&
+        DiagnosticsCollector::current() == nullptr && point.getX() == 1) {
+        cout << "Test 1 passed: Collector scope" << endl;
+        passed++;
+    } else {
+        cout << "Test 1 FAILED: Collector scope" << endl;
+        failed++;
+    }
+
+    // Test 2: ShapeList counts each affected shape once and keeps its position
+    ShapeList list;
+    list.setDiagnosticsMode(true, true);
+    list.createShape<Rectangle>(Coordinates(20, 20), 5, 10);
+    list.createShape<Triangle>(Coordinates(0, 0), Coordinates(30, 0), Coordinates(5, 30));
+    list.createShape<Circle>(Coordinates(3, 3), 1.0);
+    list.translateShapes(-10, 0);
+    list.scale(0, true);
+    const DiagnosticsReport& report = list.getDiagnostics();
+    vector<size_t> skipped = report.affectedShapes(ShapeDiagnostic::TranslationSkipped);
+    if (report.count(ShapeDiagnostic::TranslationSkipped) == 2 && skipped.size() == 2 &&
+        skipped[0] == 1 && skipped[1] == 2 && report.count(ShapeDiagnostic::ScaleSkipped) == 3 &&
+        list.getShape(0)->getCoordinates().getX() == 10) {
+        cout << "Test 2 passed: Per-shape outcomes" << endl;
+        passed++;
+    } else {
+        cout << "Test 2 FAILED: Per-shape outcomes" << endl;
+        failed++;
+    }
+
+    // Test 3: Parallel chunks merge into one summary
+    ShapeList big;
+    big.setParallelExecution(2, 256);
+    big.setDiagnosticsMode(true);
+    for (int i = 0; i < 4000; ++i) {
+        big.createShape<Square>(Coordinates(i % 2 == 0 ? 0 : 10, 0), 2.0);
+    }
+    big.translateShapes(-5, 0);
+    string summary = big.diagnosticsSummary();
+    big.clearDiagnostics();
+    if (summary == "2,000 translations skipped (negative coordinates)\n" &&
+        big.getDiagnostics().affected.empty() && big.diagnosticsSummary() == "No warnings.\n") {
+        cout << "Test 3 passed: Parallel summary" << endl;
+        passed++;
+    } else {
+        cout << "Test 3 FAILED: Parallel summary" << endl;
+        failed++;
+    }
+
+    // Test 4: ColumnarShapeList reports the same per-shape counts and ids as ShapeList
+    ColumnarShapeList columns;
+    ShapeList pointers;
+    pointers.setDiagnosticsMode(true, true);
+    for (int i = 0; i < 2; ++i) {
+        columns.addShape(new Circle(Coordinates(2, 2), 1.0));
+        columns.addShape(new Square(Coordinates(9, 9), 1.0));
+        columns.addShape(new Triangle(Coordinates(0, 0), Coordinates(4, 0), Coordinates(0, 3)));
+        pointers.addShape(new Circle(Coordinates(2, 2), 1.0));
+        pointers.addShape(new Square(Coordinates(9, 9), 1.0));
+        pointers.addShape(new Triangle(Coordinates(0, 0), Coordinates(4, 0), Coordinates(0, 3)));
+    }
+    DiagnosticsReport columnReport;
+    {
+        DiagnosticsCollector collector(columnReport, true);
+        columns.translateShapes(-3, 0);
+        columns.scale(0, true);
+    }
+    pointers.translateShapes(-3, 0);
+    pointers.scale(0, true);
+    const DiagnosticsReport& pointerReport = pointers.getDiagnostics();
+    bool same = true;
+    for (int k = 0; k < DIAGNOSTIC_KINDS; ++k) {
+        ShapeDiagnostic code = static_cast<ShapeDiagnostic>(k);
+        same = same && columnReport.count(code) == pointerReport.count(code) &&
+               columnReport.affectedShapes(code) == pointerReport.affectedShapes(code);
+    }
+    if (same && columnReport.count(ShapeDiagnostic::TranslationSkipped) == 4 &&
+        columnReport.count(ShapeDiagnostic::ScaleSkipped) == 6) {
+        cout << "Test 4 passed: Columnar warnings" << endl;
+        passed++;
+    } else {
+        cout << "Test 4 FAILED: Columnar warnings" << endl;
+        failed++;
+    }
+
+    // Summary
+    cout << "========== Test Summary ==========" << endl;
+    cout << "Passed: " << passed << ", Failed: " << failed << endl;
+    cout << "==================================\n" << endl;
+}
+
+
+// ==============================
+// VariantShapeList Class
+// ==============================
+// Closed-set alternative to ShapeList for the four shape types. Shapes are
+// stored by value in one contiguous vector of std::variant, so there is no
+// per-shape allocation or pointer, and every operation dispatches with
+// std::visit on the variant index. The visitors call members qualified
+// with the concrete type (s.T::computeArea()), which bypasses the vtable
+// and lets the compiler inline the formulas into the loop.
+//
+// Values are recomputed on every call instead of using the shapes' caches.
+// removeShape() shifts whole shapes rather than pointers, so it costs more
+// than in ShapeList on large lists. Pointers returned by createShape() and
+// getShape() are invalidated by the next add or remove.
+
+typedef variant<Rectangle, Square, Circle, Triangle> ShapeVariant;
+
+class VariantShapeList {
+private:
+    vector<ShapeVariant> shapes;
+
+    template <typename T>
+    using Concrete = typename decay<T>::type;
+
+    static double areaOf(const ShapeVariant& v) {
+        return visit([](const auto& s) {
+            typedef Concrete<decltype(s)> T;
+            return s.T::computeArea();
+        }, v);
+    }
+
+    static double perimeterOf(const ShapeVariant& v) {
+        return visit([](const auto& s) {
+            typedef Concrete<decltype(s)> T;
+            return s.T::computePerimeter();
+        }, v);
+    }
+
+    static Shape* asShape(ShapeVariant& v) {
+        return visit([](auto& s) -> Shape* { return &s; }, v);
+    }
+
+public:
+    // Build a shape of type T and store it at the end of the list
+    template <typename T, typename... Args>
+    T* createShape(Args&&... args) {
+        shapes.push_back(T(forward<Args>(args)...));
+        return &get<T>(shapes.back());
+    }
+
+    // Add a copy of a heap-allocated shape and delete it, since the list
+    // takes ownership as ShapeList does
+    void addShape(Shape* s) {
+        if (s == nullptr) {
+            return;
+        }
+        switch (s->getKind()) {
+            case ShapeKind::Rectangle:
+                shapes.emplace_back(*static_cast<Rectangle*>(s));
+                break;
+            case ShapeKind::Square:
+                shapes.emplace_back(*static_cast<Square*>(s));
+                break;
+            case ShapeKind::Circle:
+                shapes.emplace_back(*static_cast<Circle*>(s));
+                break;
+            case ShapeKind::Triangle:
+                shapes.emplace_back(*static_cast<Triangle*>(s));
+                break;
+        }
+        delete s;
+    }
+
+    // Return the number of shapes in the list
+    int size() const {
+        return static_cast<int>(shapes.size());
+    }
+
+    // Return the shape at a specific position (index starts at 0)
+    Shape* getShape(int pos) {
+        if (pos >= 0 && pos < size()) {
+            return asShape(shapes[pos]);
+        }
+        cout << "Warning: Invalid position in getShape(). Returning nullptr." << endl;
+        return nullptr;
+    }
+
+    // Remove the shape at a specific position and return a heap copy of it
+    // (caller is responsible for deletion)
+    Shape* removeShape(int pos) {
+        if (pos >= 0 && pos < size()) {
+            Shape* removed = asShape(shapes[pos])->clone();
+            shapes.erase(shapes.begin() + pos);
+            return removed;
+        }
+        cout << "Warning: Invalid position in removeShape()." << endl;
+        return nullptr;
+    }
+
+    // Return the area of the shape at a given position
+    double area(int pos) {
+        if (pos >= 0 && pos < size()) {
+            return areaOf(shapes[pos]);
+        }
+        cout << "Warning: Invalid position in area()." << endl;
+        return -1.0;
+    }
+
+    // Return the perimeter of the shape at a given position
+    double perimeter(int pos) {
+        if (pos >= 0 && pos < size()) {
+            return perimeterOf(shapes[pos]);
+        }
+        cout << "Warning: Invalid position in perimeter()." << endl;
+        return -1.0;
+    }
+
+    // Fill out with the area of every shape, in list order
+    void areas(vector<double>& out) const {
+        out.resize(shapes.size());
+        for (size_t i = 0; i < shapes.size(); ++i) {
+            out[i] = areaOf(shapes[i]);
+        }
+    }
+
+    // Fill out with the perimeter of every shape, in list order
+    void perimeters(vector<double>& out) const {
+        out.resize(shapes.size());
+        for (size_t i = 0; i < shapes.size(); ++i) {
+            out[i] = perimeterOf(shapes[i]);
+        }
+    }
+
+    // Translate all shapes in the list by (dx, dy)
+    void translateShapes(int dx, int dy) {
+        for (ShapeVariant& v : shapes) {
+            visit([dx, dy](auto& s) {
+                typedef Concrete<decltype(s)> T;
+                s.T::translate(dx, dy);
+            }, v);
+        }
+    }
+
+    // Scale all shapes in the list
+    void scale(int factor, bool sign) {
+        for (ShapeVariant& v : shapes) {
+            visit([factor, sign](auto& s) {
+                typedef Concrete<decltype(s)> T;
+                s.T::scale(factor, sign);
+            }, v);
+        }
+    }
+
+    // Return the bytes held by the list (inline storage, no per-shape allocation)
+    size_t memoryBytes() const {
+        return shapes.capacity() * sizeof(ShapeVariant);
+    }
+
+    // Display information about all shapes
+    string display() {
+        string result;
+        {
+            ShapeWriter out(result);
+            display(out);
+        }
+        return result;
+    }
+
+    // Write every shape into a writer, laid out as ShapeList::display()
+    void display(ShapeWriter& out) {
+        out << "--- Shape List ---\n\n";
+        for (size_t i = 0; i < shapes.size(); ++i) {
+            out << "Shape " << i + 1 << ": ";
+            visit([&out](const auto& s) {
+                typedef Concrete<decltype(s)> T;
+                s.T::write(out);
+            }, shapes[i]);
+            out << "\n\n";
+        }
+    }
+
+    // Stream every shape to an output stream
+    void display(ostream& stream) {
+        ShapeWriter out(stream);
+        display(out);
+    }
+};
+
+
+// ==============================
+// Test function for VariantShapeList class
+// ==============================
+void test_variant_shape_list_class() {
+    cout << "\n========== Running test_variant_shape_list_class() ==========" << endl;
+
+    int passed = 0, failed = 0;
+
+    ShapeList reference;
+    VariantShapeList variants;
+    reference.createShape<Rectangle>(Coordinates(10, 20), 10.5, 15);
+    reference.createShape<Square>(Coordinates(90, 40), 20);
+    reference.createShape<Circle>(Coordinates(80, 100), 25);
+    reference.createShape<Triangle>(Coordinates(50, 50), Coordinates(20, 70), Coordinates(70, 70));
+    variants.createShape<Rectangle>(Coordinates(10, 20), 10.5, 15);
+    variants.createShape<Square>(Coordinates(90, 40), 20);
+    variants.addShape(new Circle(Coordinates(80, 100), 25));
+    variants.createShape<Triangle>(Coordinates(50, 50), Coordinates(20, 70), Coordinates(70, 70));
+
+    // Test 1: Same metrics and display as ShapeList
+    vector<double> expectedAreas, actualAreas, expectedPerimeters, actualPerimeters;
+    reference.areas(expectedAreas);
+    variants.areas(actualAreas);
+    reference.perimeters(expectedPerimeters);
+    variants.perimeters(actualPerimeters);
+    bool same = variants.size() == 4 && reference.display() == variants.display();
+    for (int i = 0; i < 4; ++i) {
+        same = same && fabs(actualAreas[i] - expectedAreas[i]) < 1e-9 &&
+               fabs(actualPerimeters[i] - expectedPerimeters[i]) < 1e-9 &&
+               variants.area(i) == actualAreas[i] && variants.perimeter(i) == actualPerimeters[i];
+    }
+    if (same && variants.getShape(2)->getKind() == ShapeKind::Circle) {
+        cout << "Test 1 passed: Metrics and display match ShapeList" << endl;
+        passed++;
+    } else {
+        cout << "Test 1 FAILED: Metrics or display differ from ShapeList" << endl;
+        failed++;
+    }
+
+    // Test 2: Transforms and removal behave as in ShapeList
+    reference.translateShapes(5, -3);
+    variants.translateShapes(5, -3);
+    reference.scale(3, true);
+    variants.scale(3, true);
+    reference.scale(2, false);
+    variants.scale(2, false);
+    unique_ptr<Shape> expected(reference.removeShape(1));
+    unique_ptr<Shape> removed(variants.removeShape(1));
+    if (removed != nullptr && removed->display() == expected->display() && variants.size() == 3 &&
+        variants.display() == reference.display() && variants.removeShape(7) == nullptr) {
+        cout << "Test 2 passed: Transforms and removal" << endl;
+        passed++;
+    } else {
+        cout << "Test 2 FAILED: Transforms and removal" << endl;
+        failed++;
+    }
+
+    // Summary
+    cout << "========== Test Summary ==========" << endl;
+    cout << "Passed: " << passed << ", Failed: " << failed << endl;
+    cout << "==================================\n" << endl;
+}
+
+
+// ==============================
+// ShapeSlotMap Class
+// ==============================
+// Shape container addressed by stable handles instead of positions.
+// Shapes are kept densely packed for the bulk transforms; a handle names a
+// slot plus the generation it was issued for, so a handle to a removed
+// shape is detected even after its slot has been reused. Insert and
+// remove are O(1): removal moves the last dense shape into the gap.
+
+// Stable reference to a shape in a ShapeSlotMap (generation 0 is never issued)
+struct ShapeHandle {
+    uint32_t index = 0;
+    uint32_t generation = 0;
+
+    bool operator==(const ShapeHandle& other) const {
+        return index == other.index && generation == other.generation;
+    }
+
+    bool operator!=(const ShapeHandle& other) const {
+        return !(*this == other);
+    }
+};
+
+class ShapeSlotMap {
+private:
+    static constexpr uint32_t NO_SLOT = 0xffffffffu;
+
+    struct Slot {
+        uint32_t generation = 1;  // Generation of the current (or next) occupant
+        uint32_t dense = NO_SLOT; // Position in the dense arrays, or NO_SLOT when free
+        uint32_t nextFree = NO_SLOT;
+    };
+
+    vector<Slot> slots;
+    vector<Shape*> dense;       // Live shapes, packed
+    vector<uint32_t> denseSlot; // Slot of each dense shape
+    uint32_t freeHead = NO_SLOT;
+    ShapeArena arena;           // Owns the shapes built by createShape()
+    size_t heapShapes = 0;      // Shapes added with addShape()
+
+    // Return the dense position of a live handle, or NO_SLOT
+    uint32_t find(ShapeHandle h) const {
+        if (h.index >= slots.size() || slots[h.index].generation != h.generation) {
+            return NO_SLOT;
+        }
+        return slots[h.index].dense;
+    }
+
+    ShapeHandle insert(Shape* s) {
+        uint32_t index;
+        if (freeHead != NO_SLOT) {
+            index = freeHead;
+            freeHead = slots[index].nextFree;
+        } else {
+            index = static_cast<uint32_t>(slots.size());
+            slots.push_back(Slot());
+        }
+        slots[index].dense = static_cast<uint32_t>(dense.size());
+        dense.push_back(s);
+        denseSlot.push_back(index);
+        return ShapeHandle{index, slots[index].generation};
+    }
+
+public:
+    ShapeSlotMap() = default;
+    ShapeSlotMap(const ShapeSlotMap&) = delete;
+    ShapeSlotMap& operator=(const ShapeSlotMap&) = delete;
+
+    // Add a heap-allocated shape (the map takes ownership) and return its handle
+    ShapeHandle addShape(Shape* s) {
+        if (s == nullptr) {
+            return ShapeHandle();
+        }
+        heapShapes++;
+        return insert(s);
+    }
+
+    // Construct a shape of type T in the map's arena and return its handle
+    template <typename T, typename... Args>
+    ShapeHandle createShape(Args&&... args) {
+        return insert(arena.create<T>(forward<Args>(args)...));
+    }
+
+    // Return the number of shapes in the map
+    int size() const {
+        return static_cast<int>(dense.size());
+    }
+
+    // Check whether a handle still refers to a shape
+    bool contains(ShapeHandle h) const {
+        return find(h) != NO_SLOT;
+    }
+
+    // Return the shape behind a handle
+    Shape* getShape(ShapeHandle h) {
+        uint32_t d = find(h);
+        if (d == NO_SLOT) {
+            cout << "Warning: Invalid handle in getShape(). Returning nullptr." << endl;
+            return nullptr;
+        }
+        return dense[d];
+    }
+
+    // Remove the shape behind a handle and return it (caller is responsible for deletion)
+    Shape* removeShape(ShapeHandle h) {
+        uint32_t d = find(h);
+        if (d == NO_SLOT) {
+            cout << "Warning: Invalid handle in removeShape()." << endl;
+            return nullptr;
+        }
+        Shape* removed = dense[d];
+
+        // Fill the gap with the last dense shape
+        uint32_t last = static_cast<uint32_t>(dense.size() - 1);
+        dense[d] = dense[last];
+        denseSlot[d] = denseSlot[last];
+        slots[denseSlot[d]].dense = d;
+        dense.pop_back();
+        denseSlot.pop_back();
+
+        // Retire the slot: old handles stop matching its generation
+        Slot& slot = slots[h.index];
+        slot.generation = slot.generation == 0xffffffffu ? 1 : slot.generation + 1;
+        slot.dense = NO_SLOT;
+        slot.nextFree = freeHead;
+        freeHead = h.index;
+
+        if (arena.owns(removed)) {
+            Shape* copy = removed->clone();
+            arena.destroy(removed);
+            return copy;
+        }
+        heapShapes--;
+        return removed;
+    }
+
+    // Return the area of the shape behind a handle
+    double area(ShapeHandle h) {
+        Shape* s = getShape(h);
+        return s != nullptr ? s->getArea() : -1.0;
+    }
+
+    // Return the perimeter of the shape behind a handle
+    double perimeter(ShapeHandle h) {
+        Shape* s = getShape(h);
+        return s != nullptr ? s->getPerimeter() : -1.0;
+    }
+
+    // Translate all shapes by (dx, dy)
+    void translateShapes(int dx, int dy) {
+        for (Shape* s : dense) {
+            s->translate(dx, dy);
+        }
+    }
+
+    // Scale all shapes
+    void scale(int factor, bool sign) {
+        for (Shape* s : dense) {
+            s->scale(factor, sign);
+        }
+    }
+
+    // Return the handles of every shape, in dense order
+    vector<ShapeHandle> handles() const {
+        vector<ShapeHandle> result;
+        result.reserve(dense.size());
+        for (uint32_t index : denseSlot) {
+            result.push_back(ShapeHandle{index, slots[index].generation});
+        }
+        return result;
+    }
+
+    // Display information about all shapes, labelled with their handle
+    string display() const {
+        string result;
+        {
+            ShapeWriter out(result);
+            out << "--- Shape Slot Map ---\n\n";
+            for (size_t i = 0; i < dense.size(); ++i) {
+                out << "Shape [" << denseSlot[i] << ':' << slots[denseSlot[i]].generation << "]: ";
+                dense[i]->write(out);
+                out << "\n\n";
+            }
+        }
+        return result;
+    }
+
+    // Destructor: delete the shapes added with addShape(); arena slabs are released together
+    ~ShapeSlotMap() {
+        if (heapShapes > 0) {
+            for (Shape* s : dense) {
+                if (!arena.owns(s)) {
+                    delete s;
+                }
+            }
+        }
+    }
+};
+
+
+// ==============================
+// Test function for ShapeSlotMap class
+// ==============================
+void test_shape_slot_map_class() {
+    cout << "\n========== Running test_shape_slot_map_class() ==========" << endl;
+
+    int passed = 0, failed = 0;
+
+    // Test 1: Handles find their shapes
+    ShapeSlotMap map;
+    ShapeHandle rect = map.createShape<Rectangle>(Coordinates(10, 20), 5, 10);
+    ShapeHandle circle = map.addShape(new Circle(Coordinates(5, 5), 1.0));
+    ShapeHandle square = map.createShape<Square>(Coordinates(1, 1), 3.0);
+    if (map.size() == 3 && fabs(map.area(rect) - 50.0) < 0.001 &&
+        fabs(map.perimeter(square) - 12.0) < 0.001 && map.getShape(circle)->getKind() == ShapeKind::Circle) {
+        cout << "Test 1 passed: Lookup by handle" << endl;
+        passed++;
+    } else {
+        cout << "Test 1 FAILED: Lookup by handle" << endl;
+        failed++;
+    }
+
+    // Test 2: Removing one shape leaves the other handles valid
+    Shape* removed = map.removeShape(rect);
+    if (removed != nullptr && fabs(removed->getArea() - 50.0) < 0.001 && map.size() == 2 &&
+        !map.contains(rect) && map.contains(circle) && fabs(map.area(square) - 9.0) < 0.001) {
+        cout << "Test 2 passed: O(1) removal keeps other handles" << endl;
+        passed++;
+    } else {
+        cout << "Test 2 FAILED: Removal" << endl;
+        failed++;
+    }
+    delete removed;
+
+    // Test 3: A reused slot does not revive the old handle
+    ShapeHandle triangle = map.createShape<Triangle>(Coordinates(0, 0), Coordinates(4, 0), Coordinates(0, 3));
+    if (triangle.index == rect.index && triangle.generation != rect.generation &&
+        map.getShape(rect) == nullptr && map.removeShape(rect) == nullptr && map.area(rect) < 0 &&
+        fabs(map.area(triangle) - 6.0) < 0.001) {
+        cout << "Test 3 passed: Stale handle rejected" << endl;
+        passed++;
+    } else {
+        cout << "Test 3 FAILED: Stale handle" << endl;
+        failed++;
+    }
+
+    // Test 4: Bulk transforms reach every shape
+    map.translateShapes(1, 1);
+    map.scale(2, true);
+    Coordinates c = map.getShape(circle)->getCoordinates();
+    if (c.getX() == 12 && c.getY() == 12 && fabs(map.area(triangle) - 24.0) < 0.001 &&
+        map.handles().size() == 3 && map.display().find("Shape [") != string::npos) {
+        cout << "Test 4 passed: Bulk transforms" << endl;
+        passed++;
+    } else {
+        cout << "Test 4 FAILED: Bulk transforms" << endl;
+        failed++;
+    }
+
+    // Summary
+    cout << "========== Test Summary ==========" << endl;
+    cout << "Passed: " << passed << ", Failed: " << failed << endl;
+    cout << "==================================\n" << endl;
+}
+
+
+// ==============================
+// CowShapeList Class
+// ==============================
+// Shape list whose snapshots share storage with it. Shapes are kept in
+// chunks held by shared_ptr; a snapshot copies the chunk pointers, so it
+// costs O(chunks), and a writer that changes a chunk still held by a
+// snapshot clones that chunk first. Snapshots are immutable and can be read
+// from any number of threads while the list keeps changing.
+//
+// Adds fill the last chunk even when a snapshot shares it, and a removal
+// merges its chunk with a neighbour once both fit in one, so any two
+// neighbouring chunks hold more than CHUNK_SIZE shapes and there are at
+// most about 2n / CHUNK_SIZE chunks however adds, removals and snapshots
+// interleave. The first position of every chunk is kept alongside, so a
+// position is found by binary search.
+//
+// Shapes memoize their area, perimeter and box on first use, so snapshot()
+// fills those caches for the chunks changed since the last snapshot; after
+// that, reading a shared shape never writes to it. snapshot() and every
+// change must come from the writer's thread (or under the writer's lock).
+
+class CowShapeList {
+private:
+    static constexpr size_t CHUNK_SIZE = 512;  // Shapes per chunk before a new one is started
+
+    struct Chunk {
+        vector<unique_ptr<Shape>> shapes;
+        bool warm = false;  // Every shape's cached metrics and box are filled
+
+        Chunk() {}
+
+        // Deep copy, for a writer taking over a shared chunk
+        Chunk(const Chunk& other) : warm(other.warm) {
+            shapes.reserve(max(other.shapes.size(), CHUNK_SIZE));
+            for (const unique_ptr<Shape>& s : other.shapes) {
+                shapes.push_back(unique_ptr<Shape>(s->clone()));
+            }
+        }
+    };
+
+    vector<shared_ptr<Chunk>> chunks;
+    vector<size_t> starts;  // Position of the first shape of each chunk
+    size_t count = 0;
+
+    // Return the chunk holding a valid position
+    static size_t chunkOf(const vector<size_t>& starts, size_t pos) {
+        return static_cast<size_t>(upper_bound(starts.begin(), starts.end(), pos) - starts.begin()) - 1;
+    }
+
+    // Recompute the chunk starts from chunk c on
+    void reindex(size_t c) {
+        starts.resize(chunks.size());
+        for (; c < chunks.size(); ++c) {
+            starts[c] = c == 0 ? 0 : starts[c - 1] + chunks[c - 1]->shapes.size();
+        }
+    }
+
+    // Merge chunk c with a neighbour if both fit in one chunk; an empty chunk is dropped
+    void mergeAround(size_t c) {
+        if (chunks[c]->shapes.empty()) {
+            chunks.erase(chunks.begin() + c);
+            reindex(c);
+            return;
+        }
+        size_t left;
+        if (c + 1 < chunks.size() && chunks[c]->shapes.size() + chunks[c + 1]->shapes.size() <= CHUNK_SIZE) {
+            left = c;
+        } else if (c > 0 && chunks[c - 1]->shapes.size() + chunks[c]->shapes.size() <= CHUNK_SIZE) {
+            left = c - 1;
+        } else {
+            reindex(c);
+            return;
+        }
+        Chunk& into = writable(left);
+        Chunk& from = writable(left + 1);
+        for (unique_ptr<Shape>& s : from.shapes) {
+            into.shapes.push_back(move(s));
+        }
+        chunks.erase(chunks.begin() + left + 1);
+        reindex(left);
+    }
+
+    // Return a chunk the writer may change, cloning it if a snapshot shares it
+    Chunk& writable(size_t c) {
+        if (chunks[c].use_count() > 1) {
+            chunks[c] = make_shared<Chunk>(*chunks[c]);
+        }
+        chunks[c]->warm = false;
+        return *chunks[c];
+    }
+
+    // Find the chunk holding a position and the position within it
+    bool locate(int pos, size_t& c, size_t& offset) const {
+        if (pos < 0 || static_cast<size_t>(pos) >= count) {
+            return false;
+        }
+        c = chunkOf(starts, static_cast<size_t>(pos));
+        offset = static_cast<size_t>(pos) - starts[c];
+        return true;
+    }
+
+    static void warmUp(Chunk& chunk) {
+        for (const unique_ptr<Shape>& s : chunk.shapes) {
+            s->getArea();
+            s->getPerimeter();
+            s->getBoundingBox();
+        }
+        chunk.warm = true;
+    }
+
+public:
+    // Immutable view of the list at the time snapshot() was called
+    class Snapshot {
+    private:
+        vector<shared_ptr<const Chunk>> chunks;
+        vector<size_t> starts;
+        size_t count = 0;
+
+        friend class CowShapeList;
+
+    public:
+        // Return the number of shapes in the snapshot
+        int size() const {
+            return static_cast<int>(count);
+        }
+
+        // Return the shape at a position, or nullptr
+        const Shape* getShape(int pos) const {
+            if (pos < 0 || static_cast<size_t>(pos) >= count) {
+                return nullptr;
+            }
+            size_t c = chunkOf(starts, static_cast<size_t>(pos));
+            return chunks[c]->shapes[static_cast<size_t>(pos) - starts[c]].get();
+        }
+
+        // Call fn on every shape, in list order
+        void forEach(const function<void(const Shape*)>& fn) const {
+            for (const shared_ptr<const Chunk>& chunk : chunks) {
+                for (const unique_ptr<Shape>& s : chunk->shapes) {
+                    fn(s.get());
+                }
+            }
+        }
+
+        // Return the area of the shape at a position, or -1.0
+        double area(int pos) const {
+            const Shape* s = getShape(pos);
+            return s != nullptr ? s->getArea() : -1.0;
+        }
+
+        // Return the perimeter of the shape at a position, or -1.0
+        double perimeter(int pos) const {
+            const Shape* s = getShape(pos);
+            return s != nullptr ? s->getPerimeter() : -1.0;
+        }
+
+        // Scene totals computed from the snapshot
+        SceneAggregates aggregates() const {
+            SceneAggregates totals;
+            forEach([&totals](const Shape* s) {
+                int k = static_cast<int>(s->getKind());
+                const BoundingBox& box = s->getBoundingBox();
+                totals.bounds = totals.count == 0 ? box : totals.bounds.merge(box);
+                totals.count++;
+                totals.countByKind[k]++;
+                totals.areaByKind[k] += s->getArea();
+                totals.perimeterByKind[k] += s->getPerimeter();
+            });
+            return totals;
+        }
+
+        // Display information about all shapes, laid out as ShapeList::display()
+        string display() const {
+            string result;
+            {
+                ShapeWriter out(result);
+                out << "--- Shape List ---\n\n";
+                int i = 0;
+                forEach([&out, &i](const Shape* s) {
+                    out << "Shape " << ++i << ": ";
+                    s->write(out);
+                    out << "\n\n";
+                });
+            }
+            return result;
+        }
+    };
+
+    // Add a heap-allocated shape (the list takes ownership)
+    void addShape(Shape* s) {
+        if (s == nullptr) {
+            cout << "Warning: Cannot add a null shape." << endl;
+            return;
+        }
+        // Start a new chunk only when the last one is full; a shared last
+        // chunk is cloned, so snapshots between adds do not leave small chunks
+        if (chunks.empty() || chunks.back()->shapes.size() >= CHUNK_SIZE) {
+            chunks.push_back(make_shared<Chunk>());
+            chunks.back()->shapes.reserve(CHUNK_SIZE);
+            starts.push_back(count);
+        }
+        writable(chunks.size() - 1).shapes.push_back(unique_ptr<Shape>(s));
+        count++;
+    }
+
+    // Return the number of shapes in the list
+    int size() const {
+        return static_cast<int>(count);
+    }
+
+    // Return the shape at a position for reading, or nullptr
+    const Shape* getShape(int pos) const {
+        size_t c, offset;
+        if (!locate(pos, c, offset)) {
+            cout << "Warning: Invalid position in getShape(). Returning nullptr." << endl;
+            return nullptr;
+        }
+        return chunks[c]->shapes[offset].get();
+    }
+
+    // Remove the shape at a position and return it (caller is responsible for deletion)
+    Shape* removeShape(int pos) {
+        size_t c, offset;
+        if (!locate(pos, c, offset)) {
+            cout << "Warning: Invalid position in removeShape()." << endl;
+            return nullptr;
+        }
+        Chunk& chunk = writable(c);
+        Shape* removed = chunk.shapes[offset].release();
+        chunk.shapes.erase(chunk.shapes.begin() + offset);
+        count--;
+        mergeAround(c);
+        return removed;
+    }
+
+    // Return the area of the shape at a position, or -1.0
+    double area(int pos) const {
+        const Shape* s = getShape(pos);
+        return s != nullptr ? s->getArea() : -1.0;
+    }
+
+    // Return the perimeter of the shape at a position, or -1.0
+    double perimeter(int pos) const {
+        const Shape* s = getShape(pos);
+        return s != nullptr ? s->getPerimeter() : -1.0;
+    }
+
+    // Translate all shapes by (dx, dy); chunks shared with a snapshot are cloned first
+    void translateShapes(int dx, int dy) {
+        for (size_t c = 0; c < chunks.size(); ++c) {
+            for (unique_ptr<Shape>& s : writable(c).shapes) {
+                s->translate(dx, dy);
+            }
+        }
+    }
+
+    // Scale all shapes; chunks shared with a snapshot are cloned first
+    void scale(int factor, bool sign) {
+        for (size_t c = 0; c < chunks.size(); ++c) {
+            for (unique_ptr<Shape>& s : writable(c).shapes) {
+                s->scale(factor, sign);
+            }
+        }
+    }
+
+    // Return an immutable view of the current shapes
+    Snapshot snapshot() {
+        Snapshot view;
+        view.chunks.reserve(chunks.size());
+        for (shared_ptr<Chunk>& chunk : chunks) {
+            if (!chunk->warm) {
+                warmUp(*chunk);
+            }
+            view.chunks.push_back(chunk);
+        }
+        view.starts = starts;
+        view.count = count;
+        return view;
+    }
+
+    // Return the number of chunks a snapshot taken now would share
+    size_t chunkCount() const {
+        return chunks.size();
+    }
+
+    // Display information about all shapes
+    string display() {
+        return snapshot().display();
+    }
+};
+
+
+// ==============================
+// Test function for CowShapeList class
+// ==============================
+void test_cow_shape_list_class() {
+    cout << "\n========== Running test_cow_shape_list_class() ==========" << endl;
+
+    int passed = 0, failed = 0;
+
+    // Test 1: A snapshot keeps the shapes it saw while the list changes
+    CowShapeList list;
+    for (int i = 0; i < 1200; ++i) {
+        list.addShape(new Square(Coordinates(i, i), 2.0));
+    }
+    list.addShape(new Circle(Coordinates(5, 5), 1.0));
+    CowShapeList::Snapshot before = list.snapshot();
+    string shown = before.display();
+    list.translateShapes(10, 0);
+    delete list.removeShape(0);
+    list.addShape(new Rectangle(Coordinates(1, 1), 3, 4));
+    CowShapeList::Snapshot after = list.snapshot();
+    if (before.size() == 1201 && before.getShape(0)->getCoordinates().getX() == 0 &&
+        before.display() == shown && before.aggregates().countOf(ShapeKind::Circle) == 1 &&
+        after.size() == 1201 && after.getShape(0)->getCoordinates().getX() == 11 &&
+        after.getShape(1200)->getKind() == ShapeKind::Rectangle && list.area(1200) == 12.0 &&
+        list.display() == after.display()) {
+        cout << "Test 1 passed: Snapshot isolation" << endl;
+        passed++;
+    } else {
+        cout << "Test 1 FAILED: Snapshot isolation" << endl;
+        failed++;
+    }
+
+    // Test 2: Readers on other threads see consistent versions while a writer keeps going
+    CowShapeList live;
+    for (int i = 0; i < 2000; ++i) {
+        live.addShape(new Square(Coordinates(i % 100, i / 100), 1.0));
+    }
+    mutex lock;
+    CowShapeList::Snapshot latest = live.snapshot();
+    atomic<bool> done(false);
+    atomic<int> inconsistent(0), reads(0);
+    vector<thread> readers;
+    for (int r = 0; r < 2; ++r) {
+        readers.emplace_back([&]() {
+            while (!done) {
+                CowShapeList::Snapshot view;
+                {
+                    lock_guard<mutex> guard(lock);
+                    view = latest;
+                }
+                // Every square has side 1 and every version is translated as a whole
+                SceneAggregates totals = view.aggregates();
+                int x0 = view.getShape(0)->getCoordinates().getX();
+                if (totals.totalArea() != static_cast<double>(view.size()) ||
+                    view.getShape(view.size() - 1)->getCoordinates().getX() - x0 != 99) {
+                    inconsistent++;
+                }
+                reads++;
+            }
+        });
+    }
+    for (int step = 0; step < 200 || reads < 10; ++step) {
+        live.translateShapes(1, 0);
+        if (step % 10 == 0) {
+            live.addShape(new Square(Coordinates(99 + step + 1, 0), 1.0));
+            delete live.removeShape(live.size() - 1);
+        }
+        CowShapeList::Snapshot next = live.snapshot();
+        lock_guard<mutex> guard(lock);
+        latest = next;
+    }
+    done = true;
+    for (thread& t : readers) {
+        t.join();
+    }
+    if (inconsistent == 0 && reads >= 10 && latest.getShape(0)->getCoordinates().getX() >= 200) {
+        cout << "Test 2 passed: Concurrent readers" << endl;
+        passed++;
+    } else {
+        cout << "Test 2 FAILED: Concurrent readers" << endl;
+        failed++;
+    }
+
+    // Test 3: Interleaved adds, removals and snapshots keep the chunks few and full
+    CowShapeList ingest;
+    vector<CowShapeList::Snapshot> reports;
+    for (int i = 0; i < 3000; ++i) {
+        ingest.addShape(new Square(Coordinates(i, 0), 1.0));
+        reports.push_back(ingest.snapshot());
+    }
+    size_t afterAdds = ingest.chunkCount();
+    for (int i = 0; i < 1500; ++i) {
+        delete ingest.removeShape((i * 7919) % ingest.size());
+        reports.push_back(ingest.snapshot());
+    }
+    bool ordered = true;
+    for (int i = 1; i < ingest.size(); ++i) {
+        ordered = ordered && ingest.getShape(i - 1)->getCoordinates().getX() < ingest.getShape(i)->getCoordinates().getX();
+    }
+    const CowShapeList::Snapshot& first = reports[0];
+    const CowShapeList::Snapshot& middle = reports[2999];
+    if (afterAdds == 6 && ingest.chunkCount() <= 2 * 1500 / 512 + 1 && ordered && ingest.size() == 1500 &&
+        first.size() == 1 && middle.size() == 3000 && middle.getShape(2999)->getCoordinates().getX() == 2999 &&
+        reports.back().getShape(1499) == ingest.getShape(1499)) {
+        cout << "Test 3 passed: Chunks stay full under interleaving" << endl;
+        passed++;
+    } else {
+        cout << "Test 3 FAILED: Chunks stay full under interleaving" << endl;
+        failed++;
+    }
+
+    // Summary
+    cout << "========== Test Summary ==========" << endl;
+    cout << "Passed: " << passed << ", Failed: " << failed << endl;
+    cout << "==================================\n" << endl;
+}
+
+
+// ==============================
+// ConcurrentShapeList Class
+// ==============================
+// Shape list for many reader threads and serialized writers. Readers never
+// block: a read enters the current epoch by bumping a per-thread-sharded
+// counter, loads the published table, reads it and leaves. Writers take a
+// mutex and never change a shape or table that readers may hold; they
+// publish a new table (new shapes for a transform) and retire the old
+// one. Retired memory is freed after a grace period: the writer flips the
+// epoch twice and waits each time for the readers of the previous parity
+// to leave, so no reader can still see it.
+//
+// Shapes are published with their area, perimeter and box already cached,
+// so reading a shape never writes to it.
+
+class ConcurrentShapeList {
+private:
+    static constexpr int READER_SHARDS = 16;     // Reader counters, one cache line each
+    static constexpr size_t RECLAIM_BATCH = 256;  // Retired objects that trigger a grace period
+
+    // Published shape pointers. Slots below count are immutable; an add fills
+    // the next slot and then releases the new count, so readers never see a
+    // half-written slot. A table that is full or loses a shape is replaced.
+    struct Table {
+        vector<Shape*> slots;
+        atomic<size_t> count;
+
+        Table(size_t capacity, size_t used) : slots(capacity, nullptr), count(used) {}
+    };
+
+    struct alignas(64) ReaderCount {
+        atomic<long> active{0};
+    };
+
+    atomic<Table*> table;
+    atomic<uint64_t> epoch{0};
+    ReaderCount readers[2][READER_SHARDS];  // [epoch parity][shard]
+
+    mutex writeLock;                 // Serializes writers
+    vector<Table*> retiredTables;    // Waiting for a grace period
+    vector<Shape*> retiredShapes;
+
+    // Spread reader threads over the counters so they do not share a cache line
+    static int readerShard() {
+        static atomic<int> nextShard(0);
+        thread_local int shard = nextShard++ % READER_SHARDS;
+        return shard;
+    }
+
+    // Marks the calling thread as reading for its lifetime (wait-free)
+    class ReadSection {
+    private:
+        ConcurrentShapeList& list;
+        int parity;
+        int shard;
+
+    public:
+        explicit ReadSection(ConcurrentShapeList& owner)
+            : list(owner), parity(static_cast<int>(owner.epoch.load() & 1)), shard(readerShard()) {
+            list.readers[parity][shard].active.fetch_add(1);
+        }
+
+        ~ReadSection() {
+            list.readers[parity][shard].active.fetch_sub(1);
+        }
+
+        ReadSection(const ReadSection&) = delete;
+        ReadSection& operator=(const ReadSection&) = delete;
+    };
+
+    // Fill a shape's memoized values before readers can see it
+    static void warmUp(Shape* s) {
+        s->getArea();
+        s->getPerimeter();
+        s->getBoundingBox();
+    }
+
+    // Wait until no reader can hold anything retired before this call.
+    // A reader may have loaded the epoch just before a flip and counted
+    // itself under the old parity afterwards, so both parities are drained.
+    void synchronize() {
+        for (int phase = 0; phase < 2; ++phase) {
+            int parity = static_cast<int>(epoch.fetch_add(1) & 1);
+            for (;;) {
+                long active = 0;
+                for (int s = 0; s < READER_SHARDS; ++s) {
+                    active += readers[parity][s].active.load();
+                }
+                if (active == 0) {
+                    break;
+                }
+                this_thread::yield();
+            }
+        }
+    }
+
+    // Free the retired objects once a batch has built up (writer lock held)
+    void reclaimIfNeeded() {
+        if (retiredTables.size() + retiredShapes.size() >= RECLAIM_BATCH) {
+            reclaimLocked();
+        }
+    }
+
+    void reclaimLocked() {
+        if (retiredTables.empty() && retiredShapes.empty()) {
+            return;
+        }
+        synchronize();
+        for (Table* t : retiredTables) {
+            delete t;
+        }
+        for (Shape* s : retiredShapes) {
+            delete s;
+        }
+        retiredTables.clear();
+        retiredShapes.clear();
+    }
+
+    // Publish a replacement table and retire the old one (writer lock held)
+    void publish(Table* next) {
+        Table* old = table.exchange(next);
+        retiredTables.push_back(old);
+    }
+
+    // Replace every shape by a transformed copy (writer lock held)
+    void transformAll(const function<void(Shape*)>& fn) {
+        Table* current = table.load();
+        size_t count = current->count.load();
+        Table* next = new Table(max(current->slots.size(), static_cast<size_t>(1)), count);
+        for (size_t i = 0; i < count; ++i) {
+            Shape* copy = current->slots[i]->clone();
+            fn(copy);
+            warmUp(copy);
+            next->slots[i] = copy;
+            retiredShapes.push_back(current->slots[i]);
+        }
+        publish(next);
+        reclaimIfNeeded();
+    }
+
+public:
+    ConcurrentShapeList() : table(new Table(16, 0)) {}
+
+    ConcurrentShapeList(const ConcurrentShapeList&) = delete;
+    ConcurrentShapeList& operator=(const ConcurrentShapeList&) = delete;
+
+    // Add a heap-allocated shape (the list takes ownership)
+    void addShape(Shape* s) {
+        if (s == nullptr) {
+            cout << "Warning: Cannot add a null shape." << endl;
+            return;
+        }
+        warmUp(s);
+        lock_guard<mutex> lock(writeLock);
+        Table* current = table.load();
+        size_t count = current->count.load();
+        if (count < current->slots.size()) {
+            current->slots[count] = s;
+            current->count.store(count + 1);
+            return;
+        }
+        Table* next = new Table(current->slots.size() * 2, count + 1);
+        copy(current->slots.begin(), current->slots.begin() + count, next->slots.begin());
+        next->slots[count] = s;
+        publish(next);
+        reclaimIfNeeded();
+    }
+
+    // Remove the shape at a position and return a copy of it (caller is
+    // responsible for deletion); the original is freed once no reader holds it
+    Shape* removeShape(int pos) {
+        lock_guard<mutex> lock(writeLock);
+        Table* current = table.load();
+        size_t count = current->count.load();
+        if (pos < 0 || static_cast<size_t>(pos) >= count) {
+            cout << "Warning: Invalid position in removeShape()." << endl;
+            return nullptr;
+        }
+        Shape* removed = current->slots[pos];
+        Table* next = new Table(current->slots.size(), count - 1);
+        copy(current->slots.begin(), current->slots.begin() + pos, next->slots.begin());
+        copy(current->slots.begin() + pos + 1, current->slots.begin() + count, next->slots.begin() + pos);
+        publish(next);
+        retiredShapes.push_back(removed);
+        Shape* copy = removed->clone();
+        reclaimIfNeeded();
+        return copy;
+    }
+
+    // Translate all shapes by (dx, dy); readers keep the previous shapes until they finish
     void translateShapes(int dx, int dy) {
-        for (Shape* s : listofShapes) {
-            if (s != nullptr) {
-                s->translate(dx, dy);
+        lock_guard<mutex> lock(writeLock);
+        transformAll([dx, dy](Shape* s) { s->translate(dx, dy); });
+    }
+
+    // Scale all shapes; readers keep the previous shapes until they finish
+    void scale(int factor, bool sign) {
+        lock_guard<mutex> lock(writeLock);
+        transformAll([factor, sign](Shape* s) { s->scale(factor, sign); });
+    }
+
+    // Free every retired shape and table now, waiting for the readers that may hold them
+    void reclaim() {
+        lock_guard<mutex> lock(writeLock);
+        reclaimLocked();
+    }
+
+    // Return the number of retired shapes and tables not yet freed
+    size_t awaitingReclaim() {
+        lock_guard<mutex> lock(writeLock);
+        return retiredTables.size() + retiredShapes.size();
+    }
+
+    // Return the number of shapes in the list
+    int size() {
+        ReadSection section(*this);
+        return static_cast<int>(table.load()->count.load());
+    }
+
+    // Call fn with the shape at a position and return true, or return false
+    // for an invalid position. The shape must not be kept after fn returns.
+    bool readShape(int pos, const function<void(const Shape&)>& fn) {
+        ReadSection section(*this);
+        Table* current = table.load();
+        if (pos < 0 || static_cast<size_t>(pos) >= current->count.load()) {
+            return false;
+        }
+        fn(*current->slots[pos]);
+        return true;
+    }
+
+    // Return the area of the shape at a given position, or -1.0
+    double area(int pos) {
+        double result = -1.0;
+        readShape(pos, [&result](const Shape& s) { result = s.getArea(); });
+        return result;
+    }
+
+    // Return the perimeter of the shape at a given position, or -1.0
+    double perimeter(int pos) {
+        double result = -1.0;
+        readShape(pos, [&result](const Shape& s) { result = s.getPerimeter(); });
+        return result;
+    }
+
+    // Display information about all shapes, laid out as ShapeList::display();
+    // every shape comes from the same version of the list
+    string display() {
+        string result;
+        {
+            ShapeWriter out(result);
+            ReadSection section(*this);
+            Table* current = table.load();
+            size_t count = current->count.load();
+            out << "--- Shape List ---\n\n";
+            for (size_t i = 0; i < count; ++i) {
+                out << "Shape " << i + 1 << ": ";
+                current->slots[i]->write(out);
+                out << "\n\n";
+            }
+        }
+        return result;
+    }
+
+    // Destructor: no reader may be running any more
+    ~ConcurrentShapeList() {
+        Table* current = table.load();
+        for (size_t i = 0; i < current->count.load(); ++i) {
+            delete current->slots[i];
+        }
+        delete current;
+        for (Table* t : retiredTables) {
+            delete t;
+        }
+        for (Shape* s : retiredShapes) {
+            delete s;
+        }
+    }
+};
+
+
+// ==============================
+// Test function for ConcurrentShapeList class
+// ==============================
+void test_concurrent_shape_list_class() {
+    cout << "\n========== Running test_concurrent_shape_list_class() ==========" << endl;
+
+    int passed = 0, failed = 0;
+
+    // Test 1: Same results as ShapeList; removed shapes wait for reclamation
+    ConcurrentShapeList list;
+    ShapeList plain;
+    for (int i = 0; i < 40; ++i) {
+        list.addShape(new Circle(Coordinates(i, 2 * i), 1.0 + i));
+        plain.addShape(new Circle(Coordinates(i, 2 * i), 1.0 + i));
+    }
+    list.translateShapes(3, 1);
+    plain.translateShapes(3, 1);
+    Shape* removed = list.removeShape(5);
+    delete plain.removeShape(5);
+    size_t waiting = list.awaitingReclaim();
+    list.reclaim();
+    if (removed != nullptr && removed->getCoordinates().getX() == 8 && list.size() == 39 &&
+        list.area(5) == plain.area(5) && list.perimeter(38) == plain.perimeter(38) && list.area(39) == -1.0 &&
+        list.display() == plain.display() && waiting > 0 && list.awaitingReclaim() == 0) {
+        cout << "Test 1 passed: Single-threaded behaviour" << endl;
+        passed++;
+    } else {
+        cout << "Test 1 FAILED: Single-threaded behaviour" << endl;
+        failed++;
+    }
+    delete removed;
+
+    // Test 2: Readers run against a writer that adds, removes and translates
+    ConcurrentShapeList live;
+    for (int i = 0; i < 300; ++i) {
+        live.addShape(new Square(Coordinates(i, 0), 1.0));
+    }
+    atomic<bool> done(false);
+    atomic<int> bad(0), reads(0);
+    vector<thread> readers;
+    for (int r = 0; r < 3; ++r) {
+        readers.emplace_back([&live, &done, &bad, &reads, r]() {
+            while (!done) {
+                int n = live.size();
+                double a = live.area((n + r) / 2);
+                if (a != 1.0 && a != -1.0) {
+                    bad++;
+                }
+                // One display is one version: as many squares as numbered shapes
+                string shown = live.display();
+                size_t shapes = 0, squares = 0;
+                for (size_t at = shown.find("\n\nShape "); at != string::npos; at = shown.find("\n\nShape ", at + 1)) {
+                    shapes++;
+                }
+                for (size_t at = shown.find("Square"); at != string::npos; at = shown.find("Square", at + 1)) {
+                    squares++;
+                }
+                if (shapes != squares) {
+                    bad++;
+                }
+                reads++;
+            }
+        });
+    }
+    for (int step = 0; step < 300 || reads < 30; ++step) {
+        live.addShape(new Square(Coordinates(step, 1), 1.0));
+        delete live.removeShape(step % 50);
+        if (step % 25 == 0) {
+            live.translateShapes(1, 0);
+        }
+    }
+    done = true;
+    for (thread& t : readers) {
+        t.join();
+    }
+    live.reclaim();
+    if (bad == 0 && reads >= 30 && live.size() == 300 && live.awaitingReclaim() == 0) {
+        cout << "Test 2 passed: Concurrent readers and writer" << endl;
+        passed++;
+    } else {
+        cout << "Test 2 FAILED: Concurrent readers and writer" << endl;
+        failed++;
+    }
+
+    // Summary
+    cout << "========== Test Summary ==========" << endl;
+    cout << "Passed: " << passed << ", Failed: " << failed << endl;
+    cout << "==================================\n" << endl;
+}
+
+
+// ==============================
+// ShapeSnapshot Class
+// ==============================
+// Fixed-layout binary file holding a whole shape list, designed to be
+// mmap'ed and read in place. Layout (native byte order):
+//
+//   Header                      magic, version, counts, section offsets and checksums
+//   OrderRecord[shapeCount]     list position -> (kind, row)
+//   RectangleRecord[...]        one typed section per shape kind,
+//   SquareRecord[...]           each starting on a 64-byte boundary
+//   CircleRecord[...]
+//   TriangleRecord[...]
+class ShapeSnapshot {
+public:
+    static constexpr uint32_t VERSION = 1;
+    static constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+    static constexpr size_t SECTION_ALIGNMENT = 64;
+
+    // Section numbers: the order table, then one section per ShapeKind
+    enum Section { ORDER = 0, RECTANGLES = 1, SQUARES = 2, CIRCLES = 3, TRIANGLES = 4, SECTION_COUNT = 5 };
+
+    struct Header {
+        char magic[8];                      // "SHAPESNP"
+        uint32_t version;
+        uint32_t byteOrder;                 // BYTE_ORDER_MARK as written by the saving machine
+        uint64_t shapeCount;
+        uint64_t counts[SECTION_COUNT];     // Records per section
+        uint64_t offsets[SECTION_COUNT];    // Byte offset of each section
+        uint64_t checksums[SECTION_COUNT];  // FNV-1a of each section
+        uint64_t headerChecksum;            // FNV-1a of every field above
+    };
+
+    struct OrderRecord {
+        uint32_t kind;  // ShapeKind value
+        uint32_t row;   // Record index inside that kind's section
+    };
+
+    struct RectangleRecord {
+        int32_t x, y;
+        double width, length;
+    };
+
+    struct SquareRecord {
+        int32_t x, y;
+        double side;
+    };
+
+    struct CircleRecord {
+        int32_t x, y;
+        double radius;
+    };
+
+    // x, y is the base Shape position, kept apart from the vertices as Triangle does
+    struct TriangleRecord {
+        int32_t x, y;
+        int32_t x1, y1, x2, y2, x3, y3;
+    };
+
+    // 64-bit FNV-1a hash
+    static uint64_t checksum(const void* data, size_t size) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        uint64_t hash = 14695981039346656037ULL;
+        for (size_t i = 0; i < size; ++i) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    // Write every shape of a ShapeList (pending transforms are applied first)
+    static bool save(ShapeList& list, const string& path) {
+        list.flush();
+        vector<OrderRecord> order;
+        vector<RectangleRecord> rectangles;
+        vector<SquareRecord> squares;
+        vector<CircleRecord> circles;
+        vector<TriangleRecord> triangles;
+        order.reserve(list.size());
+        for (int i = 0; i < list.size(); ++i) {
+            Shape* s = list.listofShapes[i];  // Up to date after flush()
+            Coordinates c = s->getCoordinates();
+            switch (s->getKind()) {
+                case ShapeKind::Rectangle: {
+                    Rectangle* r = static_cast<Rectangle*>(s);
+                    order.push_back(OrderRecord{RECTANGLES - 1, static_cast<uint32_t>(rectangles.size())});
+                    rectangles.push_back(RectangleRecord{c.getX(), c.getY(), r->getWidth(), r->getLength()});
+                    break;
+                }
+                case ShapeKind::Square:
+                    order.push_back(OrderRecord{SQUARES - 1, static_cast<uint32_t>(squares.size())});
+                    squares.push_back(SquareRecord{c.getX(), c.getY(), static_cast<Square*>(s)->getSide()});
+                    break;
+                case ShapeKind::Circle:
+                    order.push_back(OrderRecord{CIRCLES - 1, static_cast<uint32_t>(circles.size())});
+                    circles.push_back(CircleRecord{c.getX(), c.getY(), static_cast<Circle*>(s)->getRadius()});
+                    break;
+                case ShapeKind::Triangle: {
+                    Triangle* t = static_cast<Triangle*>(s);
+                    order.push_back(OrderRecord{TRIANGLES - 1, static_cast<uint32_t>(triangles.size())});
+                    triangles.push_back(TriangleRecord{c.getX(), c.getY(),
+                        t->getPosition1().getX(), t->getPosition1().getY(),
+                        t->getPosition2().getX(), t->getPosition2().getY(),
+                        t->getPosition3().getX(), t->getPosition3().getY()});
+                    break;
+                }
+            }
+        }
+        return write(path, order, rectangles, squares, circles, triangles);
+    }
+
+    // Write every shape of a ColumnarShapeList
+    static bool save(const ColumnarShapeList& list, const string& path) {
+        vector<OrderRecord> order;
+        vector<RectangleRecord> rectangles(list.rectangles.x.size());
+        vector<SquareRecord> squares(list.squares.x.size());
+        vector<CircleRecord> circles(list.circles.x.size());
+        vector<TriangleRecord> triangles(list.triangles.x.size());
+        order.reserve(list.order.size());
+        for (const ColumnarShapeList::Entry& e : list.order) {
+            order.push_back(OrderRecord{static_cast<uint32_t>(e.kind), static_cast<uint32_t>(e.row)});
+        }
+        for (size_t i = 0; i < rectangles.size(); ++i) {
+            rectangles[i] = RectangleRecord{list.rectangles.x[i], list.rectangles.y[i],
+                                            list.rectangles.width[i], list.rectangles.length[i]};
+        }
+        for (size_t i = 0; i < squares.size(); ++i) {
+            squares[i] = SquareRecord{list.squares.x[i], list.squares.y[i], list.squares.side[i]};
+        }
+        for (size_t i = 0; i < circles.size(); ++i) {
+            circles[i] = CircleRecord{list.circles.x[i], list.circles.y[i], list.circles.radius[i]};
+        }
+        const ColumnarShapeList::TriangleColumns& t = list.triangles;
+        for (size_t i = 0; i < triangles.size(); ++i) {
+            triangles[i] = TriangleRecord{t.x[i], t.y[i], t.x1[i], t.y1[i], t.x2[i], t.y2[i], t.x3[i], t.y3[i]};
+        }
+        return write(path, order, rectangles, squares, circles, triangles);
+    }
+
+private:
+    static uint64_t align(uint64_t offset) {
+        return (offset + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+    }
+
+    static bool write(const string& path, const vector<OrderRecord>& order,
+                      const vector<RectangleRecord>& rectangles, const vector<SquareRecord>& squares,
+                      const vector<CircleRecord>& circles, const vector<TriangleRecord>& triangles) {
+        const void* sections[SECTION_COUNT] = {order.data(), rectangles.data(), squares.data(),
+                                               circles.data(), triangles.data()};
+        uint64_t sizes[SECTION_COUNT] = {order.size() * sizeof(OrderRecord),
+                                         rectangles.size() * sizeof(RectangleRecord),
+                                         squares.size() * sizeof(SquareRecord),
+                                         circles.size() * sizeof(CircleRecord),
+                                         triangles.size() * sizeof(TriangleRecord)};
+        Header header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, "SHAPESNP", 8);
+        header.version = VERSION;
+        header.byteOrder = BYTE_ORDER_MARK;
+        header.shapeCount = order.size();
+        header.counts[ORDER] = order.size();
+        header.counts[RECTANGLES] = rectangles.size();
+        header.counts[SQUARES] = squares.size();
+        header.counts[CIRCLES] = circles.size();
+        header.counts[TRIANGLES] = triangles.size();
+        uint64_t offset = align(sizeof(Header));
+        for (int i = 0; i < SECTION_COUNT; ++i) {
+            header.offsets[i] = offset;
+            header.checksums[i] = checksum(sections[i], sizes[i]);
+            offset = align(offset + sizes[i]);
+        }
+        header.headerChecksum = checksum(&header, offsetof(Header, headerChecksum));
+
+        ofstream out(path, ios::binary | ios::trunc);
+        if (!out) {
+            cout << "Warning: Cannot open snapshot file " << path << " for writing." << endl;
+            return false;
+        }
+        static const char padding[SECTION_ALIGNMENT] = {};
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        uint64_t written = sizeof(header);
+        for (int i = 0; i < SECTION_COUNT; ++i) {
+            out.write(padding, header.offsets[i] - written);
+            out.write(static_cast<const char*>(sections[i]), sizes[i]);
+            written = header.offsets[i] + sizes[i];
+        }
+        out.write(padding, align(written) - written);
+        if (!out) {
+            cout << "Warning: Failed to write snapshot file " << path << "." << endl;
+            return false;
+        }
+        return true;
+    }
+};
+
+// ==============================
+// MappedShapeSnapshot Class
+// ==============================
+// Read-only view of a snapshot file. The file is mmap'ed where the
+// platform allows it (and read into memory otherwise); the typed
+// sections are then used in place without any parsing. open() checks the
+// header and walks the order table, so a loaded file never points two
+// shapes at one row.
+class MappedShapeSnapshot {
+private:
+    const unsigned char* data = nullptr;
+    size_t length = 0;
+    bool mapped = false;           // True when data comes from mmap()
+    vector<unsigned char> buffer;  // Fallback storage when mmap is unavailable
+
+    const ShapeSnapshot::Header& header() const {
+        return *reinterpret_cast<const ShapeSnapshot::Header*>(data);
+    }
+
+    template <typename Record>
+    const Record* section(int index) const {
+        return reinterpret_cast<const Record*>(data + header().offsets[index]);
+    }
+
+    // Check the header and that every section lies inside the file
+    bool validate(bool verifyChecksums) const {
+        if (length < sizeof(ShapeSnapshot::Header) || memcmp(header().magic, "SHAPESNP", 8) != 0) {
+            cout << "Warning: Not a shape snapshot file." << endl;
+            return false;
+        }
+        const ShapeSnapshot::Header& h = header();
+        if (h.version != ShapeSnapshot::VERSION || h.byteOrder != ShapeSnapshot::BYTE_ORDER_MARK) {
+            cout << "Warning: Unsupported snapshot version or byte order." << endl;
+            return false;
+        }
+        if (ShapeSnapshot::checksum(&h, offsetof(ShapeSnapshot::Header, headerChecksum)) != h.headerChecksum) {
+            cout << "Warning: Snapshot header checksum mismatch." << endl;
+            return false;
+        }
+        const uint64_t recordSizes[ShapeSnapshot::SECTION_COUNT] = {
+            sizeof(ShapeSnapshot::OrderRecord), sizeof(ShapeSnapshot::RectangleRecord),
+            sizeof(ShapeSnapshot::SquareRecord), sizeof(ShapeSnapshot::CircleRecord),
+            sizeof(ShapeSnapshot::TriangleRecord)};
+        uint64_t total = 0;
+        for (int i = 0; i < ShapeSnapshot::SECTION_COUNT; ++i) {
+            // Compare by division so a forged count cannot wrap the byte size
+            if (h.offsets[i] % ShapeSnapshot::SECTION_ALIGNMENT != 0 || h.offsets[i] > length ||
+                h.counts[i] > (length - h.offsets[i]) / recordSizes[i]) {
+                cout << "Warning: Snapshot section " << i << " lies outside the file." << endl;
+                return false;
+            }
+            uint64_t bytes = h.counts[i] * recordSizes[i];
+            if (verifyChecksums && ShapeSnapshot::checksum(data + h.offsets[i], bytes) != h.checksums[i]) {
+                cout << "Warning: Snapshot section " << i << " checksum mismatch." << endl;
+                return false;
+            }
+            if (i > 0) {
+                if (h.counts[i] > h.shapeCount - total) {
+                    cout << "Warning: Snapshot shape counts are inconsistent." << endl;
+                    return false;
+                }
+                total += h.counts[i];
+            }
+        }
+        if (h.counts[ShapeSnapshot::ORDER] != h.shapeCount || total != h.shapeCount) {
+            cout << "Warning: Snapshot shape counts are inconsistent." << endl;
+            return false;
+        }
+        // The loaders rely on every row of each kind being listed once, in
+        // row order, as save() writes them
+        uint64_t nextRow[4] = {};
+        const ShapeSnapshot::OrderRecord* entries = section<ShapeSnapshot::OrderRecord>(ShapeSnapshot::ORDER);
+        for (uint64_t i = 0; i < h.shapeCount; ++i) {
+            if (entries[i].kind >= 4 || entries[i].row != nextRow[entries[i].kind]) {
+                cout << "Warning: Snapshot entry " << i << " is out of order or repeated." << endl;
+                return false;
+            }
+            nextRow[entries[i].kind]++;
+        }
+        return true;
+    }
+
+public:
+    MappedShapeSnapshot() = default;
+    MappedShapeSnapshot(const MappedShapeSnapshot&) = delete;
+    MappedShapeSnapshot& operator=(const MappedShapeSnapshot&) = delete;
+
+    // Map a snapshot file; section checksums are only verified on request,
+    // since that reads every section
+    bool open(const string& path, bool verifyChecksums = false) {
+        close();
+#if defined(__unix__) || defined(__APPLE__)
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            cout << "Warning: Cannot open snapshot file " << path << "." << endl;
+            return false;
+        }
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0) {
+            void* p = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                data = static_cast<const unsigned char*>(p);
+                length = info.st_size;
+                mapped = true;
+            }
+        }
+        ::close(fd);
+#endif
+        if (!mapped) {
+            ifstream in(path, ios::binary);
+            if (!in) {
+                cout << "Warning: Cannot open snapshot file " << path << "." << endl;
+                return false;
+            }
+            buffer.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+            data = buffer.data();
+            length = buffer.size();
+        }
+        if (!validate(verifyChecksums)) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    // Unmap the file
+    void close() {
+#if defined(__unix__) || defined(__APPLE__)
+        if (mapped) {
+            munmap(const_cast<unsigned char*>(data), length);
+        }
+#endif
+        data = nullptr;
+        length = 0;
+        mapped = false;
+        buffer.clear();
+    }
+
+    // Getters for the typed sections, valid while the snapshot stays open
+    size_t shapeCount() const { return data ? header().shapeCount : 0; }
+    size_t rectangleCount() const { return data ? header().counts[ShapeSnapshot::RECTANGLES] : 0; }
+    size_t squareCount() const { return data ? header().counts[ShapeSnapshot::SQUARES] : 0; }
+    size_t circleCount() const { return data ? header().counts[ShapeSnapshot::CIRCLES] : 0; }
+    size_t triangleCount() const { return data ? header().counts[ShapeSnapshot::TRIANGLES] : 0; }
+    const ShapeSnapshot::OrderRecord* order() const { return section<ShapeSnapshot::OrderRecord>(ShapeSnapshot::ORDER); }
+    const ShapeSnapshot::RectangleRecord* rectangles() const { return section<ShapeSnapshot::RectangleRecord>(ShapeSnapshot::RECTANGLES); }
+    const ShapeSnapshot::SquareRecord* squares() const { return section<ShapeSnapshot::SquareRecord>(ShapeSnapshot::SQUARES); }
+    const ShapeSnapshot::CircleRecord* circles() const { return section<ShapeSnapshot::CircleRecord>(ShapeSnapshot::CIRCLES); }
+    const ShapeSnapshot::TriangleRecord* triangles() const { return section<ShapeSnapshot::TriangleRecord>(ShapeSnapshot::TRIANGLES); }
+
+    // Append every shape to a ShapeList, built in the list's arena
+    void loadInto(ShapeList& list) const {
+        for (size_t i = 0; i < shapeCount(); ++i) {
+            const ShapeSnapshot::OrderRecord& e = order()[i];
+            switch (static_cast<ShapeKind>(e.kind)) {
+                case ShapeKind::Rectangle: {
+                    const ShapeSnapshot::RectangleRecord& r = rectangles()[e.row];
+                    list.createShape<Rectangle>(Coordinates(r.x, r.y), r.width, r.length);
+                    break;
+                }
+                case ShapeKind::Square: {
+                    const ShapeSnapshot::SquareRecord& r = squares()[e.row];
+                    list.createShape<Square>(Coordinates(r.x, r.y), r.side);
+                    break;
+                }
+                case ShapeKind::Circle: {
+                    const ShapeSnapshot::CircleRecord& r = circles()[e.row];
+                    list.createShape<Circle>(Coordinates(r.x, r.y), r.radius);
+                    break;
+                }
+                case ShapeKind::Triangle: {
+                    const ShapeSnapshot::TriangleRecord& r = triangles()[e.row];
+                    Triangle* t = list.createShape<Triangle>(Coordinates(r.x1, r.y1), Coordinates(r.x2, r.y2),
+                                                             Coordinates(r.x3, r.y3));
+                    t->setCoordinates(Coordinates(r.x, r.y));
+                    break;
+                }
+            }
+        }
+    }
+
+    // Replace the content of a ColumnarShapeList with a bulk copy of the sections
+    void loadInto(ColumnarShapeList& list) const {
+        list = ColumnarShapeList();
+        list.order.reserve(shapeCount());
+        for (size_t i = 0; i < shapeCount(); ++i) {
+            const ShapeSnapshot::OrderRecord& e = order()[i];
+            list.order.push_back(ColumnarShapeList::Entry{static_cast<ShapeKind>(e.kind), static_cast<int>(e.row)});
+        }
+        for (size_t i = 0; i < rectangleCount(); ++i) {
+            const ShapeSnapshot::RectangleRecord& r = rectangles()[i];
+            list.rectangles.x.push_back(r.x);
+            list.rectangles.y.push_back(r.y);
+            list.rectangles.width.push_back(r.width);
+            list.rectangles.length.push_back(r.length);
+        }
+        for (size_t i = 0; i < squareCount(); ++i) {
+            const ShapeSnapshot::SquareRecord& r = squares()[i];
+            list.squares.x.push_back(r.x);
+            list.squares.y.push_back(r.y);
+            list.squares.side.push_back(r.side);
+        }
+        for (size_t i = 0; i < circleCount(); ++i) {
+            const ShapeSnapshot::CircleRecord& r = circles()[i];
+            list.circles.x.push_back(r.x);
+            list.circles.y.push_back(r.y);
+            list.circles.radius.push_back(r.radius);
+        }
+        ColumnarShapeList::TriangleColumns& t = list.triangles;
+        for (size_t i = 0; i < triangleCount(); ++i) {
+            const ShapeSnapshot::TriangleRecord& r = triangles()[i];
+            t.x.push_back(r.x); t.y.push_back(r.y);
+            t.x1.push_back(r.x1); t.y1.push_back(r.y1);
+            t.x2.push_back(r.x2); t.y2.push_back(r.y2);
+            t.x3.push_back(r.x3); t.y3.push_back(r.y3);
+        }
+    }
+
+    // Destructor: unmap the file
+    ~MappedShapeSnapshot() {
+        close();
+    }
+};
+
+
+// ==============================
+// Test function for ShapeSnapshot class
+// ==============================
+void test_shape_snapshot_class() {
+    cout << "\n========== Running test_shape_snapshot_class() ==========" << endl;
+
+    int passed = 0, failed = 0;
+    const string path = "shape_snapshot_test.bin";
+
+    ShapeList original;
+    original.createShape<Triangle>(Coordinates(50, 50), Coordinates(20, 70), Coordinates(70, 70));
+    original.createShape<Rectangle>(Coordinates(100, 20), 10.5, 15);
+    original.createShape<Circle>(Coordinates(80, 100), 25);
+    original.createShape<Square>(Coordinates(90, 40), 20);
+    original.createShape<Rectangle>(Coordinates(1, 2), 3, 4);
+    original.translateShapes(5, 5);
+
+    // Test 1: Save and map back into a ShapeList; saving reads the shapes without counting getShape()
+    MappedShapeSnapshot snapshot;
+    ShapeList restored;
+    original.enableStats(true);
+    if (ShapeSnapshot::save(original, path) && original.getStats()->calls(ShapeOperation::GetShape) == 0 &&
+        snapshot.open(path, true) &&
+        snapshot.shapeCount() == 5 && snapshot.rectangleCount() == 2 && snapshot.rectangles()[1].x == 6) {
+        snapshot.loadInto(restored);
+    }
+    if (restored.display() == original.display()) {
+        cout << "Test 1 passed: ShapeList round trip" << endl;
+        passed++;
+    } else {
+        cout << "Test 1 FAILED: ShapeList round trip" << endl;
+        failed++;
+    }
+
+    // Test 2: Columnar lists save and load through the same format
+    ColumnarShapeList columns;
+    snapshot.loadInto(columns);
+    MappedShapeSnapshot again;
+    ColumnarShapeList reloaded;
+    if (ShapeSnapshot::save(columns, path) && again.open(path, true)) {
+        again.loadInto(reloaded);
+    }
+    if (columns.display() == original.display() && reloaded.display() == original.display()) {
+        cout << "Test 2 passed: ColumnarShapeList round trip" << endl;
+        passed++;
+    } else {
+        cout << "Test 2 FAILED: ColumnarShapeList round trip" << endl;
+        failed++;
+    }
+    again.close();
+
+    // Test 3: A corrupted section fails checksum verification
+    {
+        // Flip a byte of the first rectangle's width, which only the checksum covers
+        fstream file(path, ios::in | ios::out | ios::binary);
+        ShapeSnapshot::Header h;
+        if (file.read(reinterpret_cast<char*>(&h), sizeof(h))) {
+            file.seekp(static_cast<streamoff>(h.offsets[ShapeSnapshot::RECTANGLES] + 8));
+            file.put('\x01');
+        }
+    }
+    MappedShapeSnapshot corrupted;
+    bool rejected = !corrupted.open(path, true);
+    bool acceptedUnverified = corrupted.open(path, false);
+    corrupted.close();
+
+    // Test 4: A file that is not a snapshot is rejected
+    {
+        ofstream junk(path, ios::binary | ios::trunc);
+        junk << "not a snapshot";
+    }
+    MappedShapeSnapshot junkSnapshot;
+    if (rejected && acceptedUnverified) {
+        cout << "Test 3 passed: Corrupted section detected" << endl;
+        passed++;
+    } else {
+        cout << "Test 3 FAILED: Corrupted section not detected" << endl;
+        failed++;
+    }
+    if (!junkSnapshot.open(path) && junkSnapshot.shapeCount() == 0) {
+        cout << "Test 4 passed: Invalid file rejected" << endl;
+        passed++;
+    } else {
+        cout << "Test 4 FAILED: Invalid file accepted" << endl;
+        failed++;
+    }
+
+    // Test 5: Forged counts whose byte sizes and total wrap around are rejected
+    bool forged = false;
+    if (ShapeSnapshot::save(original, path)) {
+        fstream file(path, ios::in | ios::out | ios::binary);
+        ShapeSnapshot::Header h;
+        if (file.read(reinterpret_cast<char*>(&h), sizeof(h))) {
+            // 2^61 rectangles and 14 * 2^60 squares add a multiple of 2^64
+            // to both the section sizes and the shape total
+            h.counts[ShapeSnapshot::RECTANGLES] += 1ULL << 61;
+            h.counts[ShapeSnapshot::SQUARES] += 14ULL << 60;
+            h.headerChecksum = ShapeSnapshot::checksum(&h, offsetof(ShapeSnapshot::Header, headerChecksum));
+            file.seekp(0);
+            forged = static_cast<bool>(file.write(reinterpret_cast<const char*>(&h), sizeof(h)));
+        }
+    }
+    MappedShapeSnapshot forgedSnapshot;
+    if (forged && !forgedSnapshot.open(path)) {
+        cout << "Test 5 passed: Forged section counts rejected" << endl;
+        passed++;
+    } else {
+        cout << "Test 5 FAILED: Forged section counts accepted" << endl;
+        failed++;
+    }
+    forgedSnapshot.close();
+
+    // Test 6: An order table that repeats a row is rejected even without checksums
+    bool repeated = false;
+    if (ShapeSnapshot::save(original, path)) {
+        fstream file(path, ios::in | ios::out | ios::binary);
+        ShapeSnapshot::Header h;
+        if (file.read(reinterpret_cast<char*>(&h), sizeof(h))) {
+            // Entry 4 is the second rectangle (row 1); point it at row 0 again
+            ShapeSnapshot::OrderRecord entry{ShapeSnapshot::RECTANGLES - 1, 0};
+            file.seekp(static_cast<streamoff>(h.offsets[ShapeSnapshot::ORDER] + 4 * sizeof(entry)));
+            repeated = static_cast<bool>(file.write(reinterpret_cast<const char*>(&entry), sizeof(entry)));
+        }
+    }
+    MappedShapeSnapshot repeatedSnapshot;
+    if (repeated && !repeatedSnapshot.open(path, false)) {
+        cout << "Test 6 passed: Repeated order entry rejected" << endl;
+        passed++;
+    } else {
+        cout << "Test 6 FAILED: Repeated order entry accepted" << endl;
+        failed++;
+    }
+    remove(path.c_str());
+
+    // Summary
+    cout << "========== Test Summary ==========" << endl;
+    cout << "Passed: " << passed << ", Failed: " << failed << endl;
+    cout << "==================================\n" << endl;
+}
+
+
+// ==============================
+// WriteAheadLog Class
+// ==============================
+// Durable record of every change made to a ShapeList. A change is appended
+// to an in-memory buffer as a framed record (checksum, length, kind,
+// sequence number) and reaches the current log segment in batches:
+//
+//   WalSync::Always    commit() returns once the caller's changes are on
+//                      disk. Concurrent committers share one write and one
+//                      fdatasync: the first one flushes everything buffered
+//                      so far and the others wait for it (group commit).
+//   WalSync::Interval  A background thread flushes and syncs every
+//                      intervalMs, so a crash loses at most that window.
+//   WalSync::None      The buffer is written when it fills and on close;
+//                      the OS decides when it reaches the disk.
+//
+// Once a segment grows past checkpointBytes, the list is saved as a
+// ShapeSnapshot named after the last sequence it holds and a new segment is
+// started, so recovery loads the newest checkpoint and replays at most about
+// one segment. A torn or corrupt record at the end of the log (crash during
+// a write) is cut off; any other damage, or a log that no readable
+// checkpoint covers, makes open() fail without changing the files.
+
+enum class WalSync { None, Interval, Always };
+
+struct WalOptions {
+    WalSync sync = WalSync::Interval;
+    int intervalMs = 2;                       // Flush period for WalSync::Interval
+    uint64_t checkpointBytes = 64ULL << 20;   // Segment size that triggers a checkpoint
+};
+
+#if defined(__unix__) || defined(__APPLE__)
+class WriteAheadLog : public ShapeListLog {
+private:
+    static constexpr size_t WRITE_BATCH = 1 << 16;  // Buffered bytes written at once under WalSync::None
+
+    enum RecordKind : uint32_t { ADD_RECTANGLE = 1, ADD_SQUARE, ADD_CIRCLE, ADD_TRIANGLE, REMOVE, TRANSLATE, SCALE };
+
+    // The checksum comes first so that it covers one contiguous range
+    struct RecordHeader {
+        uint64_t checksum;  // FNV-1a of the rest of the header and the payload
+        uint32_t length;    // Payload bytes
+        uint32_t kind;      // RecordKind
+        uint64_t sequence;  // 1, 2, 3... across segments
+    };
+
+    struct RemoveRecord {
+        int32_t pos;
+    };
+
+    struct TranslateRecord {
+        int32_t dx, dy;
+    };
+
+    struct ScaleRecord {
+        int32_t factor;
+        int32_t sign;
+    };
+
+    string directory;
+    WalOptions options;
+    ShapeList* list = nullptr;  // Attached list
+
+    int fd = -1;                      // Current segment
+    uint64_t segmentBytes = 0;        // Record bytes in the segment, written or not
+    uint64_t checkpointSequence = 0;  // Last sequence held by the newest checkpoint
+    size_t recovered = 0;             // Records replayed by open()
+
+    mutex lock;                  // Guards the members below
+    condition_variable flushed;  // A flush finished
+    condition_variable wake;     // Wakes the interval flusher early (close)
+    string buffer;               // Records not yet written
+    string spare;                // Storage swapped in while a batch is written
+    uint64_t appended = 0;       // Last sequence appended
+    uint64_t durable = 0;        // Last sequence synced to disk
+    bool flushing = false;       // A thread uses the segment outside the lock
+    bool stopping = false;
+    bool failed = false;         // A write or sync failed
+    uint64_t syncs = 0;          // Completed flushes
+    thread flusher;
+
+    static inline thread_local uint64_t lastAppended = 0;  // Last sequence appended by this thread
+
+    string checkpointPath(uint64_t sequence) const {
+        char name[48];
+        snprintf(name, sizeof(name), "/checkpoint-%020llu.snap", static_cast<unsigned long long>(sequence));
+        return directory + name;
+    }
+
+    string segmentPath(uint64_t first) const {
+        char name[48];
+        snprintf(name, sizeof(name), "/wal-%020llu.log", static_cast<unsigned long long>(first));
+        return directory + name;
+    }
+
+    // Collect the sequence numbers in the checkpoint and segment file names, ascending
+    static void listFiles(const string& dir, vector<uint64_t>& checkpoints, vector<uint64_t>& segments) {
+        DIR* d = opendir(dir.c_str());
+        if (d == nullptr) {
+            return;
+        }
+        while (dirent* entry = readdir(d)) {
+            unsigned long long sequence;
+            char tail;
+            if (sscanf(entry->d_name, "checkpoint-%llu.sna%c", &sequence, &tail) == 2 && tail == 'p') {
+                checkpoints.push_back(sequence);
+            } else if (sscanf(entry->d_name, "wal-%llu.lo%c", &sequence, &tail) == 2 && tail == 'g') {
+                segments.push_back(sequence);
+            }
+        }
+        closedir(d);
+        sort(checkpoints.begin(), checkpoints.end());
+        sort(segments.begin(), segments.end());
+    }
+
+    static bool syncFile(int file) {
+#if defined(__APPLE__)
+        return fsync(file) == 0;
+#else
+        return fdatasync(file) == 0;
+#endif
+    }
+
+    // Sync a file or directory by path (a directory sync makes renames durable)
+    static bool syncPath(const string& path) {
+        int file = ::open(path.c_str(), O_RDONLY);
+        if (file < 0) {
+            return false;
+        }
+        bool ok = fsync(file) == 0;
+        ::close(file);
+        return ok;
+    }
+
+    static bool writeAll(int file, const string& data) {
+        size_t done = 0;
+        while (done < data.size()) {
+            ssize_t n = ::write(file, data.data() + done, data.size() - done);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            done += static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    int openSegment(uint64_t first) {
+        int file = ::open(segmentPath(first).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+        if (file < 0) {
+            cout << "Warning: Cannot create log segment " << segmentPath(first) << "." << endl;
+        }
+        return file;
+    }
+
+    // Frame one record into the buffer
+    void append(RecordKind kind, const void* payload, uint32_t length) {
+        lock_guard<mutex> guard(lock);
+        size_t start = buffer.size();
+        RecordHeader h{0, length, kind, ++appended};
+        buffer.append(reinterpret_cast<const char*>(&h), sizeof(h));
+        buffer.append(static_cast<const char*>(payload), length);
+        h.checksum = ShapeSnapshot::checksum(buffer.data() + start + sizeof(h.checksum),
+                                             sizeof(h) - sizeof(h.checksum) + length);
+        memcpy(&buffer[start], &h.checksum, sizeof(h.checksum));
+        segmentBytes += sizeof(h) + length;
+        lastAppended = appended;
+        if (options.sync == WalSync::None && buffer.size() >= WRITE_BATCH && !flushing) {
+            failed = failed || !writeAll(fd, buffer);
+            buffer.clear();
+        }
+    }
+
+    // Write and sync every record up to target. Whoever finds no flush
+    // running writes the whole buffer for everyone; the others wait.
+    void flushTo(unique_lock<mutex>& guard, uint64_t target) {
+        while (durable < target && !failed) {
+            if (flushing) {
+                flushed.wait(guard);
+                continue;
+            }
+            flushing = true;
+            string batch;
+            batch.swap(buffer);
+            buffer.swap(spare);
+            uint64_t last = appended;
+            guard.unlock();
+            bool ok = writeAll(fd, batch) && syncFile(fd);
+            guard.lock();
+            batch.clear();
+            spare.swap(batch);
+            flushing = false;
+            syncs++;
+            if (ok) {
+                durable = last;
+            } else {
+                failed = true;
+                cout << "Warning: Cannot write the shape log in " << directory << "." << endl;
+            }
+            flushed.notify_all();
+        }
+    }
+
+    void runFlusher() {
+        unique_lock<mutex> guard(lock);
+        while (!stopping) {
+            wake.wait_for(guard, chrono::milliseconds(options.intervalMs));
+            flushTo(guard, appended);
+        }
+    }
+
+    template <typename Record>
+    static bool decode(const char* payload, uint32_t length, Record& r) {
+        if (length != sizeof(Record)) {
+            return false;
+        }
+        memcpy(&r, payload, sizeof(Record));
+        return true;
+    }
+
+    // Apply one replayed record; false when the payload does not fit the kind
+    static bool apply(ShapeList& target, uint32_t kind, const char* payload, uint32_t length) {
+        switch (kind) {
+            case ADD_RECTANGLE: {
+                ShapeSnapshot::RectangleRecord r;
+                if (!decode(payload, length, r)) return false;
+                target.createShape<Rectangle>(Coordinates(r.x, r.y), r.width, r.length);
+                return true;
+            }
+            case ADD_SQUARE: {
+                ShapeSnapshot::SquareRecord r;
+                if (!decode(payload, length, r)) return false;
+                target.createShape<Square>(Coordinates(r.x, r.y), r.side);
+                return true;
+            }
+            case ADD_CIRCLE: {
+                ShapeSnapshot::CircleRecord r;
+                if (!decode(payload, length, r)) return false;
+                target.createShape<Circle>(Coordinates(r.x, r.y), r.radius);
+                return true;
+            }
+            case ADD_TRIANGLE: {
+                ShapeSnapshot::TriangleRecord r;
+                if (!decode(payload, length, r)) return false;
+                Triangle* t = target.createShape<Triangle>(Coordinates(r.x1, r.y1), Coordinates(r.x2, r.y2),
+                                                           Coordinates(r.x3, r.y3));
+                t->setCoordinates(Coordinates(r.x, r.y));
+                return true;
+            }
+            case REMOVE: {
+                RemoveRecord r;
+                if (!decode(payload, length, r) || r.pos < 0 || r.pos >= target.size()) return false;
+                delete target.removeShape(r.pos);
+                return true;
+            }
+            case TRANSLATE: {
+                TranslateRecord r;
+                if (!decode(payload, length, r)) return false;
+                target.translateShapes(r.dx, r.dy);
+                return true;
+            }
+            case SCALE: {
+                ScaleRecord r;
+                if (!decode(payload, length, r)) return false;
+                target.scale(r.factor, r.sign != 0);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Replay one segment's records after the last applied sequence and set
+    // valid to the length of the prefix that passes the length and checksum
+    // checks (size is the file length). Returns false when a record is out of
+    // sequence or cannot be applied: the log does not match the list.
+    bool replaySegment(const string& path, ShapeList& target, uint64_t& last, uint64_t& bytes,
+                       size_t& valid, size_t& size) {
+        ifstream in(path, ios::binary);
+        vector<char> data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+        size = data.size();
+        size_t offset = 0;
+        while (data.size() - offset >= sizeof(RecordHeader)) {
+            RecordHeader h;
+            memcpy(&h, data.data() + offset, sizeof(h));
+            const char* payload = data.data() + offset + sizeof(h);
+            if (h.length > data.size() - offset - sizeof(h) ||
+                ShapeSnapshot::checksum(data.data() + offset + sizeof(h.checksum),
+                                        sizeof(h) - sizeof(h.checksum) + h.length) != h.checksum) {
+                break;
+            }
+            if (h.sequence > last) {
+                if (h.sequence != last + 1) {
+                    cout << "Warning: Log segment " << path << " jumps from record " << last << " to "
+                         << h.sequence << ". Cannot recover." << endl;
+                    return false;
+                }
+                if (!apply(target, h.kind, payload, h.length)) {
+                    cout << "Warning: Log record " << h.sequence << " in " << path
+                         << " cannot be applied. Cannot recover." << endl;
+                    return false;
+                }
+                last = h.sequence;
+                bytes += sizeof(h) + h.length;
+                recovered++;
+            }
+            offset += sizeof(h) + h.length;
+        }
+        valid = offset;
+        return true;
+    }
+
+    // Save the list as the checkpoint for sequence and start a new segment
+    // after it (no flush may run: flushing is held by the caller)
+    bool writeCheckpoint(ShapeList& target, uint64_t sequence) {
+        string temporary = directory + "/checkpoint.tmp";
+        if (!ShapeSnapshot::save(target, temporary) || !syncPath(temporary)) {
+            cout << "Warning: Cannot write checkpoint " << temporary << "." << endl;
+            return false;
+        }
+        if (rename(temporary.c_str(), checkpointPath(sequence).c_str()) != 0) {
+            cout << "Warning: Cannot rename checkpoint to " << checkpointPath(sequence) << "." << endl;
+            return false;
+        }
+        int next = openSegment(sequence + 1);
+        if (next < 0) {
+            return false;
+        }
+        syncPath(directory);
+        ::close(fd);
+        fd = next;
+        segmentBytes = 0;
+        checkpointSequence = sequence;
+
+        // Older checkpoints and segments are no longer needed for recovery
+        vector<uint64_t> checkpoints, segments;
+        listFiles(directory, checkpoints, segments);
+        for (uint64_t c : checkpoints) {
+            if (c < sequence) {
+                ::unlink(checkpointPath(c).c_str());
+            }
+        }
+        for (uint64_t s : segments) {
+            if (s <= sequence) {
+                ::unlink(segmentPath(s).c_str());
+            }
+        }
+        return true;
+    }
+
+public:
+    WriteAheadLog() = default;
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    // Recover an empty list from the log in dir (created if missing), then
+    // attach to it so that every later change is logged
+    bool open(const string& dir, ShapeList& target, const WalOptions& opts = WalOptions()) {
+        if (list != nullptr) {
+            cout << "Warning: The shape log is already open." << endl;
+            return false;
+        }
+        if (target.size() != 0) {
+            cout << "Warning: A shape log can only be recovered into an empty list." << endl;
+            return false;
+        }
+        if (::mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+            cout << "Warning: Cannot create log directory " << dir << "." << endl;
+            return false;
+        }
+        directory = dir;
+        options = opts;
+        recovered = 0;
+
+        // Newest readable checkpoint first
+        vector<uint64_t> checkpoints, segments;
+        listFiles(directory, checkpoints, segments);
+        uint64_t last = 0;
+        for (auto it = checkpoints.rbegin(); it != checkpoints.rend(); ++it) {
+            MappedShapeSnapshot snapshot;
+            if (snapshot.open(checkpointPath(*it), true)) {
+                snapshot.loadInto(target);
+                last = *it;
+                break;
+            }
+            cout << "Warning: Checkpoint " << checkpointPath(*it) << " is unreadable. Trying an older one." << endl;
+        }
+        checkpointSequence = last;
+
+        // The records before the first segment only exist in checkpoints, so
+        // without a checkpoint that reaches it the log cannot be replayed
+        if (!segments.empty() && segments.front() > last + 1) {
+            cout << "Warning: No readable checkpoint covers log segment " << segmentPath(segments.front())
+                 << ". Cannot recover." << endl;
+            return false;
+        }
+
+        // Then every record after it. Only the end of the last segment may be
+        // torn (a crash during a write); it is cut off so appends can follow.
+        uint64_t bytes = 0;
+        for (size_t i = 0; i < segments.size(); ++i) {
+            string path = segmentPath(segments[i]);
+            size_t valid = 0, size = 0;
+            if (!replaySegment(path, target, last, bytes, valid, size)) {
+                return false;
+            }
+            if (valid == size) {
+                continue;
+            }
+            if (i + 1 < segments.size()) {
+                cout << "Warning: Log segment " << path << " is damaged at byte " << valid
+                     << " and later segments follow. Cannot recover." << endl;
+                return false;
+            }
+            cout << "Warning: Log segment " << path << " ends with a torn or corrupt record."
+                 << " Cut at byte " << valid << "." << endl;
+            if (::truncate(path.c_str(), static_cast<off_t>(valid)) != 0) {
+                return false;
+            }
+        }
+
+        fd = openSegment(last + 1);
+        if (fd < 0) {
+            return false;
+        }
+        syncPath(directory);
+        appended = durable = last;
+        segmentBytes = bytes;  // Replayed records count towards the next checkpoint
+        failed = false;
+        stopping = false;
+        list = &target;
+        target.setChangeLog(this);
+        if (options.sync == WalSync::Interval) {
+            flusher = thread(&WriteAheadLog::runFlusher, this);
+        }
+        return true;
+    }
+
+    // Return once this thread's changes are on disk under WalSync::Always;
+    // false if the log could not be written
+    bool commit() {
+        unique_lock<mutex> guard(lock);
+        if (options.sync == WalSync::Always) {
+            flushTo(guard, min(lastAppended, appended));
+        }
+        return !failed;
+    }
+
+    // Write and sync every change logged so far
+    bool sync() {
+        unique_lock<mutex> guard(lock);
+        flushTo(guard, appended);
+        return !failed;
+    }
+
+    // Save the attached list as a checkpoint and start a new segment. The
+    // caller must keep other threads from changing the list meanwhile.
+    bool checkpoint() {
+        if (list == nullptr) {
+            return false;
+        }
+        unique_lock<mutex> guard(lock);
+        flushTo(guard, appended);
+        flushed.wait(guard, [this]() { return !flushing; });
+        if (failed) {
+            return false;
+        }
+        if (appended == checkpointSequence) {
+            return true;
+        }
+        flushing = true;
+        uint64_t sequence = appended;
+        guard.unlock();
+        bool ok = writeCheckpoint(*list, sequence);
+        guard.lock();
+        flushing = false;
+        flushed.notify_all();
+        return ok;
+    }
+
+    // Flush, stop logging and detach from the list
+    void close() {
+        if (list == nullptr) {
+            return;
+        }
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        if (flusher.joinable()) {
+            flusher.join();
+        }
+        sync();
+        list->setChangeLog(nullptr);
+        list = nullptr;
+        ::close(fd);
+        fd = -1;
+    }
+
+    // ShapeListLog: one record per change
+    void logAdd(const Shape* s) override {
+        Coordinates c = s->getCoordinates();
+        switch (s->getKind()) {
+            case ShapeKind::Rectangle: {
+                const Rectangle* r = static_cast<const Rectangle*>(s);
+                ShapeSnapshot::RectangleRecord record{c.getX(), c.getY(), r->getWidth(), r->getLength()};
+                append(ADD_RECTANGLE, &record, sizeof(record));
+                break;
+            }
+            case ShapeKind::Square: {
+                ShapeSnapshot::SquareRecord record{c.getX(), c.getY(), static_cast<const Square*>(s)->getSide()};
+                append(ADD_SQUARE, &record, sizeof(record));
+                break;
+            }
+            case ShapeKind::Circle: {
+                ShapeSnapshot::CircleRecord record{c.getX(), c.getY(), static_cast<const Circle*>(s)->getRadius()};
+                append(ADD_CIRCLE, &record, sizeof(record));
+                break;
+            }
+            case ShapeKind::Triangle: {
+                const Triangle* t = static_cast<const Triangle*>(s);
+                ShapeSnapshot::TriangleRecord record{c.getX(), c.getY(),
+                    t->getPosition1().getX(), t->getPosition1().getY(),
+                    t->getPosition2().getX(), t->getPosition2().getY(),
+                    t->getPosition3().getX(), t->getPosition3().getY()};
+                append(ADD_TRIANGLE, &record, sizeof(record));
+                break;
+            }
+        }
+    }
+
+    void logRemove(int pos) override {
+        RemoveRecord record{pos};
+        append(REMOVE, &record, sizeof(record));
+    }
+
+    void logTranslate(int dx, int dy) override {
+        TranslateRecord record{dx, dy};
+        append(TRANSLATE, &record, sizeof(record));
+    }
+
+    void logScale(int factor, bool sign) override {
+        ScaleRecord record{factor, sign ? 1 : 0};
+        append(SCALE, &record, sizeof(record));
+    }
+
+    // Checkpoint once the segment has grown past the configured size
+    void changed(ShapeList&) override {
+        if (segmentBytes >= options.checkpointBytes) {
+            checkpoint();
+        }
+    }
+
+    // Getters
+    size_t recoveredRecords() const { return recovered; }
+    uint64_t lastCheckpoint() const { return checkpointSequence; }
+    uint64_t lastSequence() {
+        lock_guard<mutex> guard(lock);
+        return appended;
+    }
+    uint64_t flushCount() {
+        lock_guard<mutex> guard(lock);
+        return syncs;
+    }
+
+    // Delete the log files in dir and the directory itself
+    static void destroy(const string& dir) {
+        vector<uint64_t> checkpoints, segments;
+        listFiles(dir, checkpoints, segments);
+        WriteAheadLog names;
+        names.directory = dir;
+        for (uint64_t c : checkpoints) {
+            ::unlink(names.checkpointPath(c).c_str());
+        }
+        for (uint64_t s : segments) {
+            ::unlink(names.segmentPath(s).c_str());
+        }
+        ::unlink((dir + "/checkpoint.tmp").c_str());
+        ::rmdir(dir.c_str());
+    }
+
+    // Destructor: flush and detach
+    ~WriteAheadLog() {
+        close();
+    }
+};
+
+
+// ==============================
+// Test function for WriteAheadLog class
+// ==============================
+void test_write_ahead_log_class() {
+    cout << "\n========== Running test_write_ahead_log_class() ==========" << endl;
+
+    int passed = 0, failed = 0;
+    const string dir = "shape_wal_test";
+    WriteAheadLog::destroy(dir);
+
+    // Names of the log files starting with prefix, in name order
+    auto filesStartingWith = [&dir](const string& prefix) {
+        vector<string> names;
+        DIR* d = opendir(dir.c_str());
+        while (dirent* entry = d != nullptr ? readdir(d) : nullptr) {
+            string name = entry->d_name;
+            if (name.compare(0, prefix.size(), prefix) == 0) {
+                names.push_back(name);
+            }
+        }
+        if (d != nullptr) {
+            closedir(d);
+        }
+        sort(names.begin(), names.end());
+        return names;
+    };
+
+    // Test 1: Every kind of change survives a reopen
+    string expected;
+    {
+        ShapeList list;
+        WriteAheadLog log;
+        WalOptions options;
+        options.sync = WalSync::Always;
+        log.open(dir, list, options);
+        list.createShape<Rectangle>(Coordinates(10, 20), 10.5, 15);
+        list.createShape<Circle>(Coordinates(80, 100), 25);
+        list.createShape<Square>(Coordinates(90, 40), 20);
+        list.createShape<Triangle>(Coordinates(50, 50), Coordinates(20, 70), Coordinates(70, 70));
+        list.translateShapes(5, -3);
+        list.scale(2, true);
+        delete list.removeShape(1);
+        list.scale(3, false);
+        log.commit();
+        expected = list.display();
+    }
+    ShapeList recovered;
+    WriteAheadLog reopened;
+    bool opened = reopened.open(dir, recovered);
+    if (opened && recovered.display() == expected && reopened.recoveredRecords() == 8) {
+        cout << "Test 1 passed: Logged changes recovered" << endl;
+        passed++;
+    } else {
+        cout << "Test 1 FAILED: Recovered list differs from the logged one" << endl;
+        failed++;
+    }
+
+    // Test 2: Checkpoints keep the replay short
+    reopened.close();
+    WriteAheadLog::destroy(dir);
+    {
+        ShapeList list;
+        WriteAheadLog log;
+        WalOptions options;
+        options.sync = WalSync::None;
+        options.checkpointBytes = 4096;
+        log.open(dir, list, options);
+        for (int i = 0; i < 1000; ++i) {
+            list.createShape<Square>(Coordinates(i % 100, i / 100), 1 + i % 7);
+        }
+        list.translateShapes(1, 1);
+        expected = list.display();
+    }
+    ShapeList fromCheckpoint;
+    WriteAheadLog checkpointed;
+    checkpointed.open(dir, fromCheckpoint);
+    if (fromCheckpoint.display() == expected && checkpointed.lastCheckpoint() > 900 &&
+        checkpointed.recoveredRecords() < 100) {
+        cout << "Test 2 passed: Recovery replayed " << checkpointed.recoveredRecords()
+             << " records after checkpoint " << checkpointed.lastCheckpoint() << endl;
+        passed++;
+    } else {
+        cout << "Test 2 FAILED: Checkpoint recovery replayed " << checkpointed.recoveredRecords() << " records" << endl;
+        failed++;
+    }
+    checkpointed.close();
+
+    // Test 3: A torn record at the end of the log is cut off, and logging goes on after it
+    string afterTorn;
+    {
+        ShapeList list;
+        WriteAheadLog log;
+        log.open(dir, list);
+        list.createShape<Circle>(Coordinates(1, 1), 1);
+        afterTorn = list.display();
+    }
+    {
+        ofstream segment(dir + "/" + filesStartingWith("wal-").back(), ios::binary | ios::app);
+        segment.write("\x2a\x00\x00\x00\x01\x00", 6);
+    }
+    ShapeList repaired;
+    bool tornIgnored = false;
+    {
+        WriteAheadLog log;
+        log.open(dir, repaired);
+        tornIgnored = repaired.display() == afterTorn;
+        repaired.createShape<Square>(Coordinates(2, 2), 2);
+    }
+    ShapeList continued;
+    WriteAheadLog continuedLog;
+    continuedLog.open(dir, continued);
+    if (tornIgnored && continued.size() == 1002 && continued.display() == repaired.display()) {
+        cout << "Test 3 passed: Torn tail ignored and cut" << endl;
+        passed++;
+    } else {
+        cout << "Test 3 FAILED: Torn tail broke recovery (" << continued.size() << " shapes)" << endl;
+        failed++;
+    }
+    continuedLog.close();
+
+    // Test 4: Concurrent committers share flushes and lose nothing
+    WriteAheadLog::destroy(dir);
+    uint64_t flushes = 0;
+    {
+        ShapeList list;
+        WriteAheadLog log;
+        WalOptions options;
+        options.sync = WalSync::Always;
+        log.open(dir, list, options);
+        mutex listLock;
+        vector<thread> writers;
+        for (int t = 0; t < 4; ++t) {
+            writers.push_back(thread([&list, &log, &listLock, t]() {
+                for (int i = 0; i < 100; ++i) {
+                    {
+                        lock_guard<mutex> guard(listLock);
+                        list.createShape<Circle>(Coordinates(t, i), 1 + i);
+                    }
+                    log.commit();
+                }
+            }));
+        }
+        for (thread& w : writers) {
+            w.join();
+        }
+        flushes = log.flushCount();
+    }
+    ShapeList concurrent;
+    WriteAheadLog concurrentLog;
+    concurrentLog.open(dir, concurrent);
+    if (concurrent.size() == 400 && flushes <= 400) {
+        cout << "Test 4 passed: 400 concurrent commits in " << flushes << " flushes" << endl;
+        passed++;
+    } else {
+        cout << "Test 4 FAILED: " << concurrent.size() << " of 400 shapes recovered" << endl;
+        failed++;
+    }
+    concurrentLog.close();
+
+    // Test 5: A damaged checkpoint makes recovery fail and leaves the log untouched
+    WriteAheadLog::destroy(dir);
+    {
+        ShapeList list;
+        WriteAheadLog log;
+        WalOptions options;
+        options.sync = WalSync::None;
+        options.checkpointBytes = 256;
+        log.open(dir, list, options);
+        for (int i = 0; i < 8; ++i) {
+            list.createShape<Square>(Coordinates(i, i), 1 + i);
+        }
+    }
+    vector<string> checkpointFiles = filesStartingWith("checkpoint-");
+    vector<string> segmentFiles = filesStartingWith("wal-");
+    auto fileSizes = [&dir, &segmentFiles]() {
+        vector<long> sizes;
+        for (const string& name : segmentFiles) {
+            struct stat info;
+            sizes.push_back(::stat((dir + "/" + name).c_str(), &info) == 0 ? static_cast<long>(info.st_size) : -1);
+        }
+        return sizes;
+    };
+    vector<long> sizesBefore = fileSizes();
+    if (!checkpointFiles.empty()) {
+        fstream file(dir + "/" + checkpointFiles.back(), ios::in | ios::out | ios::binary);
+        file.seekp(20);
+        file.put('\x7f');
+    }
+    ShapeList damaged;
+    WriteAheadLog damagedLog;
+    bool refused = !damagedLog.open(dir, damaged);
+    if (checkpointFiles.size() == 1 && sizesBefore.back() > 0 && refused && damaged.size() == 0 &&
+        fileSizes() == sizesBefore && filesStartingWith("wal-") == segmentFiles) {
+        cout << "Test 5 passed: Damaged checkpoint refused, log kept" << endl;
+        passed++;
+    } else {
+        cout << "Test 5 FAILED: Damaged checkpoint handling" << endl;
+        failed++;
+    }
+    WriteAheadLog::destroy(dir);
+
+    // Summary
+    cout << "========== Test Summary ==========" << endl;
+    cout << "Passed: " << passed << ", Failed: " << failed << endl;
+    cout << "==================================\n" << endl;
+}
+#endif
+
+
+// ==============================
+// ShapeImporter Class
+// ==============================
+// Bulk loader for line-oriented shape files. Each line holds one shape,
+// with fields separated by commas and/or whitespace:
+//
+//   rect,x,y,width,length        (or "rectangle")
+//   square,x,y,side
+//   circle,x,y,radius
+//   triangle,x1,y1,x2,y2,x3,y3
+//
+// Blank lines and lines starting with '#' are ignored. The file is read in
+// large chunks and parsed with from_chars; a bad line is reported and
+// skipped without stopping the load. With more than one thread, each
+// chunk is split at line boundaries and the pieces are parsed in parallel.
+
+// A line that could not be imported
+struct ImportError {
+    size_t line;     // 1-based line number
+    string message;
+};
+
+// Outcome of an import
+struct ImportResult {
+    size_t linesRead = 0;
+    size_t shapesLoaded = 0;
+    vector<ImportError> errors;
+};
+
+class ShapeImporter {
+private:
+    // One parsed line, kept until the shapes are added in file order
+    struct ParsedShape {
+        ShapeKind kind;
+        int coords[6];
+        double dims[2];
+    };
+
+    // Result of parsing one piece of a chunk
+    struct ParsedPiece {
+        vector<ParsedShape> shapes;
+        vector<ImportError> errors;  // Line numbers relative to the piece
+        size_t lines = 0;
+    };
+
+    size_t chunkSize;
+    unique_ptr<WorkStealingPool> pool;  // Set when parsing in parallel
+
+    static bool isSeparator(char c) {
+        return c == ',' || c == ' ' || c == '\t' || c == '\r';
+    }
+
+    // Split a line into at most maxFields fields; returns the field count, or maxFields + 1 if there are more
+    static int splitFields(const char* begin, const char* end, const char** starts, const char** stops, int maxFields) {
+        int count = 0;
+        const char* p = begin;
+        while (true) {
+            while (p < end && isSeparator(*p)) ++p;
+            if (p == end) {
+                return count;
+            }
+            if (count == maxFields) {
+                return maxFields + 1;
+            }
+            starts[count] = p;
+            while (p < end && !isSeparator(*p)) ++p;
+            stops[count++] = p;
+        }
+    }
+
+    template <typename T>
+    static bool parseNumber(const char* begin, const char* end, T& value) {
+        from_chars_result r = from_chars(begin, end, value);
+        return r.ec == errc() && r.ptr == end;
+    }
+
+    static bool matches(const char* begin, const char* end, const char* word) {
+        size_t n = strlen(word);
+        return static_cast<size_t>(end - begin) == n && strncmp(begin, word, n) == 0;
+    }
+
+    // Parse one line; returns an empty string on success or the error message
+    static string parseLine(const char* begin, const char* end, ParsedShape& shape, bool& blank) {
+        const char* starts[8];
+        const char* stops[8];
+        int fields = splitFields(begin, end, starts, stops, 7);
+        blank = fields == 0 || *starts[0] == '#';
+        if (blank) {
+            return "";
+        }
+
+        int coordCount, dimCount;
+        if (matches(starts[0], stops[0], "rect") || matches(starts[0], stops[0], "rectangle")) {
+            shape.kind = ShapeKind::Rectangle; coordCount = 2; dimCount = 2;
+        } else if (matches(starts[0], stops[0], "square")) {
+            shape.kind = ShapeKind::Square; coordCount = 2; dimCount = 1;
+        } else if (matches(starts[0], stops[0], "circle")) {
+            shape.kind = ShapeKind::Circle; coordCount = 2; dimCount = 1;
+        } else if (matches(starts[0], stops[0], "triangle")) {
+            shape.kind = ShapeKind::Triangle; coordCount = 6; dimCount = 0;
+        } else {
+            return "Unknown shape type '" + string(starts[0], stops[0]) + "'";
+        }
+        if (fields != 1 + coordCount + dimCount) {
+            return "Expected " + to_string(coordCount + dimCount) + " values, found " +
+                   (fields > 7 ? string("more") : to_string(fields - 1));
+        }
+        for (int i = 0; i < coordCount; ++i) {
+            if (!parseNumber(starts[1 + i], stops[1 + i], shape.coords[i])) {
+                return "Invalid coordinate '" + string(starts[1 + i], stops[1 + i]) + "'";
+            }
+            if (shape.coords[i] < 0) {
+                return "Coordinates must be positive";
+            }
+        }
+        for (int i = 0; i < dimCount; ++i) {
+            const char* b = starts[1 + coordCount + i];
+            const char* e = stops[1 + coordCount + i];
+            if (!parseNumber(b, e, shape.dims[i])) {
+                return "Invalid dimension '" + string(b, e) + "'";
+            }
+            if (!(shape.dims[i] > 0)) {
+                return "Dimensions must be positive";
+            }
+        }
+        return "";
+    }
+
+    // Parse every line of [begin, end), which holds whole lines only
+    static void parsePiece(const char* begin, const char* end, ParsedPiece& piece) {
+        const char* line = begin;
+        while (line < end) {
+            const char* eol = static_cast<const char*>(memchr(line, '\n', end - line));
+            if (eol == nullptr) eol = end;
+            piece.lines++;
+            ParsedShape shape;
+            bool blank;
+            string error = parseLine(line, eol, shape, blank);
+            if (!error.empty()) {
+                piece.errors.push_back(ImportError{piece.lines, error});
+            } else if (!blank) {
+                piece.shapes.push_back(shape);
+            }
+            line = eol + 1;
+        }
+    }
+
+    static void addParsed(const ParsedShape& p, ShapeList& list) {
+        switch (p.kind) {
+            case ShapeKind::Rectangle:
+                list.createShape<Rectangle>(Coordinates(p.coords[0], p.coords[1]), p.dims[0], p.dims[1]);
+                break;
+            case ShapeKind::Square:
+                list.createShape<Square>(Coordinates(p.coords[0], p.coords[1]), p.dims[0]);
+                break;
+            case ShapeKind::Circle:
+                list.createShape<Circle>(Coordinates(p.coords[0], p.coords[1]), p.dims[0]);
+                break;
+            case ShapeKind::Triangle:
+                list.createShape<Triangle>(Coordinates(p.coords[0], p.coords[1]), Coordinates(p.coords[2], p.coords[3]),
+                                           Coordinates(p.coords[4], p.coords[5]));
+                break;
+        }
+    }
+
+    // Parse a buffer of whole lines and append its shapes to the list
+    void importLines(const char* begin, const char* end, ShapeList& list, ImportResult& result) {
+        size_t pieces = pool == nullptr ? 1 : static_cast<size_t>(pool->getThreadCount()) * 4;
+        vector<const char*> bounds(1, begin);
+        for (size_t k = 1; k < pieces; ++k) {
+            const char* cut = max(bounds.back(), begin + (end - begin) * k / pieces);
+            const char* eol = static_cast<const char*>(memchr(cut, '\n', end - cut));
+            bounds.push_back(eol == nullptr ? end : eol + 1);
+        }
+        bounds.push_back(end);
+
+        vector<ParsedPiece> parsed(bounds.size() - 1);
+        if (pool == nullptr) {
+            parsePiece(bounds[0], bounds[1], parsed[0]);
+        } else {
+            pool->parallelFor(parsed.size(), 1, [&bounds, &parsed](size_t b, size_t e) {
+                for (size_t k = b; k < e; ++k) parsePiece(bounds[k], bounds[k + 1], parsed[k]);
+            });
+        }
+
+        for (ParsedPiece& piece : parsed) {
+            for (const ParsedShape& shape : piece.shapes) {
+                addParsed(shape, list);
+            }
+            for (ImportError& error : piece.errors) {
+                error.line += result.linesRead;
+                result.errors.push_back(move(error));
+            }
+            result.shapesLoaded += piece.shapes.size();
+            result.linesRead += piece.lines;
+        }
+    }
+
+public:
+    // Constructor: chunk size in bytes and number of parsing threads
+    explicit ShapeImporter(size_t chunkBytes = 8 << 20, int threads = 1) : chunkSize(chunkBytes) {
+        if (chunkSize < 4096) {
+            chunkSize = 4096;
+        }
+        if (threads > 1) {
+            pool.reset(new WorkStealingPool(threads));
+        }
+    }
+
+    // Parse one shape row and add it to the list; returns false and sets error if the row is invalid
+    static bool addShapeLine(const string& line, ShapeList& list, string& error) {
+        ParsedShape shape;
+        bool blank;
+        error = parseLine(line.data(), line.data() + line.size(), shape, blank);
+        if (error.empty() && blank) {
+            error = "Missing shape";
+        }
+        if (!error.empty()) {
+            return false;
+        }
+        addParsed(shape, list);
+        return true;
+    }
+
+    // Stream shapes from any input into the list
+    ImportResult importStream(istream& in, ShapeList& list) {
+        ImportResult result;
+        vector<char> buffer(chunkSize);
+        size_t carried = 0;  // Bytes of an unfinished line kept from the previous chunk
+        while (true) {
+            if (carried == buffer.size()) {
+                buffer.resize(buffer.size() * 2);  // A single line longer than the chunk
+            }
+            in.read(buffer.data() + carried, buffer.size() - carried);
+            size_t filled = carried + static_cast<size_t>(in.gcount());
+            if (filled == 0) {
+                break;
+            }
+            bool atEnd = filled < buffer.size();
+            const char* begin = buffer.data();
+            const char* end = begin + filled;
+            if (!atEnd) {
+                // Only parse up to the last complete line
+                const char* last = end;
+                while (last > begin && last[-1] != '\n') --last;
+                end = last;
+            }
+            if (end > begin) {
+                importLines(begin, end, list, result);
+            }
+            carried = filled - (end - begin);
+            memmove(buffer.data(), end, carried);
+            if (atEnd) {
+                break;
+            }
+        }
+        return result;
+    }
+
+    // Load a whole file into the list
+    ImportResult importFile(const string& path, ShapeList& list) {
+        ifstream in(path, ios::binary);
+        if (!in) {
+            ImportResult result;
+            result.errors.push_back(ImportError{0, "Cannot open file " + path});
+            return result;
+        }
+        return importStream(in, list);
+    }
+};
+
+
+
+// ==============================
+// Test function for ShapeImporter class
+// ==============================
+void test_shape_importer_class() {
+    cout << "\n========== Running test_shape_importer_class() ==========" << endl;
+
+    int passed = 0, failed = 0;
+
+    // Test 1: Valid rows of every type, comments, blank lines and both separators
+    string text =
+        "# shapes\n"
+        "rect,100,20,10,15\n"
+        "circle 80 100 25\n"
+        "\n"
+        "square, 90, 40, 20\r\n"
+        "triangle,50,50,20,70,70,70";
+    istringstream valid(text);
+    ShapeList list;
+    ShapeImporter importer;
+    ImportResult result = importer.importStream(valid, list);
+    if (result.linesRead == 6 && result.shapesLoaded == 4 && result.errors.empty() &&
+        list.size() == 4 && fabs(list.area(0) - 150.0) < 0.001 && list.getShape(3)->getKind() == ShapeKind::Triangle) {
+        cout << "Test 1 passed: Valid rows imported" << endl;
+        passed++;
+    } else {
+        cout << "Test 1 FAILED: Valid rows" << endl;
+        failed++;
+    }
+
+    // Test 2: Bad rows are reported with their line number and the load continues
+    istringstream mixed("hexagon,1,2,3\ncircle,1,2\nsquare,-1,2,3\nrect,1,2,x,4\ncircle,5,5,0\nsquare,1,1,2\n");
+    ShapeList partial;
+    result = importer.importStream(mixed, partial);
+    if (result.shapesLoaded == 1 && result.errors.size() == 5 && result.errors[0].line == 1 &&
+        result.errors[3].line == 4 && result.errors[4].line == 5 && partial.size() == 1) {
+        cout << "Test 2 passed: Per-line errors reported" << endl;
+        passed++;
+    } else {
+        cout << "Test 2 FAILED: Per-line errors" << endl;
+        failed++;
+    }
+
+    // Test 3: Parallel parsing with small chunks gives the same list and line numbers
+    string big;
+    for (int i = 0; i < 20000; ++i) {
+        big += (i % 4 == 0) ? "rect," + to_string(i % 97) + ",3," + to_string(i % 13 + 1) + ".5,2\n"
+             : (i % 4 == 1) ? "circle," + to_string(i % 89) + ",7,1.25\n"
+             : (i % 4 == 2) ? "triangle,0,0," + to_string(i % 50) + ",1,2,9\n"
+             : (i == 7003) ? "square,bad\n" : "square,1,2," + to_string(i % 7 + 1) + "\n";
+    }
+    istringstream serialInput(big), parallelInput(big);
+    ShapeList serial, parallel;
+    ShapeImporter serialImporter(4096, 1), parallelImporter(4096, 4);
+    ImportResult a = serialImporter.importStream(serialInput, serial);
+    ImportResult b = parallelImporter.importStream(parallelInput, parallel);
+    if (a.shapesLoaded == 19999 && b.shapesLoaded == 19999 && b.linesRead == 20000 &&
+        b.errors.size() == 1 && b.errors[0].line == 7004 && serial.display() == parallel.display()) {
+        cout << "Test 3 passed: Parallel chunked import" << endl;
+        passed++;
+    } else {
+        cout << "Test 3 FAILED: Parallel chunked import" << endl;
+        failed++;
+    }
+
+    // Summary
+    cout << "========== Test Summary ==========" << endl;
+    cout << "Passed: " << passed << ", Failed: " << failed << endl;
+    cout << "==================================\n" << endl;
+}
+
+// ==============================
+// BufferedOutput Class
+// ==============================
+// Stream buffer that writes to stdout in large blocks. Flush requests
+// (such as endl) are ignored; data goes out when the buffer fills or when
+// flushAll() is called, so batch runs do not pay for a write per line.
+class BufferedOutput : public streambuf {
+private:
+    vector<char> buffer;
+
+    void writeOut() {
+        size_t pending = pptr() - pbase();
+        if (pending > 0) {
+            fwrite(pbase(), 1, pending, stdout);
+        }
+        setp(buffer.data(), buffer.data() + buffer.size());
+    }
+
+protected:
+    int overflow(int c) override {
+        writeOut();
+        if (c != traits_type::eof()) {
+            *pptr() = static_cast<char>(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    int sync() override {
+        return 0;
+    }
+
+public:
+    explicit BufferedOutput(size_t size = 1 << 20) : buffer(size) {
+        setp(buffer.data(), buffer.data() + buffer.size());
+    }
+
+    // Write everything buffered so far to stdout
+    void flushAll() {
+        writeOut();
+        fflush(stdout);
+    }
+
+    ~BufferedOutput() {
+        flushAll();
+    }
+};
+
+
+// ==============================
+// ShapeBenchmark Class
+// ==============================
+// Times every ShapeList operation on synthetic scenes and reports the
+// results as JSON. Scenes come from a seeded generator with a configurable
+// Rectangle/Square/Circle/Triangle mix. Per-shape operations (addShape,
+// area, perimeter) are timed in batches, whole-list operations once per
+// repetition, and removeShape call by call.
+
+struct BenchmarkConfig {
+    vector<size_t> sizes = {1000, 10000, 100000, 1000000};
+    double mix[4] = {1.0, 1.0, 1.0, 1.0};  // Weights for Rectangle, Square, Circle, Triangle
+    int repetitions = 5;                    // Runs of each whole-list operation
+    size_t removals = 1000;                 // removeShape calls per scene
+    int threads = 1;                        // Passed to ShapeList::setParallelExecution()
+    uint64_t seed = 42;
+    bool lists[3] = {true, true, true};     // Containers to run: ShapeList, VariantShapeList, ColumnarShapeList
+};
+
+class ShapeBenchmark {
+private:
+    static constexpr size_t BATCH = 1024;  // Per-shape calls timed together
+
+    struct OperationStats {
+        string name;
+        size_t calls = 0;          // Timed calls
+        size_t items = 0;          // Shapes processed by those calls
+        double seconds = 0.0;
+        vector<double> latencies;  // Nanoseconds per call, one entry per sample
+    };
+
+    struct SceneResult {
+        const char* list = "";
+        size_t shapes = 0;
+        long heapGrowthKb = -1;  // Heap memory held by the list once every shape is added
+        long peakRssKb = -1;
+        vector<OperationStats> operations;
+    };
+
+    // Parameters of one generated shape, drawn before the clock starts
+    struct ShapeSpec {
+        int kind;
+        int x, y, a, b;
+    };
+
+    // Stream buffer that discards its input, so display() is timed without I/O
+    class NullBuffer : public streambuf {
+    protected:
+        int overflow(int c) override {
+            return traits_type::not_eof(c);
+        }
+
+        streamsize xsputn(const char*, streamsize n) override {
+            return n;
+        }
+    };
+
+    typedef chrono::steady_clock Clock;
+
+    BenchmarkConfig config;
+    uint64_t state;
+
+    // splitmix64 step
+    uint64_t next() {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+
+    int uniform(int lo, int hi) {
+        return lo + static_cast<int>(next() % static_cast<uint64_t>(hi - lo + 1));
+    }
+
+    ShapeSpec randomSpec() {
+        double total = config.mix[0] + config.mix[1] + config.mix[2] + config.mix[3];
+        double pick = static_cast<double>(next() >> 11) * (1.0 / 9007199254740992.0) * total;
+        ShapeSpec spec;
+        spec.kind = 3;
+        for (int k = 0; k < 3; ++k) {
+            if (pick < config.mix[k]) {
+                spec.kind = k;
+                break;
+            }
+            pick -= config.mix[k];
+        }
+        // Keep positions well away from zero so the +/-1 translations never clamp
+        spec.x = uniform(1000, 100000);
+        spec.y = uniform(1000, 100000);
+        spec.a = uniform(1, 100);
+        spec.b = uniform(1, 100);
+        return spec;
+    }
+
+    template <typename List>
+    static void addSpec(List& list, const ShapeSpec& spec) {
+        Coordinates at(spec.x, spec.y);
+        switch (spec.kind) {
+            case 0:
+                list.template createShape<Rectangle>(at, spec.a, spec.b);
+                break;
+            case 1:
+                list.template createShape<Square>(at, spec.a);
+                break;
+            case 2:
+                list.template createShape<Circle>(at, spec.a);
+                break;
+            default:
+                list.template createShape<Triangle>(at, Coordinates(spec.x + spec.a, spec.y), Coordinates(spec.x, spec.y + spec.b));
+                break;
+        }
+    }
+
+    static double elapsedNs(Clock::time_point start) {
+        return static_cast<double>(chrono::duration_cast<chrono::nanoseconds>(Clock::now() - start).count());
+    }
+
+    static void record(OperationStats& op, double ns, size_t calls, size_t items) {
+        op.latencies.push_back(ns / static_cast<double>(calls));
+        op.calls += calls;
+        op.items += items;
+        op.seconds += ns * 1e-9;
+    }
+
+    // Nearest-rank percentile of a sorted sample
+    static double percentile(const vector<double>& sorted, double p) {
+        if (sorted.empty()) {
+            return 0.0;
+        }
+        size_t rank = static_cast<size_t>(ceil(p / 100.0 * static_cast<double>(sorted.size())));
+        return sorted[rank == 0 ? 0 : rank - 1];
+    }
+
+    // Peak resident set size of the process so far, in KB (-1 when unavailable)
+    static long peakRssKb() {
+#if defined(__unix__) || defined(__APPLE__)
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#if defined(__APPLE__)
+            return static_cast<long>(usage.ru_maxrss / 1024);  // Reported in bytes
+#else
+            return static_cast<long>(usage.ru_maxrss);
+#endif
+        }
+#endif
+        return -1;
+    }
+
+    // Heap memory currently allocated by the process, in KB (-1 when unavailable).
+    // Unlike the RSS it does not count freed blocks the allocator keeps.
+    static long heapInUseKb() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+        struct mallinfo2 info = mallinfo2();
+        return static_cast<long>((info.uordblks + info.hblkhd) / 1024);
+#else
+        return -1;
+#endif
+    }
+
+    static void configure(ShapeList& list, int threads) {
+        if (threads > 1) {
+            list.setParallelExecution(threads);
+        }
+    }
+
+    // VariantShapeList and ColumnarShapeList have no parallel mode
+    static void configure(VariantShapeList&, int) {}
+    static void configure(ColumnarShapeList&, int) {}
+
+    // Time a per-shape query over every position, BATCH calls per sample
+    template <typename Query>
+    void timePerShape(OperationStats& op, int count, Query query) {
+        volatile double sink = 0.0;
+        for (int rep = 0; rep < config.repetitions; ++rep) {
+            for (int first = 0; first < count; first += static_cast<int>(BATCH)) {
+                int last = min(count, first + static_cast<int>(BATCH));
+                double sum = 0.0;
+                Clock::time_point start = Clock::now();
+                for (int i = first; i < last; ++i) {
+                    sum += query(i);
+                }
+                record(op, elapsedNs(start), last - first, last - first);
+                sink = sink + sum;
+            }
+        }
+    }
+
+    // Run every operation on a scene of the given size held in a List
+    template <typename List>
+    SceneResult runScene(size_t shapes, const char* name) {
+        SceneResult result;
+        result.list = name;
+        result.shapes = shapes;
+        OperationStats add, area, perimeter, areas, perimeters, translate, scale, display, remove;
+        add.name = "addShape";
+        area.name = "area";
+        perimeter.name = "perimeter";
+        areas.name = "areas";
+        perimeters.name = "perimeters";
+        translate.name = "translateShapes";
+        scale.name = "scale";
+        display.name = "display";
+        remove.name = "removeShape";
+
+        long heapBefore = heapInUseKb();
+        List list;
+        configure(list, config.threads);
+
+        vector<ShapeSpec> specs(BATCH);
+        for (size_t first = 0; first < shapes; first += BATCH) {
+            size_t count = min(BATCH, shapes - first);
+            for (size_t i = 0; i < count; ++i) {
+                specs[i] = randomSpec();
+            }
+            Clock::time_point start = Clock::now();
+            for (size_t i = 0; i < count; ++i) {
+                addSpec(list, specs[i]);
+            }
+            record(add, elapsedNs(start), count, count);
+        }
+        long heapAfter = heapInUseKb();
+        result.heapGrowthKb = heapBefore >= 0 && heapAfter >= 0 ? heapAfter - heapBefore : -1;
+
+        int count = list.size();
+        timePerShape(area, count, [&list](int i) { return list.area(i); });
+        timePerShape(perimeter, count, [&list](int i) { return list.perimeter(i); });
+
+        vector<double> values;
+        for (int rep = 0; rep < config.repetitions; ++rep) {
+            Clock::time_point start = Clock::now();
+            list.areas(values);
+            record(areas, elapsedNs(start), 1, count);
+
+            start = Clock::now();
+            list.perimeters(values);
+            record(perimeters, elapsedNs(start), 1, count);
+
+            // Alternate directions so repeated runs stay inside the generated range
+            start = Clock::now();
+            list.translateShapes(rep % 2 == 0 ? 1 : -1, rep % 2 == 0 ? 1 : -1);
+            record(translate, elapsedNs(start), 1, count);
+
+            start = Clock::now();
+            list.scale(2, rep % 2 == 0);
+            record(scale, elapsedNs(start), 1, count);
+
+            NullBuffer sink;
+            ostream stream(&sink);
+            start = Clock::now();
+            list.display(stream);
+            record(display, elapsedNs(start), 1, count);
+        }
+
+        size_t removals = min(config.removals, shapes);
+        for (size_t i = 0; i < removals; ++i) {
+            int pos = static_cast<int>(next() % static_cast<uint64_t>(list.size()));
+            Clock::time_point start = Clock::now();
+            Shape* removed = list.removeShape(pos);
+            record(remove, elapsedNs(start), 1, 1);
+            delete removed;
+        }
+
+        result.peakRssKb = peakRssKb();
+        result.operations = {add, area, perimeter, areas, perimeters, translate, scale, display, remove};
+        return result;
+    }
+
+    static void writeOperation(ShapeWriter& out, OperationStats& op) {
+        sort(op.latencies.begin(), op.latencies.end());
+        out << "        {\"name\": \"" << op.name << "\", \"calls\": " << op.calls
+            << ", \"shapes\": " << op.items
+            << ", \"seconds\": " << op.seconds
+            << ", \"shapes_per_second\": " << (op.seconds > 0.0 ? static_cast<double>(op.items) / op.seconds : 0.0)
+            << ", \"p50_ns\": " << percentile(op.latencies, 50.0)
+            << ", \"p90_ns\": " << percentile(op.latencies, 90.0)
+            << ", \"p99_ns\": " << percentile(op.latencies, 99.0)
+            << ", \"max_ns\": " << (op.latencies.empty() ? 0.0 : op.latencies.back()) << "}";
+    }
+
+public:
+    explicit ShapeBenchmark(const BenchmarkConfig& cfg) : config(cfg), state(cfg.seed) {}
+
+    // Run every configured scene size and write the JSON report
+    void run(ostream& stream) {
+        ShapeWriter out(stream);
+        out << "{\n  \"config\": {\"repetitions\": " << config.repetitions
+            << ", \"removals\": " << config.removals
+            << ", \"threads\": " << config.threads
+            << ", \"seed\": " << config.seed
+            << ", \"mix\": [" << config.mix[0] << ", " << config.mix[1] << ", "
+            << config.mix[2] << ", " << config.mix[3] << "]},\n  \"scenes\": [\n";
+        bool first = true;
+        for (size_t s = 0; s < config.sizes.size(); ++s) {
+            cerr << "Benchmarking " << config.sizes[s] << " shapes..." << endl;
+            // Every container gets the same generated scene
+            uint64_t sceneState = state;
+            vector<SceneResult> scenes;
+            if (config.lists[0]) {
+                scenes.push_back(runScene<ShapeList>(config.sizes[s], "ShapeList"));
+            }
+            if (config.lists[1]) {
+                state = sceneState;
+                scenes.push_back(runScene<VariantShapeList>(config.sizes[s], "VariantShapeList"));
+            }
+            if (config.lists[2]) {
+                state = sceneState;
+                scenes.push_back(runScene<ColumnarShapeList>(config.sizes[s], "ColumnarShapeList"));
+            }
+            // Peak RSS is process-wide, so scenes are best run in increasing size
+            for (SceneResult& scene : scenes) {
+                out << (first ? "" : ",\n");
+                first = false;
+                out << "    {\"list\": \"" << scene.list << "\", \"shapes\": " << scene.shapes
+                    << ", \"heap_kb\": " << scene.heapGrowthKb << ", \"peak_rss_kb\": " << scene.peakRssKb
+                    << ", \"operations\": [\n";
+                for (size_t i = 0; i < scene.operations.size(); ++i) {
+                    writeOperation(out, scene.operations[i]);
+                    out << (i + 1 < scene.operations.size() ? ",\n" : "\n");
+                }
+                out << "    ]}";
+            }
+            out.flush();
+        }
+        out << "\n  ]\n}\n";
+    }
+
+    // Parse the options that follow --bench; returns false with a message on bad input
+    static bool parseArguments(int argc, char* argv[], int first, BenchmarkConfig& cfg, string& outPath, string& error) {
+        for (int i = first; i < argc; ++i) {
+            string option = argv[i];
+            if (i + 1 >= argc) {
+                error = "Missing value for " + option + ".";
+                return false;
+            }
+            string value = argv[++i];
+            if (option == "--sizes" || option == "--mix") {
+                vector<double> numbers;
+                stringstream items(value);
+                string item;
+                while (getline(items, item, ',')) {
+                    char* end = nullptr;
+                    double number = strtod(item.c_str(), &end);
+                    if (item.empty() || *end != '\0' || !(number >= 0.0)) {
+                        error = "Invalid number '" + item + "' in " + option + ".";
+                        return false;
+                    }
+                    numbers.push_back(number);
+                }
+                if (option == "--sizes") {
+                    cfg.sizes.clear();
+                    for (double n : numbers) {
+                        if (n < 1.0) {
+                            error = "Scene sizes must be at least 1.";
+                            return false;
+                        }
+                        cfg.sizes.push_back(static_cast<size_t>(n));
+                    }
+                    if (cfg.sizes.empty()) {
+                        error = "No scene sizes given.";
+                        return false;
+                    }
+                } else {
+                    if (numbers.size() != 4 || numbers[0] + numbers[1] + numbers[2] + numbers[3] <= 0.0) {
+                        error = "--mix needs four weights (rectangle,square,circle,triangle) with a positive sum.";
+                        return false;
+                    }
+                    for (int k = 0; k < 4; ++k) {
+                        cfg.mix[k] = numbers[k];
+                    }
+                }
+            } else if (option == "--reps" || option == "--removes" || option == "--threads" || option == "--seed") {
+                char* end = nullptr;
+                unsigned long long number = strtoull(value.c_str(), &end, 10);
+                if (value.empty() || *end != '\0') {
+                    error = "Invalid value '" + value + "' for " + option + ".";
+                    return false;
+                }
+                if (option == "--reps") {
+                    cfg.repetitions = max(1, static_cast<int>(number));
+                } else if (option == "--removes") {
+                    cfg.removals = static_cast<size_t>(number);
+                } else if (option == "--threads") {
+                    cfg.threads = max(1, static_cast<int>(number));
+                } else {
+                    cfg.seed = number;
+                }
+            } else if (option == "--lists") {
+                cfg.lists[0] = cfg.lists[1] = cfg.lists[2] = false;
+                stringstream items(value);
+                string item;
+                while (getline(items, item, ',')) {
+                    if (item == "shape") {
+                        cfg.lists[0] = true;
+                    } else if (item == "variant") {
+                        cfg.lists[1] = true;
+                    } else if (item == "columnar") {
+                        cfg.lists[2] = true;
+                    } else {
+                        error = "Unknown list '" + item + "' in --lists (use shape, variant and/or columnar).";
+                        return false;
+                    }
+                }
+                if (!cfg.lists[0] && !cfg.lists[1] && !cfg.lists[2]) {
+                    error = "No list given in --lists.";
+                    return false;
+                }
+            } else if (option == "--out") {
+                outPath = value;
+            } else {
+                error = "Unknown option " + option + ".";
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+
+// ==============================
+// Test function for ShapeBenchmark class
+// ==============================
+void test_shape_benchmark_class() {
+    cout << "\n========== Running test_shape_benchmark_class() ==========" << endl;
+
+    int passed = 0, failed = 0;
+
+    // Test 1: Options are parsed, including exponent sizes
+    BenchmarkConfig cfg;
+    string outPath, error;
+    const char* args[] = {"shapes", "--bench", "--sizes", "1e3,200", "--mix", "1,0,2,1", "--reps", "2", "--removes", "10",
+                          "--lists", "variant"};
+    bool ok = ShapeBenchmark::parseArguments(12, const_cast<char**>(args), 2, cfg, outPath, error);
+    const char* bad[] = {"shapes", "--bench", "--mix", "1,2"};
+    BenchmarkConfig unused;
+    if (ok && cfg.sizes.size() == 2 && cfg.sizes[0] == 1000 && cfg.sizes[1] == 200 && cfg.mix[1] == 0.0 &&
+        cfg.repetitions == 2 && cfg.removals == 10 && !cfg.lists[0] && cfg.lists[1] && !cfg.lists[2] &&
+        !ShapeBenchmark::parseArguments(4, const_cast<char**>(bad), 2, unused, outPath, error)) {
+        cout << "Test 1 passed: Argument parsing" << endl;
+        passed++;
+    } else {
+        cout << "Test 1 FAILED: Argument parsing" << endl;
+        failed++;
+    }
+
+    // Test 2: A small run reports every operation for every scene and list
+    cfg.sizes = {200};
+    cfg.lists[0] = cfg.lists[2] = true;
+    stringstream report;
+    ShapeBenchmark(cfg).run(report);
+    string json = report.str();
+    const char* names[] = {"addShape", "removeShape", "translateShapes", "scale", "\"area\"", "\"perimeter\"", "display"};
+    bool complete = json.find("\"shapes\": 200,") != string::npos && json.find("peak_rss_kb") != string::npos &&
+                    json.find("\"list\": \"ShapeList\"") != string::npos &&
+                    json.find("\"list\": \"VariantShapeList\"") != string::npos &&
+                    json.find("\"list\": \"ColumnarShapeList\"") != string::npos;
+    for (const char* name : names) {
+        complete = complete && json.find(name) != string::npos;
+    }
+    if (complete && json.front() == '{' && json.find("]\n}\n") != string::npos) {
+        cout << "Test 2 passed: JSON report" << endl;
+        passed++;
+    } else {
+        cout << "Test 2 FAILED: JSON report" << endl;
+        failed++;
+    }
+
+    // Summary
+    cout << "========== Test Summary ==========" << endl;
+    cout << "Passed: " << passed << ", Failed: " << failed << endl;
+    cout << "==================================\n" << endl;
+}
+
+// ShapeManagement Class
+
+class ShapeManagement {
+private:
+    ShapeList shapes;  // Composition: ShapeManagement "has-a" ShapeList
+#if defined(__unix__) || defined(__APPLE__)
+    unique_ptr<WriteAheadLog> log;  // Declared after shapes: detaches before the list goes away
+#endif
+
+public:
+    // Operation statistics are collected from the start so they can be shown at any time
+    ShapeManagement() {
+        shapes.enableStats(true);
+    }
+
+    // Recover the shapes from the log in dir and log every later change;
+    // must be called before any shape is added
+    bool enableLog(const string& dir, const WalOptions& options) {
+#if defined(__unix__) || defined(__APPLE__)
+        log.reset(new WriteAheadLog());
+        if (!log->open(dir, shapes, options)) {
+            log.reset();
+            return false;
+        }
+        cout << "Recovered " << shapes.size() << " shapes (" << log->recoveredRecords()
+             << " log records after checkpoint " << log->lastCheckpoint() << ")." << endl;
+        return true;
+#else
+        (void)dir;
+        (void)options;
+        cout << "Warning: The shape log needs a POSIX system." << endl;
+        return false;
+#endif
+    }
+
+    // Parse "--log <dir>" and "--sync always|interval|none". Returns false
+    // for any other option, or with error set for a bad value.
+    static bool parseLogOption(const string& option, const string& value, string& dir, WalOptions& options,
+                               string& error) {
+        if (option == "--log") {
+            dir = value;
+            return true;
+        }
+        if (option != "--sync") {
+            return false;
+        }
+        if (value == "always") {
+            options.sync = WalSync::Always;
+        } else if (value == "interval") {
+            options.sync = WalSync::Interval;
+        } else if (value == "none") {
+            options.sync = WalSync::None;
+        } else {
+            error = "Unknown sync policy " + value + ".";
+            return false;
+        }
+        return true;
+    }
+
+    // Make the changes of the calling thread durable as the log's sync policy
+    // requires; call it after a command, outside any lock around the scene
+    bool commitLog() {
+#if defined(__unix__) || defined(__APPLE__)
+        return log == nullptr || log->commit();
+#else
+        return true;
+#endif
+    }
+
+    // Display menu options
+    void displayMenu() {
+        cout << "\n\n Shape Management Menu " << endl;
+        cout << "1. Add a shape" << endl;
+        cout << "2. Remove a shape" << endl;
+        cout << "3. Display all shapes" << endl;
+        cout << "4. Translate all shapes" << endl;
+        cout << "5. Scale all shapes" << endl;
+        cout << "6. Get area of a shape by position" << endl;
+        cout << "7. Get perimeter of a shape by position" << endl;
+        cout << "8. Import shapes from a file" << endl;
+        cout << "9. Show operation statistics" << endl;
+        cout << "0. Exit\n\n" << endl;
+    }
+
+    // Add a shape (user selects type and provides input)
+    void addShape() {
+        int type;
+        cout << "Select shape type: 1-Rectangle, 2-Circle, 3-Square, 4-Triangle: ";
+        cin >> type;
+
+        if (type == 1) {
+            int x, y;
+            double width, length;
+            cout << "Enter x y coordinates: ";
+            cin >> x >> y;
+            cout << "Enter width and length: ";
+            cin >> width >> length;
+            shapes.createShape<Rectangle>(Coordinates(x, y), width, length);
+        }
+        else if (type == 2) {
+            int x, y;
+            double radius;
+            cout << "Enter x y coordinates: ";
+            cin >> x >> y;
+            cout << "Enter radius: ";
+            cin >> radius;
+            shapes.createShape<Circle>(Coordinates(x, y), radius);
+        }
+        else if (type == 3) {
+            int x, y;
+            double side;
+            cout << "Enter x y coordinates: ";
+            cin >> x >> y;
+            cout << "Enter side length: ";
+            cin >> side;
+            shapes.createShape<Square>(Coordinates(x, y), side);
+        }
+        else if (type == 4) {
+            int x1, y1, x2, y2, x3, y3;
+            cout << "Enter coordinates of point 1: ";
+            cin >> x1 >> y1;
+            cout << "Enter coordinates of point 2: ";
+            cin >> x2 >> y2;
+            cout << "Enter coordinates of point 3: ";
+            cin >> x3 >> y3;
+            shapes.createShape<Triangle>(
+                Coordinates(x1, y1),
+                Coordinates(x2, y2),
+                Coordinates(x3, y3)
+            );
+        } else {
+            cout << "Invalid shape type selected." << endl;
+        }
+    }
+
+    // Remove a shape at a given position
+    void removeShape() {
+        int pos;
+        cout << "Enter shape position to remove (starting from 0): ";
+        cin >> pos;
+        Shape* removed = shapes.removeShape(pos);
+        if (removed != nullptr) {
+            cout << "Shape removed: " << removed->display() << endl;
+            delete removed;  // Important: free memory
+        }
+    }
+
+    // Display all shapes
+    void displayShapes() {
+        shapes.display(cout);
+    }
+     
+        // Get area of a shape at a given position
+    void getAreaOfShape() {
+        int pos;
+        cout << "Enter shape position to calculate area (starting from 0): ";
+        cin >> pos;
+        double result = shapes.area(pos);
+        if (result >= 0) {
+            cout << "Area of shape at position " << pos << " = " << result << endl;
+        } else {
+            cout << "Invalid position. Cannot compute area." << endl;
+        }
+    }
+
+    // Get perimeter of a shape at a given position
+    void getPerimeterOfShape() {
+        int pos;
+        cout << "Enter shape position to calculate perimeter (starting from 0): ";
+        cin >> pos;
+        double result = shapes.perimeter(pos);
+        if (result >= 0) {
+            cout << "Perimeter of shape at position " << pos << " = " << result << endl;
+        } else {
+            cout << "Invalid position. Cannot compute perimeter." << endl;
+        }
+    }
+    // Translate all shapes
+    void translateShapes() {
+        int dx, dy;
+        cout << "Enter dx and dy to translate all shapes: ";
+        cin >> dx >> dy;
+        shapes.translateShapes(dx, dy);
+    }
+
+    // Scale all shapes
+    void scaleShapes() {
+        int factor;
+        bool sign;
+        cout << "Enter scale factor: ";
+        cin >> factor;
+        cout << "Enter scale type (1 for multiply, 0 for divide): ";
+        cin >> sign;
+        shapes.scale(factor, sign);
+    }
+
+    // Bulk-load shapes from a text/CSV file
+    void importShapes() {
+        string path;
+        cout << "Enter file path: ";
+        cin >> path;
+        ShapeImporter importer(8 << 20, static_cast<int>(thread::hardware_concurrency()));
+        ImportResult result = importer.importFile(path, shapes);
+        cout << "Imported " << result.shapesLoaded << " shapes from " << result.linesRead << " lines." << endl;
+        size_t shown = min(result.errors.size(), static_cast<size_t>(10));
+        for (size_t i = 0; i < shown; ++i) {
+            cout << "Line " << result.errors[i].line << ": " << result.errors[i].message << endl;
+        }
+        if (result.errors.size() > shown) {
+            cout << "... and " << result.errors.size() - shown << " more errors." << endl;
+        }
+    }
+
+    // Print call counts and latency percentiles per ShapeList operation
+    void showStatistics() {
+        ShapeListStats* stats = shapes.getStats();
+        if (stats == nullptr) {
+            cout << "Operation statistics are disabled." << endl;
+            return;
+        }
+        ShapeWriter out(cout);
+        stats->write(out);
+    }
+
+    // Check a position argument; sets error when no shape is there
+    bool validPosition(int pos, string& error) {
+        if (pos < 0 || pos >= shapes.size()) {
+            error = "Invalid position " + to_string(pos) + " (the scene has " + to_string(shapes.size()) + " shapes)";
+            return false;
+        }
+        return true;
+    }
+
+    // Run a bulk transform and write a summary of the shapes it skipped or
+    // reset to out, rather than one console warning per shape
+    template <typename Fn>
+    void transform(ostream& out, Fn fn) {
+        DiagnosticsReport warnings;
+        shapes.collectDiagnostics(warnings, fn);
+        if (warnings.total() > 0) {
+            ShapeWriter writer(out);
+            warnings.write(writer);
+        }
+    }
+
+    // Run one script command, writing its result to out.
+    // Returns false and sets error when the command is not understood or its
+    // arguments are invalid.
+    bool runCommand(const string& line, ostream& out, string& error) {
+        istringstream in(line);
+        string command;
+        in >> command;
+        if (command == "add") {
+            string rest;
+            getline(in, rest);
+            return ShapeImporter::addShapeLine(rest, shapes, error);
+        }
+        if (command == "remove") {
+            int pos;
+            if (!(in >> pos)) {
+                error = "Usage: remove <position>";
+                return false;
+            }
+            if (!validPosition(pos, error)) {
+                return false;
+            }
+            Shape* removed = shapes.removeShape(pos);
+            if (removed != nullptr) {
+                out << "Shape removed: " << removed->display() << '\n';
+                delete removed;
+            }
+            return true;
+        }
+        if (command == "translate") {
+            int dx, dy;
+            if (!(in >> dx >> dy)) {
+                error = "Usage: translate <dx> <dy>";
+                return false;
+            }
+            transform(out, [this, dx, dy]() { shapes.translateShapes(dx, dy); });
+            return true;
+        }
+        if (command == "scale") {
+            int factor, sign;
+            if (!(in >> factor >> sign) || (sign != 0 && sign != 1)) {
+                error = "Usage: scale <factor> <1 multiply | 0 divide>";
+                return false;
+            }
+            if (factor <= 0) {
+                error = "Scaling factor must be greater than 0";
+                return false;
+            }
+            transform(out, [this, factor, sign]() { shapes.scale(factor, sign != 0); });
+            return true;
+        }
+        if (command == "area" || command == "perimeter") {
+            int pos;
+            if (!(in >> pos)) {
+                error = "Usage: " + command + " <position>";
+                return false;
+            }
+            if (!validPosition(pos, error)) {
+                return false;
+            }
+            double result = command == "area" ? shapes.area(pos) : shapes.perimeter(pos);
+            string name = command == "area" ? "Area" : "Perimeter";
+            out << name << " of shape at position " << pos << " = " << result << '\n';
+            return true;
+        }
+        if (command == "display") {
+            // Optional range: display <first> <last> (positions, last excluded)
+            int first = 0, last = -1;
+            if (in >> first && !(in >> last)) {
+                last = first + 1;
+            }
+            shapes.display(out, first, last);
+            return true;
+        }
+        if (command == "import") {
+            string path;
+            if (!(in >> path)) {
+                error = "Usage: import <file>";
+                return false;
+            }
+            ShapeImporter importer(8 << 20, static_cast<int>(thread::hardware_concurrency()));
+            ImportResult result = importer.importFile(path, shapes);
+            out << "Imported " << result.shapesLoaded << " shapes from " << result.linesRead << " lines, "
+                << result.errors.size() << " errors.\n";
+            return true;
+        }
+        if (command == "overlaps") {
+            // overlaps [list]: count the overlapping pairs, optionally listing them
+            string mode;
+            in >> mode;
+            vector<pair<int, int>> pairs;
+            size_t count = shapes.findOverlaps([&pairs, &mode](int i, int j) {
+                if (mode == "list") {
+                    pairs.push_back(make_pair(i, j));
+                }
+            });
+            sort(pairs.begin(), pairs.end());
+            for (const pair<int, int>& p : pairs) {
+                out << p.first << ' ' << p.second << '\n';
+            }
+            out << "Overlapping pairs: " << count << '\n';
+            return true;
+        }
+        if (command == "hit") {
+            // hit <x> <y> [<x> <y> ...]: the shapes containing each point
+            vector<double> xs, ys;
+            double x, y;
+            while (in >> x >> y) {
+                xs.push_back(x);
+                ys.push_back(y);
+            }
+            if (xs.empty()) {
+                error = "Usage: hit <x> <y> [<x> <y> ...]";
+                return false;
+            }
+            HitResults hits;
+            shapes.hitTest(xs, ys, hits);
+            for (size_t i = 0; i < xs.size(); ++i) {
+                out << "Point (" << xs[i] << ", " << ys[i] << "):";
+                for (size_t k = 0; k < hits.hitCount(i); ++k) {
+                    out << ' ' << hits.hits(i)[k];
+                }
+                out << (hits.hitCount(i) == 0 ? " no shapes\n" : "\n");
+            }
+            return true;
+        }
+        if (command == "totals") {
+            const SceneAggregates& totals = shapes.aggregates();
+            out << "Shapes: " << totals.count << " (" << totals.countOf(ShapeKind::Rectangle) << " rectangles, "
+                << totals.countOf(ShapeKind::Square) << " squares, " << totals.countOf(ShapeKind::Circle) << " circles, "
+                << totals.countOf(ShapeKind::Triangle) << " triangles)\n"
+                << "Total area = " << totals.totalArea() << ", mean area = " << totals.meanArea() << '\n'
+                << "Total perimeter = " << totals.totalPerimeter() << ", mean perimeter = " << totals.meanPerimeter() << '\n'
+                << "Bounds = (" << totals.bounds.minX << ", " << totals.bounds.minY << ") - ("
+                << totals.bounds.maxX << ", " << totals.bounds.maxY << ")\n";
+            return true;
+        }
+        if (command == "stats") {
+            // stats [text | json | reset | on | off]
+            string mode = "text";
+            in >> mode;
+            if (mode == "on" || mode == "off") {
+                shapes.enableStats(mode == "on");
+                return true;
+            }
+            ShapeListStats* stats = shapes.getStats();
+            if (stats == nullptr) {
+                out << "Operation statistics are disabled.\n";
+                return true;
+            }
+            if (mode == "reset") {
+                stats->reset();
+                return true;
+            }
+            if (mode != "text" && mode != "json") {
+                error = "Usage: stats [text | json | reset | on | off]";
+                return false;
+            }
+            ShapeWriter writer(out);
+            if (mode == "json") {
+                stats->writeJson(writer);
+            } else {
+                stats->write(writer);
+            }
+            return true;
+        }
+        if (command == "diagnostics") {
+            // diagnostics [on [ids] | off | ids | clear]; no argument prints the summary
+            string mode, option;
+            in >> mode >> option;
+            if (mode == "on" || mode == "off") {
+                shapes.setDiagnosticsMode(mode == "on", option == "ids");
+                return true;
+            }
+            if (mode == "clear") {
+                shapes.clearDiagnostics();
+                return true;
+            }
+            const DiagnosticsReport& report = shapes.getDiagnostics();
+            if (mode.empty()) {
+                out << shapes.diagnosticsSummary();
+                return true;
+            }
+            if (mode != "ids") {
+                error = "Usage: diagnostics [on [ids] | off | ids | clear]";
+                return false;
+            }
+            static const char* const names[DIAGNOSTIC_KINDS] = {"translation skipped", "scale skipped", "size reset"};
+            for (int k = 0; k < DIAGNOSTIC_KINDS; ++k) {
+                vector<size_t> ids = report.affectedShapes(static_cast<ShapeDiagnostic>(k));
+                if (ids.empty()) {
+                    continue;
+                }
+                out << names[k] << ':';
+                for (size_t id : ids) {
+                    out << ' ' << id;
+                }
+                out << '\n';
+            }
+            return true;
+        }
+        if (command == "checkpoint") {
+#if defined(__unix__) || defined(__APPLE__)
+            if (log == nullptr) {
+                error = "No shape log is enabled";
+                return false;
+            }
+            if (!log->checkpoint()) {
+                error = "Checkpoint failed";
+                return false;
+            }
+            out << "Checkpoint at record " << log->lastCheckpoint() << '\n';
+            return true;
+#else
+            error = "No shape log is enabled";
+            return false;
+#endif
+        }
+        error = "Unknown command '" + command + "'";
+        return false;
+    }
+
+    // Run every command of a script without the menu, then report the
+    // total time spent per command type. Blank lines and '#' comments are skipped.
+    void runScript(istream& script, ostream& out) {
+        struct Timing {
+            size_t calls = 0;
+            chrono::nanoseconds total{0};
+        };
+        vector<pair<string, Timing>> timings;  // In order of first use
+        string line;
+        size_t lineNumber = 0;
+        while (getline(script, line)) {
+            lineNumber++;
+            size_t start = line.find_first_not_of(" \t\r");
+            if (start == string::npos || line[start] == '#') {
+                continue;
+            }
+            string command = line.substr(start, line.find_first_of(" \t\r", start) - start);
+            string error;
+            auto begin = chrono::steady_clock::now();
+            bool ok = runCommand(line, out, error);
+            if (ok && !commitLog()) {
+                ok = false;
+                error = "Cannot write the shape log";
+            }
+            auto elapsed = chrono::steady_clock::now() - begin;
+            if (!ok) {
+                out << "Error on line " << lineNumber << ": " << error << '\n';
+                continue;
+            }
+            auto it = find_if(timings.begin(), timings.end(),
+                              [&command](const pair<string, Timing>& t) { return t.first == command; });
+            if (it == timings.end()) {
+                timings.push_back(make_pair(command, Timing()));
+                it = timings.end() - 1;
+            }
+            it->second.calls++;
+            it->second.total += chrono::duration_cast<chrono::nanoseconds>(elapsed);
+        }
+
+        out << "\n--- Command timings ---\n";
+        for (const pair<string, Timing>& t : timings) {
+            double ms = t.second.total.count() / 1e6;
+            out << t.first << ": " << t.second.calls << " calls, " << ms << " ms total, "
+                << ms * 1000.0 / t.second.calls << " us average\n";
+        }
+    }
+
+            // Direct add method for testing (bypasses menu)
+        void addShapeDirectly(Shape* shape) {
+            shapes.addShape(shape);
+        }
+
+        // Provide access to ShapeList for testing
+        ShapeList& getShapeList() {
+            return shapes;
+        }
+};
+
+
+// ==============================
+// Test function for ShapeManagement class
+// ==============================
+void test_shape_management_class() {
+    cout << "\n========== Running test_shape_management_class() ==========" << endl;
+
+    int passed = 0, failed = 0;
+
+    // Test 1: A script adds, transforms and queries shapes
+    ShapeManagement manager;
+    istringstream script(
+        "# build a scene\n"
+        "add rect,10,20,5,10\n"
+        "add circle 5 5 1\n"
+        "add triangle,0,0,4,0,0,3\n"
+        "translate 1 1\n"
+        "scale 2 1\n"
+        "area 0\n"
+        "perimeter 2\n"
+        "remove 1\n"
+        "display\n"
+        "totals\n");
+    ostringstream out;
+    manager.runScript(script, out);
+    string text = out.str();
+    if (manager.getShapeList().size() == 2 &&
+        text.find("Area of shape at position 0 = 200") != string::npos &&
+        text.find("Perimeter of shape at position 2 = 24") != string::npos &&
+        text.find("Shape removed: Circle") != string::npos &&
+        text.find("Shape 2: Triangle") != string::npos &&
+        text.find("Shapes: 2 (1 rectangles, 0 squares, 0 circles, 1 triangles)") != string::npos &&
+        text.find("Total area = 224") != string::npos) {
+        cout << "Test 1 passed: Script commands" << endl;
+        passed++;
+    } else {
+        cout << "Test 1 FAILED: Script commands" << endl;
+        failed++;
+    }
+
+    // Test 2: Timings are reported per command type, and bad lines are reported
+    if (text.find("add: 3 calls") != string::npos && text.find("display: 1 calls") != string::npos) {
+        cout << "Test 2 passed: Command timings" << endl;
+        passed++;
+    } else {
+        cout << "Test 2 FAILED: Command timings" << endl;
+        failed++;
+    }
+
+    istringstream bad("explode 1\nadd square,1,1\ntranslate x\n");
+    ostringstream badOut;
+    manager.runScript(bad, badOut);
+    if (badOut.str().find("Error on line 1: Unknown command 'explode'") != string::npos &&
+        badOut.str().find("Error on line 2") != string::npos &&
+        badOut.str().find("Error on line 3") != string::npos) {
+        cout << "Test 3 passed: Invalid commands reported" << endl;
+        passed++;
+    } else {
+        cout << "Test 3 FAILED: Invalid commands" << endl;
+        failed++;
+    }
+
+    // Test 4: The stats command reports the ShapeList operations behind the script
+    istringstream statsScript("stats json\nstats reset\narea 0\nstats\nstats off\nstats\nstats bogus\n");
+    ostringstream statsOut;
+    manager.runScript(statsScript, statsOut);
+    string report = statsOut.str();
+    if (report.find("{\"name\": \"display\", \"calls\": 1") != string::npos &&
+        report.find("area: 1 calls, 1 shapes") != string::npos &&
+        report.find("translateShapes:") == string::npos &&
+        report.find("Operation statistics are disabled.") != string::npos) {
+        cout << "Test 4 passed: Stats command" << endl;
+        passed++;
+    } else {
+        cout << "Test 4 FAILED: Stats command" << endl;
+        failed++;
+    }
+
+    // Test 5: Diagnostics mode replaces per-shape warnings with a summary and ids
+    ShapeManagement quiet;
+    istringstream diagnosticsScript(
+        "diagnostics on ids\n"
+        "add square 1 1 2\n"
+        "add circle 50 50 3\n"
+        "add square 2 2 2\n"
+        "translate -10 0\n"
+        "diagnostics\n"
+        "diagnostics ids\n");
+    ostringstream diagnosticsOut;
+    quiet.runScript(diagnosticsScript, diagnosticsOut);
+    string diagnosticsText = diagnosticsOut.str();
+    if (diagnosticsText.find("2 translations skipped (negative coordinates)") != string::npos &&
+        diagnosticsText.find("translation skipped: 0 2\n") != string::npos &&
+        diagnosticsText.find("Warning:") == string::npos) {
+        cout << "Test 5 passed: Diagnostics command" << endl;
+        passed++;
+    } else {
+        cout << "Test 5 FAILED: Diagnostics command" << endl;
+        failed++;
+    }
+
+    // Test 6: The overlaps command lists overlapping pairs by position
+    ShapeManagement scene;
+    istringstream overlapScript("add rect 0 0 10 10\nadd circle 30 30 2\nadd square 8 8 5\noverlaps list\n");
+    ostringstream overlapOut;
+    scene.runScript(overlapScript, overlapOut);
+    if (overlapOut.str().find("0 2\nOverlapping pairs: 1\n") != string::npos) {
+        cout << "Test 6 passed: Overlaps command" << endl;
+        passed++;
+    } else {
+        cout << "Test 6 FAILED: Overlaps command" << endl;
+        failed++;
+    }
+
+    // Test 7: Bad positions and arguments are errors, skipped shapes are summarized in the output
+    string positionError, scaleError, signError;
+    ostringstream ignored;
+    bool refused = !scene.runCommand("area 3", ignored, positionError) &&
+                   !scene.runCommand("remove -1", ignored, positionError) &&
+                   !scene.runCommand("scale 0 1", ignored, scaleError) &&
+                   !scene.runCommand("scale 2 5", ignored, signError) && ignored.str().empty();
+    istringstream skipScript("translate -10 0\nperimeter 3\n");
+    ostringstream skipOut;
+    scene.runScript(skipScript, skipOut);
+    if (refused && positionError == "Invalid position -1 (the scene has 3 shapes)" &&
+        scaleError == "Scaling factor must be greater than 0" && signError.compare(0, 6, "Usage:") == 0 &&
+        skipOut.str().find("2 translations skipped (negative coordinates)\n") != string::npos &&
+        skipOut.str().find("Error on line 2: Invalid position 3") != string::npos &&
+        scene.getShapeList().getDiagnostics().total() == 0) {
+        cout << "Test 7 passed: Command arguments checked" << endl;
+        passed++;
+    } else {
+        cout << "Test 7 FAILED: Command arguments checked" << endl;
+        failed++;
+    }
+
+    // Summary
+    cout << "========== Test Summary ==========" << endl;
+    cout << "Passed: " << passed << ", Failed: " << failed << endl;
+    cout << "==================================\n" << endl;
+}
+
+#if defined(__linux__)
+
+// ==============================
+// ShapeServer Class
+// ==============================
+// Serves the script commands of one ShapeManagement scene to many clients
+// over a Unix domain socket or loopback TCP. One thread runs an epoll loop
+// over non-blocking sockets. A request is one command line, as in a script;
+// the response is "+<length>\n" followed by the command's output, or
+// "-<length>\n" followed by the error message. Clients may pipeline any
+// number of requests; responses come back in request order.
+//
+// With worker threads the loop only moves bytes: each connection's
+// complete lines go to the workers in batches, one batch per connection at
+// a time so its responses stay in order. Commands still change the scene
+// one at a time.
+
+// Where a server listens or a client connects: a Unix socket path, or a loopback TCP port
+struct ServerAddress {
+    string unixPath;
+    int port = 0;
+};
+
+class ShapeServer {
+private:
+    static constexpr size_t MAX_LINE = 64 * 1024;           // Longer requests close the connection
+    static constexpr size_t MAX_UNSENT = 4 << 20;          // Stop executing and reading while this much output waits
+    static constexpr size_t MAX_UNREAD = 4 << 20;          // Stop reading while this much input waits
+    static constexpr size_t MAX_BATCH = 256;               // Lines handed to a worker at once
+    static constexpr uint64_t LISTENER = 0, WAKEUP = 1;    // epoll ids below the first connection
+
+    struct Connection {
+        int fd = -1;
+        string input;            // Received bytes not yet executed
+        string output;           // Responses not yet sent
+        size_t sent = 0;         // Bytes of output already sent
+        bool busy = false;       // A batch is with the workers
+        bool peerClosed = false; // No more requests will arrive
+        uint32_t events = 0;     // Current epoll interest; 0 = not registered
+    };
+
+    struct Job {
+        uint64_t id;
+        vector<string> lines;
+        string responses;
+    };
+
+    ShapeManagement& scene;
+    mutex sceneLock;  // Held while a command runs
+    int listenFd = -1;
+    int epollFd = -1;
+    int wakeFd = -1;  // eventfd: finished jobs or stop()
+    string socketPath;
+    int boundPort = 0;
+    uint64_t nextId = 2;
+    unordered_map<uint64_t, unique_ptr<Connection>> connections;
+    atomic<bool> stopping{false};
+    atomic<uint64_t> served{0};
+
+    vector<thread> workers;
+    mutex jobLock;
+    condition_variable jobReady;
+    deque<Job> jobs;      // Waiting for a worker
+    deque<Job> finished;  // Waiting for the loop
+
+    // Run one request line and append its framed response
+    void execute(const string& line, string& responses) {
+        ostringstream out;
+        string error;
+        bool ok;
+        {
+            lock_guard<mutex> lock(sceneLock);
+            ok = scene.runCommand(line, out, error);
+        }
+        string text = ok ? out.str() : error;
+        responses += ok ? '+' : '-';
+        responses += to_string(text.size());
+        responses += '\n';
+        responses += text;
+        served++;
+    }
+
+    void workerLoop() {
+        for (;;) {
+            Job job;
+            {
+                unique_lock<mutex> lock(jobLock);
+                jobReady.wait(lock, [this]() { return stopping || !jobs.empty(); });
+                if (stopping) {
+                    return;
+                }
+                job = move(jobs.front());
+                jobs.pop_front();
+            }
+            for (const string& line : job.lines) {
+                execute(line, job.responses);
+            }
+            scene.commitLog();  // One durable flush per batch, shared with the other workers
+            {
+                lock_guard<mutex> lock(jobLock);
+                finished.push_back(move(job));
+            }
+            wake();
+        }
+    }
+
+    void wake() {
+        uint64_t one = 1;
+        ssize_t written = ::write(wakeFd, &one, sizeof(one));
+        (void)written;  // The counter only saturates if the loop is already awake
+    }
+
+    // Set the epoll interest of a connection: requests while the peer is open
+    // and neither buffer is over its limit, output while some is unsent. A
+    // client that pipelines faster than it reads is thus left to the kernel's
+    // socket buffers until its output drains. A closed peer waiting for its
+    // responses is unregistered, since its hang-up would otherwise be
+    // reported on every wait.
+    void watch(uint64_t id, Connection& c) {
+        bool reading = !c.peerClosed && c.output.size() - c.sent < MAX_UNSENT && c.input.size() < MAX_UNREAD;
+        uint32_t events = (reading ? static_cast<uint32_t>(EPOLLIN) : 0u) |
+                          (c.sent < c.output.size() ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+        if (events == c.events) {
+            return;
+        }
+        epoll_event ev{};
+        ev.events = events;
+        ev.data.u64 = id;
+        if (events == 0) {
+            epoll_ctl(epollFd, EPOLL_CTL_DEL, c.fd, nullptr);
+        } else {
+            epoll_ctl(epollFd, c.events == 0 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, c.fd, &ev);
+        }
+        c.events = events;
+    }
+
+    void closeConnection(uint64_t id) {
+        auto it = connections.find(id);
+        if (it != connections.end()) {
+            if (it->second->events != 0) {
+                epoll_ctl(epollFd, EPOLL_CTL_DEL, it->second->fd, nullptr);
+            }
+            ::close(it->second->fd);
+            connections.erase(it);
+        }
+    }
+
+    // Execute (or hand to the workers) the complete lines received so far
+    void takeRequests(Connection& c, uint64_t id) {
+        if (c.busy) {
+            return;
+        }
+        Job job;
+        job.id = id;
+        size_t start = 0;
+        while (c.output.size() - c.sent < MAX_UNSENT && job.lines.size() < MAX_BATCH) {
+            size_t end = c.input.find('\n', start);
+            if (end == string::npos) {
+                break;
+            }
+            size_t length = end - start;
+            if (length > 0 && c.input[end - 1] == '\r') {
+                length--;
+            }
+            if (workers.empty()) {
+                execute(c.input.substr(start, length), c.output);
+            } else {
+                job.lines.push_back(c.input.substr(start, length));
+            }
+            start = end + 1;
+        }
+        if (workers.empty() && start > 0) {
+            scene.commitLog();
+        }
+        c.input.erase(0, start);
+        if (c.input.size() > MAX_LINE && c.input.find('\n') == string::npos) {
+            string message = "Request line too long";
+            c.output += "-" + to_string(message.size()) + "\n" + message;
+            c.input.clear();
+            c.peerClosed = true;
+        }
+        if (!job.lines.empty()) {
+            c.busy = true;
+            {
+                lock_guard<mutex> lock(jobLock);
+                jobs.push_back(move(job));
+            }
+            jobReady.notify_one();
+        }
+    }
+
+    // Send as much output as the socket takes; returns false if the connection was closed
+    bool sendOutput(Connection& c, uint64_t id) {
+        while (c.sent < c.output.size()) {
+            ssize_t n = ::send(c.fd, c.output.data() + c.sent, c.output.size() - c.sent, MSG_NOSIGNAL);
+            if (n > 0) {
+                c.sent += static_cast<size_t>(n);
+            } else if (n < 0 && errno == EINTR) {
+                continue;
+            } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                break;
+            } else {
+                closeConnection(id);
+                return false;
+            }
+        }
+        if (c.sent == c.output.size()) {
+            c.output.clear();
+            c.sent = 0;
+        }
+        return true;
+    }
+
+    // Run what can be run for a connection, send what can be sent, and close it once it is done
+    void service(uint64_t id) {
+        auto it = connections.find(id);
+        if (it == connections.end()) {
+            return;
+        }
+        Connection& c = *it->second;
+        for (;;) {
+            takeRequests(c, id);
+            if (!sendOutput(c, id)) {
+                return;
+            }
+            // Output drained below the limit: more lines may be waiting
+            bool more = !c.busy && c.output.size() - c.sent < MAX_UNSENT && c.input.find('\n') != string::npos;
+            if (!more) {
+                break;
+            }
+        }
+        if (c.peerClosed && !c.busy && c.output.empty()) {
+            closeConnection(id);
+            return;
+        }
+        watch(id, c);
+    }
+
+    void receive(uint64_t id) {
+        auto it = connections.find(id);
+        if (it == connections.end()) {
+            return;
+        }
+        Connection& c = *it->second;
+        char buffer[64 * 1024];
+        while (c.input.size() < MAX_UNREAD) {
+            ssize_t n = ::recv(c.fd, buffer, sizeof(buffer), 0);
+            if (n > 0) {
+                c.input.append(buffer, static_cast<size_t>(n));
+            } else if (n == 0) {
+                c.peerClosed = true;
+                break;
+            } else if (errno == EINTR) {
+                continue;
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            } else {
+                closeConnection(id);
+                return;
+            }
+        }
+        service(id);
+    }
+
+    void acceptClients() {
+        for (;;) {
+            int fd = ::accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return;  // EAGAIN, or a client that vanished before accept
+            }
+            if (socketPath.empty()) {
+                int one = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            }
+            uint64_t id = nextId++;
+            unique_ptr<Connection> c(new Connection());
+            c->fd = fd;
+            c->events = EPOLLIN;
+            epoll_event ev{};
+            ev.events = EPOLLIN;
+            ev.data.u64 = id;
+            if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+                ::close(fd);
+                continue;
+            }
+            connections[id] = move(c);
+        }
+    }
+
+    // Hand the workers' responses back to their connections
+    void collectFinished() {
+        uint64_t count;
+        ssize_t n = ::read(wakeFd, &count, sizeof(count));
+        (void)n;
+        deque<Job> done;
+        {
+            lock_guard<mutex> lock(jobLock);
+            done.swap(finished);
+        }
+        for (Job& job : done) {
+            auto it = connections.find(job.id);
+            if (it == connections.end()) {
+                continue;  // The client went away meanwhile
+            }
+            it->second->output += job.responses;
+            it->second->busy = false;
+            service(job.id);
+        }
+    }
+
+    bool startListening(int fd, string& error) {
+        if (::listen(fd, SOMAXCONN) < 0) {
+            error = string("listen() failed: ") + strerror(errno);
+            ::close(fd);
+            return false;
+        }
+        listenFd = fd;
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.u64 = LISTENER;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &ev);
+        return true;
+    }
+
+public:
+    // Serve a scene; with workers > 0 commands run on that many worker threads
+    ShapeServer(ShapeManagement& managed, int workerCount = 0) : scene(managed) {
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.u64 = WAKEUP;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &ev);
+        for (int i = 0; i < workerCount; ++i) {
+            workers.emplace_back([this]() { workerLoop(); });
+        }
+    }
+
+    ShapeServer(const ShapeServer&) = delete;
+    ShapeServer& operator=(const ShapeServer&) = delete;
+
+    // Listen on a Unix domain socket; a stale socket file at the path is replaced
+    bool listenUnix(const string& path, string& error) {
+        sockaddr_un address{};
+        if (listenFd >= 0 || path.empty() || path.size() >= sizeof(address.sun_path)) {
+            error = listenFd >= 0 ? "Server is already listening." : "Invalid socket path '" + path + "'.";
+            return false;
+        }
+        struct stat info;
+        if (::stat(path.c_str(), &info) == 0 && S_ISSOCK(info.st_mode)) {
+            ::unlink(path.c_str());
+        }
+        int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        address.sun_family = AF_UNIX;
+        memcpy(address.sun_path, path.c_str(), path.size());
+        if (fd < 0 || ::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+            error = "Cannot bind " + path + ": " + strerror(errno);
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            return false;
+        }
+        socketPath = path;
+        return startListening(fd, error);
+    }
+
+    // Listen on 127.0.0.1; port 0 picks a free port (see port())
+    bool listenTcp(int port, string& error) {
+        if (listenFd >= 0) {
+            error = "Server is already listening.";
+            return false;
+        }
+        int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        int one = 1;
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(static_cast<uint16_t>(port));
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (fd < 0 || setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0 ||
+            ::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+            error = "Cannot bind port " + to_string(port) + ": " + strerror(errno);
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            return false;
+        }
+        socklen_t length = sizeof(address);
+        getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length);
+        boundPort = ntohs(address.sin_port);
+        return startListening(fd, error);
+    }
+
+    // Return the TCP port the server listens on (0 for a Unix socket)
+    int port() const {
+        return boundPort;
+    }
+
+    // Return the number of requests answered so far
+    uint64_t requestsServed() const {
+        return served;
+    }
+
+    // Run the event loop until stop() is called
+    void run() {
+        epoll_event events[64];
+        while (!stopping) {
+            int n = epoll_wait(epollFd, events, 64, -1);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                break;
+            }
+            for (int i = 0; i < n && !stopping; ++i) {
+                uint64_t id = events[i].data.u64;
+                if (id == LISTENER) {
+                    acceptClients();
+                } else if (id == WAKEUP) {
+                    collectFinished();
+                } else if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                    receive(id);
+                } else if (events[i].events & EPOLLOUT) {
+                    service(id);
+                }
+            }
+        }
+    }
+
+    // Make run() return; safe to call from any thread
+    void stop() {
+        {
+            lock_guard<mutex> lock(jobLock);
+            stopping = true;
+        }
+        jobReady.notify_all();
+        wake();
+    }
+
+    // Destructor: stop the workers and close every socket
+    ~ShapeServer() {
+        stop();
+        for (thread& t : workers) {
+            t.join();
+        }
+        for (auto& entry : connections) {
+            ::close(entry.second->fd);
+        }
+        if (listenFd >= 0) {
+            ::close(listenFd);
+        }
+        if (!socketPath.empty()) {
+            ::unlink(socketPath.c_str());
+        }
+        ::close(wakeFd);
+        ::close(epollFd);
+    }
+};
+
+
+// ==============================
+// ShapeClient Class
+// ==============================
+// Blocking client for a ShapeServer. Requests can be sent in any number
+// before their responses are read back.
+
+class ShapeClient {
+private:
+    int fd = -1;
+    string buffer;       // Received bytes not yet returned
+    size_t consumed = 0; // Bytes of buffer already returned
+
+    // Read more bytes from the server; false on end of stream or error
+    bool fill() {
+        char chunk[64 * 1024];
+        for (;;) {
+            ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+            if (n > 0) {
+                buffer.append(chunk, static_cast<size_t>(n));
+                return true;
             }
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            return false;
         }
     }
 
-    // Return the shape at a specific position (index starts at 0)
-    Shape* getShape(int pos) {
-        if (pos >= 0 && pos < static_cast<int>(listofShapes.size())) {
-            return listofShapes[pos];
+public:
+    ShapeClient() {}
+
+    ShapeClient(const ShapeClient&) = delete;
+    ShapeClient& operator=(const ShapeClient&) = delete;
+
+    // Connect to a server; returns false with a message on failure
+    bool connect(const ServerAddress& address, string& error) {
+        if (!address.unixPath.empty()) {
+            sockaddr_un target{};
+            if (address.unixPath.size() >= sizeof(target.sun_path)) {
+                error = "Invalid socket path '" + address.unixPath + "'.";
+                return false;
+            }
+            target.sun_family = AF_UNIX;
+            memcpy(target.sun_path, address.unixPath.c_str(), address.unixPath.size());
+            fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (fd >= 0 && ::connect(fd, reinterpret_cast<sockaddr*>(&target), sizeof(target)) == 0) {
+                return true;
+            }
+        } else {
+            sockaddr_in target{};
+            target.sin_family = AF_INET;
+            target.sin_port = htons(static_cast<uint16_t>(address.port));
+            target.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            int one = 1;
+            if (fd >= 0 && setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)) == 0 &&
+                ::connect(fd, reinterpret_cast<sockaddr*>(&target), sizeof(target)) == 0) {
+                return true;
+            }
         }
-        cout << "Warning: Invalid position in getShape(). Returning nullptr." << endl;
-        return nullptr;
-    }
-
-    // Remove the shape at a specific position and return it (caller is responsible for deletion)
-    Shape* removeShape(int pos) {
-        if (pos >= 0 && pos < static_cast<int>(listofShapes.size())) {
-            Shape* removed = listofShapes[pos];
-            listofShapes.erase(listofShapes.begin() + pos);
-            return removed;
+        error = string("Cannot connect: ") + strerror(errno);
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
         }
-        cout << "Warning: Invalid position in removeShape()." << endl;
-        return nullptr;
+        return false;
     }
 
-    // Return the area of the shape at a given position
-    double area(int pos) {
-        Shape* s = getShape(pos);
-        if (s != nullptr) {
-            return s->getArea();
+    // Send one or more request lines (each ending in '\n')
+    bool send(const string& requests) {
+        size_t sent = 0;
+        while (sent < requests.size()) {
+            ssize_t n = ::send(fd, requests.data() + sent, requests.size() - sent, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            sent += static_cast<size_t>(n);
         }
-        return -1.0;
+        return true;
     }
 
-    // Return the perimeter of the shape at a given position
-    double perimeter(int pos) {
-        Shape* s = getShape(pos);
-        if (s != nullptr) {
-            return s->getPerimeter();
+    // Read the next response; ok tells a result from an error message
+    bool receive(bool& ok, string& payload) {
+        if (consumed > 0 && (consumed == buffer.size() || consumed >= 64 * 1024)) {
+            buffer.erase(0, consumed);
+            consumed = 0;
         }
-        return -1.0;
-    }
-
-    // Scale all shapes in the list
-    void scale(int factor, bool sign) {
-        for (Shape* s : listofShapes) {
-            if (s != nullptr) {
-                s->scale(factor, sign);
+        size_t newline;
+        while ((newline = buffer.find('\n', consumed)) == string::npos) {
+            if (!fill()) {
+                return false;
             }
         }
-    }
-
-    // Display information about all shapes
-    string display() {
-        string result = "--- Shape List ---\n\n";
-        for (size_t i = 0; i < listofShapes.size(); ++i) {
-            result += "Shape " + to_string(i + 1) + ": " + listofShapes[i]->display() + "\n\n";
+        if (buffer[consumed] != '+' && buffer[consumed] != '-') {
+            return false;
         }
-        return result;
+        ok = buffer[consumed] == '+';
+        size_t length = strtoull(buffer.c_str() + consumed + 1, nullptr, 10);
+        while (buffer.size() - (newline + 1) < length) {
+            if (!fill()) {
+                return false;
+            }
+        }
+        payload.assign(buffer, newline + 1, length);
+        consumed = newline + 1 + length;
+        return true;
     }
 
-    // Destructor: delete all dynamically allocated shapes
-    ~ShapeList() {
-        for (Shape* s : listofShapes) {
-            delete s;
+    ~ShapeClient() {
+        if (fd >= 0) {
+            ::close(fd);
         }
-        listofShapes.clear();
     }
 };
 
 
-// ShapeManagement Class
+// ==============================
+// ShapeLoadGenerator Class
+// ==============================
+// Drives a ShapeServer from several connections, each keeping a fixed
+// number of requests in flight, and reports throughput and latency as
+// JSON. A request's latency runs from the send of its pipelined batch to
+// the arrival of its response. Writes add a square; reads ask for the area
+// or perimeter of one of the first hundred shapes.
+
+struct LoadConfig {
+    ServerAddress address;
+    int connections = 4;
+    size_t requests = 100000;  // Across all connections
+    int pipeline = 16;         // Requests in flight per connection
+    int writePercent = 10;
+    uint64_t seed = 42;
+};
 
-class ShapeManagement {
+class ShapeLoadGenerator {
 private:
-    ShapeList shapes;  // Composition: ShapeManagement "has-a" ShapeList
+    LoadConfig config;
 
-public:
-    // Display menu options
-    void displayMenu() {
-        cout << "\n\n Shape Management Menu " << endl;
-        cout << "1. Add a shape" << endl;
-        cout << "2. Remove a shape" << endl;
-        cout << "3. Display all shapes" << endl;
-        cout << "4. Translate all shapes" << endl;
-        cout << "5. Scale all shapes" << endl;
-        cout << "6. Get area of a shape by position" << endl;
-        cout << "7. Get perimeter of a shape by position" << endl;
-        cout << "0. Exit\n\n" << endl;
-    }
+    struct Result {
+        LatencyHistogram latency;
+        size_t errors = 0;
+        string failure;
+    };
 
-    // Add a shape (user selects type and provides input)
-    void addShape() {
-        int type;
-        cout << "Select shape type: 1-Rectangle, 2-Circle, 3-Square, 4-Triangle: ";
-        cin >> type;
+    void drive(size_t requests, uint64_t seed, Result& result) {
+        ShapeClient client;
+        if (!client.connect(config.address, result.failure)) {
+            return;
+        }
+        uint64_t state = seed;
+        auto next = [&state]() {
+            state = state * 6364136223846793005ull + 1442695040888963407ull;
+            return state >> 33;
+        };
+        string batch, payload;
+        for (size_t done = 0; done < requests;) {
+            size_t count = min(static_cast<size_t>(max(config.pipeline, 1)), requests - done);
+            batch.clear();
+            for (size_t i = 0; i < count; ++i) {
+                if (static_cast<int>(next() % 100) < config.writePercent) {
+                    batch += "add square " + to_string(next() % 1000) + " " + to_string(next() % 1000) + " 2\n";
+                } else {
+                    batch += (next() % 2 == 0 ? "area " : "perimeter ") + to_string(next() % 100) + "\n";
+                }
+            }
+            auto start = chrono::steady_clock::now();
+            if (!client.send(batch)) {
+                result.failure = "Connection lost while sending.";
+                return;
+            }
+            for (size_t i = 0; i < count; ++i) {
+                bool ok;
+                if (!client.receive(ok, payload)) {
+                    result.failure = "Connection lost while receiving.";
+                    return;
+                }
+                auto elapsed = chrono::steady_clock::now() - start;
+                result.latency.record(static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(elapsed).count()));
+                if (!ok) {
+                    result.errors++;
+                }
+            }
+            done += count;
+        }
+    }
 
-        if (type == 1) {
-            int x, y;
-            double width, length;
-            cout << "Enter x y coordinates: ";
-            cin >> x >> y;
-            cout << "Enter width and length: ";
-            cin >> width >> length;
-            shapes.addShape(new Rectangle(Coordinates(x, y), width, length));
+public:
+    explicit ShapeLoadGenerator(const LoadConfig& cfg) : config(cfg) {}
+
+    // Run the load and write the report; returns false with a message if a connection failed
+    bool run(ostream& out, string& error) {
+        int connections = max(config.connections, 1);
+        vector<Result> results(connections);
+        vector<thread> threads;
+        auto start = chrono::steady_clock::now();
+        for (int c = 0; c < connections; ++c) {
+            size_t share = config.requests / connections + (static_cast<size_t>(c) < config.requests % connections ? 1 : 0);
+            threads.emplace_back([this, share, c, &results]() { drive(share, config.seed + c, results[c]); });
         }
-        else if (type == 2) {
-            int x, y;
-            double radius;
-            cout << "Enter x y coordinates: ";
-            cin >> x >> y;
-            cout << "Enter radius: ";
-            cin >> radius;
-            shapes.addShape(new Circle(Coordinates(x, y), radius));
+        for (thread& t : threads) {
+            t.join();
         }
-        else if (type == 3) {
-            int x, y;
-            double side;
-            cout << "Enter x y coordinates: ";
-            cin >> x >> y;
-            cout << "Enter side length: ";
-            cin >> side;
-            shapes.addShape(new Square(Coordinates(x, y), side));
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        LatencyHistogram latency;
+        size_t errors = 0;
+        for (const Result& r : results) {
+            if (!r.failure.empty()) {
+                error = r.failure;
+                return false;
+            }
+            latency.merge(r.latency);
+            errors += r.errors;
         }
-        else if (type == 4) {
-            int x1, y1, x2, y2, x3, y3;
-            cout << "Enter coordinates of point 1: ";
-            cin >> x1 >> y1;
-            cout << "Enter coordinates of point 2: ";
-            cin >> x2 >> y2;
-            cout << "Enter coordinates of point 3: ";
-            cin >> x3 >> y3;
-            shapes.addShape(new Triangle(
-                Coordinates(x1, y1),
-                Coordinates(x2, y2),
-                Coordinates(x3, y3)
-            ));
-        } else {
-            cout << "Invalid shape type selected." << endl;
+        string report;
+        {
+            ShapeWriter json(report);
+            json << "{\n  \"connections\": " << connections << ",\n  \"pipeline\": " << config.pipeline
+                 << ",\n  \"requests\": " << latency.count() << ",\n  \"errors\": " << errors
+                 << ",\n  \"seconds\": " << seconds
+                 << ",\n  \"ops_per_sec\": " << (seconds > 0.0 ? static_cast<double>(latency.count()) / seconds : 0.0)
+                 << ",\n  \"latency_us\": {\"p50\": " << latency.percentile(50) / 1e3
+                 << ", \"p90\": " << latency.percentile(90) / 1e3 << ", \"p99\": " << latency.percentile(99) / 1e3
+                 << ", \"max\": " << latency.maxValue() / 1e3 << "}\n}\n";
         }
+        out << report;
+        return true;
     }
 
-    // Remove a shape at a given position
-    void removeShape() {
-        int pos;
-        cout << "Enter shape position to remove (starting from 0): ";
-        cin >> pos;
-        Shape* removed = shapes.removeShape(pos);
-        if (removed != nullptr) {
-            cout << "Shape removed: " << removed->display() << endl;
-            delete removed;  // Important: free memory
+    // Parse the address options shared by --serve and --load; returns false with a message on bad input
+    static bool parseAddress(const string& option, const string& value, ServerAddress& address, string& error) {
+        if (option == "--unix") {
+            address.unixPath = value;
+            return true;
         }
+        char* end = nullptr;
+        long port = strtol(value.c_str(), &end, 10);
+        if (value.empty() || *end != '\0' || port < 0 || port > 65535) {
+            error = "Invalid port '" + value + "'.";
+            return false;
+        }
+        address.port = static_cast<int>(port);
+        address.unixPath.clear();
+        return true;
     }
 
-    // Display all shapes
-    void displayShapes() {
-        cout << shapes.display();
-    }
-     
-        // Get area of a shape at a given position
-    void getAreaOfShape() {
-        int pos;
-        cout << "Enter shape position to calculate area (starting from 0): ";
-        cin >> pos;
-        double result = shapes.area(pos);
-        if (result >= 0) {
-            cout << "Area of shape at position " << pos << " = " << result << endl;
-        } else {
-            cout << "Invalid position. Cannot compute area." << endl;
+    // Parse the options that follow --load; returns false with a message on bad input
+    static bool parseArguments(int argc, char* argv[], int first, LoadConfig& cfg, string& error) {
+        for (int i = first; i < argc; ++i) {
+            string option = argv[i];
+            if (i + 1 >= argc) {
+                error = "Missing value for " + option + ".";
+                return false;
+            }
+            string value = argv[++i];
+            if (option == "--unix" || option == "--port") {
+                if (!parseAddress(option, value, cfg.address, error)) {
+                    return false;
+                }
+                continue;
+            }
+            char* end = nullptr;
+            unsigned long long number = strtoull(value.c_str(), &end, 10);
+            if (value.empty() || *end != '\0') {
+                error = "Invalid value '" + value + "' for " + option + ".";
+                return false;
+            }
+            if (option == "--connections") {
+                cfg.connections = max(1, static_cast<int>(number));
+            } else if (option == "--requests") {
+                cfg.requests = static_cast<size_t>(number);
+            } else if (option == "--pipeline") {
+                cfg.pipeline = max(1, static_cast<int>(number));
+            } else if (option == "--writes") {
+                cfg.writePercent = static_cast<int>(min(number, 100ull));
+            } else if (option == "--seed") {
+                cfg.seed = number;
+            } else {
+                error = "Unknown option " + option + ".";
+                return false;
+            }
+        }
+        if (cfg.address.unixPath.empty() && cfg.address.port == 0) {
+            error = "Give the server address with --unix <path> or --port <port>.";
+            return false;
         }
+        return true;
     }
+};
 
-    // Get perimeter of a shape at a given position
-    void getPerimeterOfShape() {
-        int pos;
-        cout << "Enter shape position to calculate perimeter (starting from 0): ";
-        cin >> pos;
-        double result = shapes.perimeter(pos);
-        if (result >= 0) {
-            cout << "Perimeter of shape at position " << pos << " = " << result << endl;
-        } else {
-            cout << "Invalid position. Cannot compute perimeter." << endl;
+
+// ==============================
+// Test function for ShapeServer class
+// ==============================
+void test_shape_server_class() {
+    cout << "\n========== Running test_shape_server_class() ==========" << endl;
+
+    int passed = 0, failed = 0;
+
+    // Test 1: Pipelined requests on a Unix socket are answered in order
+    ServerAddress address;
+    address.unixPath = "/tmp/shapes-test-" + to_string(getpid()) + ".sock";
+    string error, payload;
+    bool ok = false, inOrder = false, rejected = false;
+    {
+        ShapeManagement scene;
+        ShapeServer server(scene);
+        if (server.listenUnix(address.unixPath, error)) {
+            thread loop([&server]() { server.run(); });
+            ShapeClient client;
+            if (client.connect(address, error) &&
+                client.send("add rect,0,0,3,4\nadd circle 5 5 1\narea 0\nbogus\r\nperimeter 0\n")) {
+                bool good[5] = {};
+                string text[5];
+                bool received = true;
+                for (int i = 0; i < 5 && received; ++i) {
+                    received = client.receive(good[i], text[i]);
+                }
+                inOrder = received && good[0] && good[1] && good[2] && !good[3] && good[4] &&
+                          text[2] == "Area of shape at position 0 = 12\n" && text[3] == "Unknown command 'bogus'" &&
+                          text[4] == "Perimeter of shape at position 0 = 14\n";
+                rejected = client.send(string(70 * 1024, 'x')) && client.receive(ok, payload) && !ok &&
+                           payload == "Request line too long";
+            }
+            server.stop();
+            loop.join();
         }
     }
-    // Translate all shapes
-    void translateShapes() {
-        int dx, dy;
-        cout << "Enter dx and dy to translate all shapes: ";
-        cin >> dx >> dy;
-        shapes.translateShapes(dx, dy);
+    if (inOrder && rejected) {
+        cout << "Test 1 passed: Pipelined requests" << endl;
+        passed++;
+    } else {
+        cout << "Test 1 FAILED: Pipelined requests " << error << endl;
+        failed++;
     }
 
-    // Scale all shapes
-    void scaleShapes() {
-        int factor;
-        bool sign;
-        cout << "Enter scale factor: ";
-        cin >> factor;
-        cout << "Enter scale type (1 for multiply, 0 for divide): ";
-        cin >> sign;
-        shapes.scale(factor, sign);
+    // Test 2: Worker threads over TCP serve several load-generator connections
+    bool served = false;
+    {
+        ShapeManagement scene;
+        for (int i = 0; i < 100; ++i) {
+            scene.addShapeDirectly(new Square(Coordinates(i, i), 1.0));  // Every read hits a shape
+        }
+        ShapeServer server(scene, 2);
+        if (server.listenTcp(0, error)) {
+            thread loop([&server]() { server.run(); });
+            LoadConfig load;
+            load.address.port = server.port();
+            load.connections = 3;
+            load.requests = 3000;
+            load.pipeline = 8;
+            load.writePercent = 20;
+            ShapeLoadGenerator generator(load);
+            ostringstream report;
+            bool ran = generator.run(report, error);
+            ShapeClient client;
+            bool asked = client.connect(load.address, error) && client.send("totals\n") && client.receive(ok, payload);
+            long shapes = asked && payload.compare(0, 8, "Shapes: ") == 0 ? strtol(payload.c_str() + 8, nullptr, 10) : 0;
+            served = ran && asked && ok && server.requestsServed() == 3001 &&
+                     report.str().find("\"requests\": 3000,") != string::npos &&
+                     report.str().find("\"errors\": 0,") != string::npos && shapes > 500 && shapes < 1000;
+            server.stop();
+            loop.join();
+        }
+    }
+    if (served) {
+        cout << "Test 2 passed: Workers and load generator" << endl;
+        passed++;
+    } else {
+        cout << "Test 2 FAILED: Workers and load generator " << error << endl;
+        failed++;
     }
 
-            // Direct add method for testing (bypasses menu)
-        void addShapeDirectly(Shape* shape) {
-            shapes.addShape(shape);
+    // Test 3: A client that pipelines far more than it reads is throttled, then fully answered
+    bool throttled = false;
+    {
+        ShapeManagement scene;
+        scene.addShapeDirectly(new Rectangle(Coordinates(0, 0), 3, 4));
+        ShapeServer server(scene);
+        if (server.listenUnix(address.unixPath, error)) {
+            thread loop([&server]() { server.run(); });
+            ShapeClient client;
+            if (client.connect(address, error)) {
+                const int count = 200000;  // Requests padded to 13 MB, well over the input limit
+                string requests;
+                for (int i = 0; i < count; ++i) {
+                    requests += "area" + string(60, ' ') + "0\n";
+                }
+                bool sent = false;
+                thread sender([&]() { sent = client.send(requests); });
+                this_thread::sleep_for(chrono::milliseconds(100));  // Let both directions fill up
+                int answered = 0;
+                while (answered < count && client.receive(ok, payload) && ok &&
+                       payload == "Area of shape at position 0 = 12\n") {
+                    answered++;
+                }
+                sender.join();
+                throttled = sent && answered == count && server.requestsServed() == static_cast<uint64_t>(count);
+            }
+            server.stop();
+            loop.join();
         }
+    }
+    if (throttled) {
+        cout << "Test 3 passed: Flooding client throttled and answered" << endl;
+        passed++;
+    } else {
+        cout << "Test 3 FAILED: Flooding client throttled and answered " << error << endl;
+        failed++;
+    }
+
+    // Summary
+    cout << "========== Test Summary ==========" << endl;
+    cout << "Passed: " << passed << ", Failed: " << failed << endl;
+    cout << "==================================\n" << endl;
+}
+
+#endif
 
-        // Provide access to ShapeList for testing
-        ShapeList& getShapeList() {
-            return shapes;
-        }
-};
 
 // ==============================
 // Test function for ATI Test Plan
@@ -1191,24 +11332,20 @@ void test_ATI_functional_scenario() {
     ShapeList& shapeList = manager.getShapeList();
 
     // Step 1: Add Triangle
-    Triangle* t = new Triangle(Coordinates(50, 50), Coordinates(20, 70), Coordinates(70, 70));
-    manager.addShapeDirectly(t);
+    shapeList.createShape<Triangle>(Coordinates(50, 50), Coordinates(20, 70), Coordinates(70, 70));
 
     // Step 2: Add Rectangle
-    Rectangle* r = new Rectangle(Coordinates(100, 20), 10, 15);
-    manager.addShapeDirectly(r);
+    shapeList.createShape<Rectangle>(Coordinates(100, 20), 10, 15);
 
     // Step 3: Add Circle
-    Circle* c = new Circle(Coordinates(80, 100), 25);
-    manager.addShapeDirectly(c);
+    shapeList.createShape<Circle>(Coordinates(80, 100), 25);
 
     // Step 4: Add Square
-    Square* s = new Square(Coordinates(90, 40), 20);
-    manager.addShapeDirectly(s);
+    shapeList.createShape<Square>(Coordinates(90, 40), 20);
 
     // Step 5: Add 3 more shapes
-    manager.addShapeDirectly(new Rectangle(Coordinates(10, 10), 5, 6));
-    manager.addShapeDirectly(new Triangle(Coordinates(0, 0), Coordinates(30, 0), Coordinates(15, 25)));
+    shapeList.createShape<Rectangle>(Coordinates(10, 10), 5, 6);
+    shapeList.createShape<Triangle>(Coordinates(0, 0), Coordinates(30, 0), Coordinates(15, 25));
     manager.addShapeDirectly(new Square(Coordinates(5, 5), 10));
 
     // Step 6: Area and perimeter of second shape (index 1)
@@ -1249,12 +11386,224 @@ void test_ATI_functional_scenario() {
     cout << "========== ATI Test Completed ==========" << endl;
 }
 
+// Run every unit test function
+void run_all_tests() {
+    test_shape_writer_class();
+    test_coordinate_class();
+    test_rectangle_class();
+    test_square_class();
+    test_circle_class();
+    test_triangle_class();
+    test_shape_list_class();
+    test_spatial_index_class();
+    test_work_stealing_pool_class();
+    test_shape_arena_class();
+    test_shape_list_stats_class();
+    test_scene_aggregates_class();
+    test_metric_index_class();
+    test_overlap_detector_class();
+    test_hit_tester_class();
+    test_columnar_shape_list_class();
+    test_variant_shape_list_class();
+    test_diagnostics_collector_class();
+    test_shape_slot_map_class();
+    test_cow_shape_list_class();
+    test_concurrent_shape_list_class();
+    test_shape_snapshot_class();
+#if defined(__unix__) || defined(__APPLE__)
+    test_write_ahead_log_class();
+#endif
+    test_shape_importer_class();
+    test_shape_benchmark_class();
+    test_shape_management_class();
+#if defined(__linux__)
+    test_shape_server_class();
+#endif
+    test_ATI_functional_scenario();
+}
+
 // Main Function
+//
+// Usage: shapes                  interactive menu
+//        shapes --script <file>  run a command script without the menu
+//        shapes --serve ...      serve the script commands over a socket
+//        shapes --load ...       measure a running server
+//        shapes --test           run the unit tests
 
-int main() {
+int main(int argc, char* argv[]) {
      //test_ATI_functional_scenario() ; 
+
+    if (argc >= 2 && string(argv[1]) == "--test") {
+        run_all_tests();
+        return 0;
+    }
+
+    if (argc >= 2 && string(argv[1]) == "--script") {
+        string logDir, error;
+        WalOptions logOptions;
+        bool valid = argc >= 3;
+        for (int i = 3; i < argc && valid; i += 2) {
+            valid = i + 1 < argc && ShapeManagement::parseLogOption(argv[i], argv[i + 1], logDir, logOptions, error);
+        }
+        if (!valid) {
+            if (!error.empty()) {
+                cout << error << endl;
+            }
+            cout << "Usage: " << argv[0] << " --script <file> [--log <dir>] [--sync always|interval|none]" << endl;
+            return 1;
+        }
+        ifstream script(argv[2]);
+        if (!script) {
+            cout << "Cannot open script file " << argv[2] << "." << endl;
+            return 1;
+        }
+        ios::sync_with_stdio(false);
+        BufferedOutput buffered;
+        streambuf* console = cout.rdbuf(&buffered);
+        int status = 0;
+        {
+            ShapeManagement manager;
+            if (logDir.empty() || manager.enableLog(logDir, logOptions)) {
+                manager.runScript(script, cout);
+            } else {
+                status = 1;  // Recovery was refused: nothing ran
+            }
+        }
+        cout.rdbuf(console);
+        return status;
+    }
+
+    if (argc >= 2 && string(argv[1]) == "--serve") {
+#if defined(__linux__)
+        ServerAddress address;
+        int workers = 0;
+        string error, logDir;
+        WalOptions logOptions;
+        bool valid = true;
+        for (int i = 2; i < argc && valid; i += 2) {
+            string option = argv[i];
+            if (i + 1 >= argc) {
+                error = "Missing value for " + option + ".";
+                valid = false;
+            } else if (option == "--unix" || option == "--port") {
+                valid = ShapeLoadGenerator::parseAddress(option, argv[i + 1], address, error);
+            } else if (option == "--workers") {
+                workers = max(0, atoi(argv[i + 1]));
+            } else if (!ShapeManagement::parseLogOption(option, argv[i + 1], logDir, logOptions, error)) {
+                if (error.empty()) {
+                    error = "Unknown option " + option + ".";
+                }
+                valid = false;
+            }
+        }
+        if (valid && address.unixPath.empty() && address.port == 0) {
+            error = "Give the address with --unix <path> or --port <port>.";
+            valid = false;
+        }
+        if (!valid) {
+            cout << error << endl;
+            cout << "Usage: " << argv[0] << " --serve (--unix <path> | --port <port>) [--workers N]"
+                 << " [--log <dir>] [--sync always|interval|none]" << endl;
+            return 1;
+        }
+
+        // SIGINT and SIGTERM stop the server cleanly (and remove the socket file)
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+        ShapeManagement manager;
+        if (!logDir.empty() && !manager.enableLog(logDir, logOptions)) {
+            return 1;
+        }
+        ShapeServer server(manager, workers);
+        bool listening = address.unixPath.empty() ? server.listenTcp(address.port, error)
+                                                  : server.listenUnix(address.unixPath, error);
+        if (!listening) {
+            cout << error << endl;
+            return 1;
+        }
+        cout << "Serving on " << (address.unixPath.empty() ? "127.0.0.1:" + to_string(server.port()) : address.unixPath)
+             << " with " << workers << " worker threads." << endl;
+        thread stopper([&server, signals]() {
+            int received;
+            sigwait(&signals, &received);
+            server.stop();
+        });
+        stopper.detach();
+        server.run();
+        cout << "Served " << server.requestsServed() << " requests." << endl;
+        return 0;
+#else
+        cout << "Server mode needs Linux (epoll)." << endl;
+        return 1;
+#endif
+    }
+
+    if (argc >= 2 && string(argv[1]) == "--load") {
+#if defined(__linux__)
+        LoadConfig config;
+        string error;
+        if (!ShapeLoadGenerator::parseArguments(argc, argv, 2, config, error)) {
+            cout << error << endl;
+            cout << "Usage: " << argv[0] << " --load (--unix <path> | --port <port>) [--connections N]"
+                 << " [--requests N] [--pipeline N] [--writes PERCENT] [--seed N]" << endl;
+            return 1;
+        }
+        ShapeLoadGenerator generator(config);
+        if (!generator.run(cout, error)) {
+            cout << error << endl;
+            return 1;
+        }
+        return 0;
+#else
+        cout << "Load generator needs Linux." << endl;
+        return 1;
+#endif
+    }
+
+    if (argc >= 2 && string(argv[1]) == "--bench") {
+        BenchmarkConfig config;
+        string outPath, error;
+        if (!ShapeBenchmark::parseArguments(argc, argv, 2, config, outPath, error)) {
+            cout << error << endl;
+            cout << "Usage: " << argv[0] << " --bench [--sizes 1e3,1e4,...] [--mix rect,square,circle,triangle]"
+                 << " [--reps N] [--removes N] [--threads N] [--seed N] [--lists shape,variant,columnar] [--out file]"
+                 << endl;
+            return 1;
+        }
+        ShapeBenchmark benchmark(config);
+        if (outPath.empty()) {
+            benchmark.run(cout);
+        } else {
+            ofstream report(outPath);
+            if (!report) {
+                cout << "Cannot open output file " << outPath << "." << endl;
+                return 1;
+            }
+            benchmark.run(report);
+        }
+        return 0;
+    }
     
+    string logDir, error;
+    WalOptions logOptions;
+    for (int i = 1; i < argc; i += 2) {
+        if (i + 1 >= argc || !ShapeManagement::parseLogOption(argv[i], argv[i + 1], logDir, logOptions, error)) {
+            if (!error.empty()) {
+                cout << error << endl;
+            }
+            cout << "Usage: " << argv[0] << " [--log <dir>] [--sync always|interval|none]" << endl;
+            return 1;
+        }
+    }
+
     ShapeManagement manager;  // Create shape manager
+    if (!logDir.empty() && !manager.enableLog(logDir, logOptions)) {
+        return 1;
+    }
     int choice;
 
     do {
@@ -1286,12 +11635,19 @@ int main() {
             case 7:
                 manager.getPerimeterOfShape();
                 break;
+            case 8:
+                manager.importShapes();
+                break;
+            case 9:
+                manager.showStatistics();
+                break;
             case 0:
                 cout << "Exiting program. Goodbye!" << endl;
                 break;
             default:
                 cout << "Invalid choice. Please try again." << endl;
         }
+        manager.commitLog();
 
     } while (choice != 0);  // Keep running until user selects Exit */
 